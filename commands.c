@@ -19,14 +19,26 @@ cmd_scrollback_up(struct terminal *term, int rows)
         return;
 
     const struct grid *grid = term->grid;
-    const int view = grid->view;
-    const int grid_rows = grid->num_rows;
 
     /* The view row number in scrollback relative coordinates. This is
      * the maximum number of rows we're allowed to scroll */
     int sb_start = grid_sb_start_ignore_uninitialized(grid, term->rows);
     int view_sb_rel =
-        grid_row_abs_to_sb_precalc_sb_start(grid, sb_start, view);
+        grid_row_abs_to_sb_precalc_sb_start(grid, sb_start, grid->view);
+
+    /* Reflow scrollback deferred by a resize, and page in spilled
+     * scrollback, as we scroll into it. Paging in may grow the ring,
+     * moving the view */
+    while (view_sb_rel < rows &&
+           (term_reflow_step(term) || term_spill_page_in(term, 0, NULL) > 0))
+    {
+        sb_start = grid_sb_start_ignore_uninitialized(grid, term->rows);
+        view_sb_rel =
+            grid_row_abs_to_sb_precalc_sb_start(grid, sb_start, grid->view);
+    }
+
+    const int view = grid->view;
+    const int grid_rows = grid->num_rows;
 
     rows = min(rows, view_sb_rel);
     if (rows == 0)
@@ -102,6 +114,10 @@ cmd_scrollback_down(struct terminal *term, int rows)
     selection_view_down(term, new_view);
     term->grid->view = new_view;
 
+    /* Back at the bottom; re-compress the rows we've been viewing */
+    if (new_view == offset)
+        term_compress_scrollback(term);
+
     if (rows < term->rows) {
         term_damage_scroll(
             term, DAMAGE_SCROLL_IN_VIEW,
@@ -1173,6 +1173,29 @@ parse_section_scrollback(struct context *ctx)
     else if (streq(key, "multiplier"))
         return value_to_float(ctx, &conf->scrollback.multiplier);
 
+    else if (streq(key, "compress-after")) {
+        uint32_t lines;
+        if (!value_to_uint32(ctx, 10, &lines))
+            return false;
+
+        /* Used as a (signed) row count. Anything this large means
+         * "never" anyway */
+        conf->scrollback.compress_after = min(lines, INT32_MAX);
+        return true;
+    }
+
+    else if (streq(key, "memory-limit"))
+        return value_to_uint32(ctx, 10, &conf->scrollback.memory_limit);
+
+    else if (streq(key, "spill"))
+        return value_to_bool(ctx, &conf->scrollback.spill.enabled);
+
+    else if (streq(key, "spill-directory"))
+        return value_to_str(ctx, &conf->scrollback.spill.directory);
+
+    else if (streq(key, "spill-limit"))
+        return value_to_uint32(ctx, 10, &conf->scrollback.spill.limit);
+
     else {
         LOG_CONTEXTUAL_ERR("not a valid option: %s", key);
         return false;
@@ -2583,7 +2606,8 @@ parse_section_tweak(struct context *ctx)
             return false;
 
         if (ns > 16666666) {
-            LOG_CONTEXTUAL_ERR("timeout must not exceed 16ms");
+            LOG_CONTEXTUAL_ERR(
+                "timeout must not exceed 16666666ns (one frame at 60Hz)");
             return false;
         }
 
@@ -2597,7 +2621,8 @@ parse_section_tweak(struct context *ctx)
             return false;
 
         if (ns > 16666666) {
-            LOG_CONTEXTUAL_ERR("timeout must not exceed 16ms");
+            LOG_CONTEXTUAL_ERR(
+                "timeout must not exceed 16666666ns (one frame at 60Hz)");
             return false;
         }
 
@@ -2605,6 +2630,24 @@ parse_section_tweak(struct context *ctx)
         return true;
     }
 
+    else if (streq(key, "ptmx-read-budget")) {
+        uint32_t ns;
+        if (!value_to_uint32(ctx, 10, &ns))
+            return false;
+
+        if (ns > 16666666) {
+            LOG_CONTEXTUAL_ERR(
+                "budget must not exceed 16666666ns (one frame at 60Hz)");
+            return false;
+        }
+
+        conf->tweak.ptmx_read_budget_ns = ns;
+        return true;
+    }
+
+    else if (streq(key, "parallel-reflow"))
+        return value_to_bool(ctx, &conf->tweak.parallel_reflow);
+
     else if (streq(key, "max-shm-pool-size-mb")) {
         uint32_t mb;
         if (!value_to_uint32(ctx, 10, &mb))
@@ -3149,6 +3192,13 @@ config_load(struct config *conf, const char *conf_path,
                 .text = xc32dup(U""),
             },
             .multiplier = 3.,
+            .compress_after = 0,
+            .memory_limit = 0,
+            .spill = {
+                .enabled = false,
+                .directory = NULL,
+                .limit = 1024,
+            },
         },
         .colors = {
             .fg = default_foreground,
@@ -3223,6 +3273,7 @@ config_load(struct config *conf, const char *conf_path,
             .grapheme_width_method = GRAPHEME_WIDTH_DOUBLE,
             .delayed_render_lower_ns = 500000,         /* 0.5ms */
             .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
+            .ptmx_read_budget_ns = 4000000,            /* 4ms */
             .max_shm_pool_size = 512 * 1024 * 1024,
             .render_timer = RENDER_TIMER_NONE,
             .damage_whole_window = false,
@@ -3230,6 +3281,7 @@ config_load(struct config *conf, const char *conf_path,
             .box_drawing_solid_shades = true,
             .font_monospace_warn = true,
             .sixel = true,
+            .parallel_reflow = false,
         },
 
         .touch = {
@@ -3503,6 +3555,9 @@ config_clone(const struct config *old)
     conf->app_id = xstrdup(old->app_id);
     conf->word_delimiters = xc32dup(old->word_delimiters);
     conf->scrollback.indicator.text = xc32dup(old->scrollback.indicator.text);
+    conf->scrollback.spill.directory =
+        old->scrollback.spill.directory != NULL
+            ? xstrdup(old->scrollback.spill.directory) : NULL;
     conf->server_socket_path = xstrdup(old->server_socket_path);
     spawn_template_clone(&conf->bell.command, &old->bell.command);
     spawn_template_clone(&conf->desktop_notifications.command,
@@ -3592,6 +3647,7 @@ config_free(struct config *conf)
     free(conf->word_delimiters);
     spawn_template_free(&conf->bell.command);
     free(conf->scrollback.indicator.text);
+    free(conf->scrollback.spill.directory);
     spawn_template_free(&conf->desktop_notifications.command);
     spawn_template_free(&conf->desktop_notifications.command_action_arg);
     spawn_template_free(&conf->desktop_notifications.close);
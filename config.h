@@ -200,6 +200,14 @@ struct config {
             char32_t *text;
         } indicator;
         float multiplier;
+        uint32_t compress_after;
+        uint32_t memory_limit;  /* MiB, 0 = unlimited */
+
+        struct {
+            bool enabled;
+            char *directory;  /* NULL: $XDG_CACHE_HOME, or /var/tmp */
+            uint32_t limit;   /* MiB, 0 = unlimited */
+        } spill;
     } scrollback;
 
     struct {
@@ -370,11 +378,13 @@ struct config {
         bool damage_whole_window;
         uint32_t delayed_render_lower_ns;
         uint32_t delayed_render_upper_ns;
+        uint32_t ptmx_read_budget_ns;
         off_t max_shm_pool_size;
         float box_drawing_base_thickness;
         bool box_drawing_solid_shades;
         bool font_monospace_warn;
         bool sixel;
+        bool parallel_reflow;
     } tweak;
 
     struct {
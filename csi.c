@@ -74,13 +74,8 @@ csi_as_string(struct terminal *term, uint8_t final, int idx)
 }
 
 static void
-csi_sgr(struct terminal *term)
+csi_sgr_dispatch(struct terminal *term)
 {
-    if (term->vt.params.idx == 0) {
-        sgr_reset(term);
-        return;
-    }
-
     for (size_t i = 0; i < term->vt.params.idx; i++) {
         const int param = term->vt.params.v[i].value;
 
@@ -317,6 +312,160 @@ csi_sgr(struct terminal *term)
     }
 }
 
+static size_t
+sgr_cache_slot(const struct terminal *term)
+{
+    /* FNV-1a, of the raw parameter bytes and the current attributes */
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < term->vt.params.raw_len; i++) {
+        hash ^= term->vt.params.raw[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    uint64_t attrs;
+    memcpy(&attrs, &term->vt.attrs, sizeof(attrs));
+    hash ^= attrs;
+    hash *= 0x100000001b3ull;
+    hash ^= term->vt.underline.style | term->vt.underline.color_src << 4;
+    hash *= 0x100000001b3ull;
+    hash ^= term->vt.underline.color;
+    hash *= 0x100000001b3ull;
+
+    return (hash ^ (hash >> 32)) % ALEN(term->sgr_cache.entries);
+}
+
+static void
+csi_sgr(struct terminal *term)
+{
+    if (term->vt.params.idx == 0) {
+        sgr_reset(term);
+        return;
+    }
+
+    const uint8_t raw_len = term->vt.params.raw_len;
+
+    if (unlikely(raw_len == 0 || raw_len > sizeof(term->vt.params.raw))) {
+        /* Parameters too long to be cached */
+        csi_sgr_dispatch(term);
+        return;
+    }
+
+    struct sgr_cache_entry *e =
+        &term->sgr_cache.entries[sgr_cache_slot(term)];
+
+    const bool underline_style = term->bits_affecting_ascii_printer.underline_style;
+    const bool underline_color = term->bits_affecting_ascii_printer.underline_color;
+
+    if (e->len == raw_len &&
+        e->underline_style_in == underline_style &&
+        e->underline_color_in == underline_color &&
+        memcmp(e->raw, term->vt.params.raw, raw_len) == 0 &&
+        memcmp(&e->attrs_in, &term->vt.attrs, sizeof(e->attrs_in)) == 0 &&
+        memcmp(&e->underline_in, &term->vt.underline, sizeof(e->underline_in)) == 0)
+    {
+        term->sgr_cache.hits++;
+        term->vt.attrs = e->attrs_out;
+        term->vt.underline = e->underline_out;
+
+        if (e->underline_style_out != underline_style ||
+            e->underline_color_out != underline_color)
+        {
+            term->bits_affecting_ascii_printer.underline_style = e->underline_style_out;
+            term->bits_affecting_ascii_printer.underline_color = e->underline_color_out;
+            term_update_ascii_printer(term);
+        }
+        return;
+    }
+
+    term->sgr_cache.misses++;
+
+    e->len = raw_len;
+    memcpy(e->raw, term->vt.params.raw, raw_len);
+    e->attrs_in = term->vt.attrs;
+    e->underline_in = term->vt.underline;
+    e->underline_style_in = underline_style;
+    e->underline_color_in = underline_color;
+
+    csi_sgr_dispatch(term);
+
+    e->attrs_out = term->vt.attrs;
+    e->underline_out = term->vt.underline;
+    e->underline_style_out = term->bits_affecting_ascii_printer.underline_style;
+    e->underline_color_out = term->bits_affecting_ascii_printer.underline_color;
+}
+
+/* Parse a parameter string into term->vt.params, like vt.c does */
+static void UNUSED
+sgr_test_parse(struct terminal *term, const char *params)
+{
+    term->vt.params.idx = 0;
+    term->vt.params.raw_len = 0;
+
+    struct vt_param *param = NULL;
+
+    for (const char *p = params; *p != '\0'; p++) {
+        if (param == NULL) {
+            param = &term->vt.params.v[term->vt.params.idx++];
+            *param = (struct vt_param){0};
+        }
+
+        if (*p == ';') {
+            param = &term->vt.params.v[term->vt.params.idx++];
+            *param = (struct vt_param){0};
+        } else if (*p == ':')
+            param->sub.cur = &param->sub.value[param->sub.idx++];
+        else if (param->sub.cur != NULL)
+            *param->sub.cur = *param->sub.cur * 10 + (*p - '0');
+        else
+            param->value = param->value * 10 + (*p - '0');
+
+        term->vt.params.raw[term->vt.params.raw_len++] = *p;
+    }
+}
+
+UNITTEST
+{
+    struct terminal term = {.vt = {.state = 0}};
+
+    const char *const sequences[] = {
+        "1", "31", "1;31", "0", "4:3", "58:2::1:2:3", "38;5;200", "21", "4",
+        "59", "24", "1;31", "48;2;1;2;3", "0", "4:3", "1",
+    };
+
+    /* Run the same sequences twice; second round should be all hits */
+    for (size_t round = 0; round < 2; round++) {
+        term.vt.attrs = (struct attributes){0};
+        term.vt.underline = (struct underline_range_data){0};
+        term.bits_affecting_ascii_printer.value = 0;
+
+        for (size_t i = 0; i < ALEN(sequences); i++) {
+            sgr_test_parse(&term, sequences[i]);
+
+            /* Reference result */
+            struct terminal ref = {
+                .vt = {
+                    .params = term.vt.params,
+                    .attrs = term.vt.attrs,
+                    .underline = term.vt.underline,
+                },
+                .bits_affecting_ascii_printer = term.bits_affecting_ascii_printer,
+            };
+            csi_sgr_dispatch(&ref);
+
+            csi_sgr(&term);
+
+            xassert(memcmp(&term.vt.attrs, &ref.vt.attrs, sizeof(ref.vt.attrs)) == 0);
+            xassert(memcmp(&term.vt.underline, &ref.vt.underline, sizeof(ref.vt.underline)) == 0);
+            xassert(term.bits_affecting_ascii_printer.value ==
+                    ref.bits_affecting_ascii_printer.value);
+        }
+    }
+
+    xassert(term.sgr_cache.hits > 0);
+    xassert(term.sgr_cache.hits + term.sgr_cache.misses == 2 * ALEN(sequences));
+}
+
 static void
 decset_decrst(struct terminal *term, unsigned param, bool enable)
 {
@@ -1103,6 +1252,12 @@ csi_dispatch(struct terminal *term, uint8_t final)
             memmove(&term->grid->cur_row->cells[term->grid->cursor.point.col + count],
                     &term->grid->cur_row->cells[term->grid->cursor.point.col],
                     remaining * sizeof(term->grid->cur_row->cells[0]));
+
+            if (term->grid->cur_row->used > term->grid->cursor.point.col) {
+                term->grid->cur_row->used = min(
+                    term->grid->cur_row->used + count, term->cols);
+            }
+
             for (size_t c = 0; c < remaining; c++)
                 term->grid->cur_row->cells[term->grid->cursor.point.col + count + c].attrs.clean = 0;
             term->grid->cur_row->dirty = true;
@@ -1994,6 +2149,7 @@ csi_dispatch(struct terminal *term, uint8_t final)
                 struct cell *cell = &row->cells[dst_left];
                 memcpy(cell, copy[r], cell_count * sizeof(copy[r][0]));
                 free(copy[r]);
+                grid_row_mark_used(row, dst_left + cell_count);
 
                 for (;cell < &row->cells[dst_left + cell_count]; cell++)
                     cell->attrs.clean = 0;
@@ -2106,6 +2262,7 @@ csi_dispatch(struct terminal *term, uint8_t final)
                 memcpy(&term->colors, &term->color_stack.stack[slot - 1],
                        sizeof(term->colors));
                 term->color_stack.idx = slot - 1;
+                term_colors_changed(term);
 
                 /* Assume a full palette switch *will* affect almost
                    all cells. The alternative is to call
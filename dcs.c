@@ -193,6 +193,25 @@ xtgettcap_put(struct terminal *term, uint8_t c)
     vt->dcs.data[vt->dcs.idx++] = c;
 }
 
+static void
+xtgettcap_put_span(struct terminal *term, const uint8_t *data, size_t len)
+{
+    struct vt *vt = &term->vt;
+
+    /* Grow buffer expontentially */
+    if (vt->dcs.idx + len > vt->dcs.size) {
+        size_t new_size = max(vt->dcs.size, 128);
+        while (new_size < vt->dcs.idx + len)
+            new_size *= 2;
+
+        if (!ensure_size(term, new_size))
+            return;
+    }
+
+    memcpy(&vt->dcs.data[vt->dcs.idx], data, len);
+    vt->dcs.idx += len;
+}
+
 static void
 xtgettcap_unhook(struct terminal *term)
 {
@@ -251,6 +270,13 @@ decrqss_put(struct terminal *term, uint8_t c)
     vt->dcs.data[vt->dcs.idx++] = c;
 }
 
+static void
+decrqss_put_span(struct terminal *term, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len && term->vt.dcs.idx < 2; i++)
+        decrqss_put(term, data[i]);
+}
+
 static void
 decrqss_unhook(struct terminal *term)
 {
@@ -451,6 +477,7 @@ dcs_hook(struct terminal *term, uint8_t final)
     xassert(term->vt.dcs.data == NULL);
     xassert(term->vt.dcs.size == 0);
     xassert(term->vt.dcs.put_handler == NULL);
+    xassert(term->vt.dcs.put_span_handler == NULL);
     xassert(term->vt.dcs.unhook_handler == NULL);
 
     switch (term->vt.private) {
@@ -465,6 +492,7 @@ dcs_hook(struct terminal *term, uint8_t final)
             int p3 = vt_param_get(term, 2, 0);
 
             term->vt.dcs.put_handler = sixel_init(term, p1, p2, p3);
+            term->vt.dcs.put_span_handler = &sixel_put_span;
             term->vt.dcs.unhook_handler = &sixel_unhook;
             break;
         }
@@ -475,6 +503,7 @@ dcs_hook(struct terminal *term, uint8_t final)
         switch (final) {
         case 'q':
             term->vt.dcs.put_handler = &decrqss_put;
+            term->vt.dcs.put_span_handler = &decrqss_put_span;
             term->vt.dcs.unhook_handler = &decrqss_unhook;
             break;
         }
@@ -500,6 +529,7 @@ dcs_hook(struct terminal *term, uint8_t final)
         switch (final) {
         case 'q':  /* XTGETTCAP */
             term->vt.dcs.put_handler = &xtgettcap_put;
+            term->vt.dcs.put_span_handler = &xtgettcap_put_span;
             term->vt.dcs.unhook_handler = &xtgettcap_unhook;
             break;
         }
@@ -516,6 +546,18 @@ dcs_put(struct terminal *term, uint8_t c)
         term->vt.dcs.put_handler(term, c);
 }
 
+void
+dcs_put_span(struct terminal *term, const uint8_t *data, size_t len)
+{
+    if (term->vt.dcs.put_span_handler != NULL) {
+        term->vt.dcs.put_span_handler(term, data, len);
+        return;
+    }
+
+    for (size_t i = 0; i < len && term->vt.dcs.put_handler != NULL; i++)
+        term->vt.dcs.put_handler(term, data[i]);
+}
+
 void
 dcs_unhook(struct terminal *term)
 {
@@ -524,6 +566,7 @@ dcs_unhook(struct terminal *term)
 
     term->vt.dcs.unhook_handler = NULL;
     term->vt.dcs.put_handler = NULL;
+    term->vt.dcs.put_span_handler = NULL;
 
     free(term->vt.dcs.data);
     term->vt.dcs.data = NULL;
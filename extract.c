@@ -269,3 +269,36 @@ err:
     ctx->failed = true;
     return false;
 }
+
+bool
+extract_empty(const struct terminal *term, const struct row *row,
+              const struct cell *cell, int col, size_t count, void *context)
+{
+    struct extraction_context *ctx = context;
+
+    if (count == 0)
+        return true;
+
+    /* Let extract_one() deal with the row transition */
+    if (ctx->last_row != row) {
+        if (!extract_one(term, row, cell, col, ctx))
+            return false;
+
+        cell++;
+        count--;
+    }
+
+#if defined(_DEBUG)
+    for (size_t i = 0; i < count; i++)
+        xassert(cell[i].wc == 0);
+#endif
+
+    if (count > 0) {
+        ctx->tab_spaces_left = 0;
+        ctx->empty_count += count;
+        ctx->last_row = row;
+        ctx->last_cell = &cell[count - 1];
+    }
+
+    return true;
+}
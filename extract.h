@@ -15,6 +15,14 @@ bool extract_one(
     const struct terminal *term, const struct row *row, const struct cell *cell,
     int col, void *context);
 
+/*
+ * Same as calling extract_one() on each of the 'count' empty cells
+ * (i.e. cells after the row's used width), starting at 'cell'
+ */
+bool extract_empty(
+    const struct terminal *term, const struct row *row, const struct cell *cell,
+    int col, size_t count, void *context);
+
 bool extract_finish(
     struct extraction_context *context, char **text, size_t *len);
 bool extract_finish_wide(
@@ -41,6 +41,7 @@ typedef tll(struct hook) hooks_t;
 struct fdm {
     int epoll_fd;
     bool is_polling;
+    int pending;  /* Events not yet dispatched, in current fdm_poll() */
     tll(struct fd_handler *) fds;
     tll(struct fd_handler *) deferred_delete;
 
@@ -462,12 +463,14 @@ fdm_poll(struct fdm *fdm)
         if (fd->deleted)
             continue;
 
+        fdm->pending = r - i - 1;
         if (!fd->callback(fdm, fd->fd, events[i].events, fd->callback_data)) {
             ret = false;
             break;
         }
     }
     fdm->is_polling = false;
+    fdm->pending = 0;
 
     tll_foreach(fdm->deferred_delete, it) {
         free(it->item);
@@ -476,3 +479,9 @@ fdm_poll(struct fdm *fdm)
 
     return ret;
 }
+
+int
+fdm_pending_events(const struct fdm *fdm)
+{
+    return fdm->pending;
+}
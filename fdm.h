@@ -32,3 +32,4 @@ bool fdm_signal_add(struct fdm *fdm, int signo, fdm_signal_handler_t handler, vo
 bool fdm_signal_del(struct fdm *fdm, int signo);
 
 bool fdm_poll(struct fdm *fdm);
+int fdm_pending_events(const struct fdm *fdm);
@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <unistd.h>
 
 #define LOG_MODULE "grid"
 #define LOG_ENABLE_DBG 0
@@ -10,12 +12,97 @@
 #include "debug.h"
 #include "macros.h"
 #include "sixel.h"
+#include "slab.h"
+#include "spill.h"
 #include "stride.h"
 #include "util.h"
 #include "xmalloc.h"
 
 #define TIME_REFLOW 0
 
+/* Approximate size of each cell array chunk */
+#define CELL_CHUNK_SIZE (64 * 1024)
+#define ROWS_PER_CHUNK 256
+
+struct grid_slab {
+    int cols;
+    int refs;
+    struct slab *rows;
+    struct slab *cells;
+};
+
+/*
+ * Compressed row format:
+ *
+ * The row starts with an attribute table: the number of distinct
+ * attributes (LEB128), followed by the attributes themselves (with
+ * the 'clean' bit masked out).
+ *
+ * Cells are grouped in runs of identical attributes. Each run is
+ * encoded as its length (LEB128), followed by an index into the
+ * attribute table (LEB128), followed by each cell's character
+ * (LEB128). Trailing empty cells are not encoded at all.
+ *
+ * Since most scrollback lines consist of a handful of attribute runs,
+ * using even fewer distinct attributes, and mostly ASCII, this
+ * typically shrinks a row to ~1 byte per used cell, compared to 12
+ * bytes per (used or unused) cell.
+ */
+struct row_compressed {
+    int cols;
+    size_t size;
+    uint8_t data[];
+};
+
+/*
+ * Lazy reflow
+ *
+ * When reflowing a large scrollback, only the rows close to the
+ * screen (and the viewport, and any tracking points) are reflowed
+ * right away. The older rows are left, as-is, in the old ring, and
+ * are reflowed later, in chunks, by grid_reflow_step(). Reflowed
+ * chunks are prepended to the ring, in front of 'top'.
+ *
+ * Each resize that defers rows adds a segment. Segments are ordered
+ * newest first, and each segment is reflowed from its newest row.
+ */
+#define REFLOW_LAZY_MIN_ROWS 8192
+#define REFLOW_LAZY_MARGIN 1024
+
+/*
+ * Parallel reflow
+ *
+ * Large grids are split into chunks, at hard linebreaks, and each
+ * chunk is reflowed, as a grid of its own, on a worker thread. The
+ * reflowed chunks are then stitched together into the new ring.
+ */
+#define REFLOW_PARALLEL_MIN_ROWS 16384
+#define REFLOW_JOBS_PER_THREAD 4
+
+enum reflow_flags {
+    REFLOW_LAZY = 1 << 0,           /* Defer the oldest rows */
+    REFLOW_KEEP_OLD_ROWS = 1 << 1,  /* Old rows are free:d by the caller */
+    REFLOW_NO_CURSORS = 1 << 2,     /* Don't track the (saved) cursor */
+};
+
+typedef tll(struct sixel) sixel_list_t;
+
+struct reflow_segment {
+    struct row **rows;
+    int num_rows;
+    int num_cols;
+    int first;     /* Ring index of the oldest deferred row */
+    int count;     /* Number of deferred rows, including empty ones */
+    struct grid_slab *slab;
+    tll(struct sixel) sixel_images;
+};
+
+struct grid_reflow {
+    int top;       /* Ring index of the oldest reflowed row */
+    size_t thread_count;
+    tll(struct reflow_segment) segments;
+};
+
 /*
  * "sb" (scrollback relative) coordinates
  *
@@ -102,8 +189,8 @@ verify_no_overlapping_ranges_of_type(const struct row_ranges *ranges,
                 switch (type) {
                 case ROW_RANGE_URI:
                     BUG("OSC-8 URI overlap: %s: %d-%d: %s: %d-%d",
-                        r1->uri.uri, r1->start, r1->end,
-                        r2->uri.uri, r2->start, r2->end);
+                        r1->uri.link->uri, r1->start, r1->end,
+                        r2->uri.link->uri, r2->start, r2->end);
                     break;
 
                 case ROW_RANGE_UNDERLINE:
@@ -140,8 +227,8 @@ verify_ranges_of_type_are_sorted(const struct row_ranges *ranges,
                 case ROW_RANGE_URI:
                     BUG("OSC-8 URI not sorted correctly: "
                         "%s: %d-%d came before %s: %d-%d",
-                        last->uri.uri, last->start, last->end,
-                        r->uri.uri, r->start, r->end);
+                        last->uri.link->uri, last->start, last->end,
+                        r->uri.link->uri, r->start, r->end);
                     break;
 
                 case ROW_RANGE_UNDERLINE:
@@ -169,7 +256,8 @@ static void
 range_ensure_size(struct row_ranges *ranges, int count_to_add)
 {
     if (ranges->count + count_to_add > ranges->size) {
-        ranges->size = ranges->count + count_to_add;
+        /* Grow geometrically; ranges are typically added one by one */
+        ranges->size = max(ranges->count + count_to_add, ranges->size * 2);
         ranges->v = xrealloc(ranges->v, ranges->size * sizeof(ranges->v[0]));
     }
 
@@ -201,8 +289,7 @@ range_insert(struct row_ranges *ranges, size_t idx, int start, int end,
 
     switch (type) {
     case ROW_RANGE_URI:
-        r->uri.id = data->uri.id;
-        r->uri.uri = xstrdup(data->uri.uri);
+        r->uri.link = hyperlink_ref(data->uri.link);
         break;
 
     case ROW_RANGE_UNDERLINE:
@@ -224,8 +311,7 @@ range_append_by_ref(struct row_ranges *ranges, int start, int end,
 
     switch (type) {
     case ROW_RANGE_URI:
-        r->uri.id = data->uri.id;;
-        r->uri.uri = data->uri.uri;
+        r->uri.link = data->uri.link;
         break;
 
     case ROW_RANGE_UNDERLINE:
@@ -242,8 +328,7 @@ range_append(struct row_ranges *ranges, int start, int end,
     case ROW_RANGE_URI:
         range_append_by_ref(
             ranges, start, end, type,
-            &(union row_range_data){.uri = {.id = data->uri.id,
-                                            .uri = xstrdup(data->uri.uri)}});
+            &(union row_range_data){.uri = {.link = hyperlink_ref(data->uri.link)}});
         break;
 
     case ROW_RANGE_UNDERLINE:
@@ -253,16 +338,273 @@ range_append(struct row_ranges *ranges, int start, int end,
 }
 
 static void
-range_delete(struct row_ranges *ranges, enum row_range_type type, size_t idx)
+ranges_copy_truncated(struct row_ranges *dst, const struct row_ranges *src,
+                      enum row_range_type type, int cols)
+{
+    range_ensure_size(dst, src->count);
+
+    for (int i = 0; i < src->count; i++) {
+        const struct row_range *range = &src->v[i];
+
+        if (range->start >= cols) {
+            /* The whole range is truncated */
+            continue;
+        }
+
+        const int start = range->start;
+        const int end = min(range->end, cols - 1);
+        range_append(dst, start, end, type, &range->data);
+    }
+}
+
+/* Copies 'extra' to 'row', dropping everything at, or after, 'cols' */
+static void
+row_extra_copy_truncated(struct row *row, const struct row_data *extra, int cols)
+{
+    ensure_row_has_extra_data(row);
+    ranges_copy_truncated(
+        &row->extra->uri_ranges, &extra->uri_ranges, ROW_RANGE_URI, cols);
+    ranges_copy_truncated(
+        &row->extra->underline_ranges, &extra->underline_ranges,
+        ROW_RANGE_UNDERLINE, cols);
+}
+
+/* Deletes 'count' consecutive ranges, starting at 'idx' */
+static void
+range_delete_n(struct row_ranges *ranges, enum row_range_type type,
+               size_t idx, size_t count)
 {
-    xassert(idx < ranges->count);
-    grid_row_range_destroy(&ranges->v[idx], type);
+    xassert(idx + count <= ranges->count);
+
+    for (size_t i = idx; i < idx + count; i++)
+        grid_row_range_destroy(&ranges->v[i], type);
 
-    const size_t move_count = ranges->count - idx - 1;
+    const size_t move_count = ranges->count - idx - count;
     memmove(&ranges->v[idx],
-            &ranges->v[idx + 1],
+            &ranges->v[idx + count],
             move_count * sizeof(ranges->v[0]));
-    ranges->count--;
+    ranges->count -= count;
+}
+
+static void
+range_delete(struct row_ranges *ranges, enum row_range_type type, size_t idx)
+{
+    range_delete_n(ranges, type, idx, 1);
+}
+
+/*
+ * Ranges are sorted, and don't overlap. I.e. both their start, and
+ * end, points are sorted.
+ */
+
+/* Returns the index of the first range ending at, or after, 'col' */
+static int
+range_find_end(const struct row_ranges *ranges, int col)
+{
+    /* Fast path: appending to the row */
+    if (ranges->count == 0 || ranges->v[ranges->count - 1].end < col)
+        return ranges->count;
+
+    int lo = 0;
+    int hi = ranges->count - 1;
+
+    while (lo < hi) {
+        const int mid = lo + (hi - lo) / 2;
+        if (ranges->v[mid].end < col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Returns the index of the first range starting after 'col' */
+static int
+range_find_start(const struct row_ranges *ranges, int col)
+{
+    if (ranges->count == 0 || ranges->v[ranges->count - 1].start <= col)
+        return ranges->count;
+
+    int lo = 0;
+    int hi = ranges->count - 1;
+
+    while (lo < hi) {
+        const int mid = lo + (hi - lo) / 2;
+        if (ranges->v[mid].start <= col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+const struct row_range *
+grid_row_range_lookup(const struct row_ranges *ranges, int col)
+{
+    const int idx = range_find_end(ranges, col);
+    if (idx >= ranges->count)
+        return NULL;
+
+    const struct row_range *r = &ranges->v[idx];
+    return r->start <= col ? r : NULL;
+}
+
+const struct row_range *
+grid_row_range_cursor_lookup(struct row_range_cursor *cursor, int col)
+{
+    const struct row_ranges *ranges = cursor->ranges;
+    if (ranges == NULL || ranges->count == 0)
+        return NULL;
+
+    int idx = min(max(cursor->idx, 0), ranges->count - 1);
+
+    while (idx > 0 && ranges->v[idx].start > col)
+        idx--;
+    while (idx < ranges->count - 1 && ranges->v[idx].end < col)
+        idx++;
+
+    cursor->idx = idx;
+
+    const struct row_range *r = &ranges->v[idx];
+    return r->start <= col && col <= r->end ? r : NULL;
+}
+
+struct grid_slab *
+grid_slab_new(int cols)
+{
+    xassert(cols > 0);
+
+    const size_t cells_size = cols * sizeof(struct cell);
+
+    struct grid_slab *slab = xmalloc(sizeof(*slab));
+    *slab = (struct grid_slab){
+        .cols = cols,
+        .refs = 1,
+        .rows = slab_init(sizeof(struct row), ROWS_PER_CHUNK),
+        .cells = slab_init(cells_size, max(CELL_CHUNK_SIZE / cells_size, 1)),
+    };
+    return slab;
+}
+
+/*
+ * Drops a reference. All rows allocated from the slab must have been
+ * free:d when the last reference is dropped
+ */
+void
+grid_slab_destroy(struct grid_slab *slab)
+{
+    if (slab == NULL)
+        return;
+    if (--slab->refs > 0)
+        return;
+
+    slab_destroy(slab->rows);
+    slab_destroy(slab->cells);
+    free(slab);
+}
+
+static struct grid_slab *
+slab_ref(struct grid_slab *slab)
+{
+    if (slab != NULL)
+        slab->refs++;
+    return slab;
+}
+
+/*
+ * Returns the slab to allocate resized rows from. The current slab
+ * can be re-used if the column count hasn't changed.
+ */
+static struct grid_slab *
+slab_for_resize(const struct grid *grid, int new_cols)
+{
+    return grid->slab != NULL && grid->slab->cols == new_cols
+        ? grid->slab
+        : grid_slab_new(new_cols);
+}
+
+/* Must be called after all rows from the old slab have been free:d */
+static void
+slab_replace(struct grid *grid, struct grid_slab *new_slab)
+{
+    if (grid->slab != new_slab)
+        grid_slab_destroy(grid->slab);
+    grid->slab = new_slab;
+}
+
+static struct cell *
+cells_alloc(struct grid_slab *slab, int cols)
+{
+    if (slab == NULL)
+        return xmalloc(cols * sizeof(struct cell));
+
+    xassert(slab->cols == cols);
+    return slab_alloc(slab->cells);
+}
+
+static void
+cells_free(struct row *row)
+{
+    if (row->slab == NULL)
+        free(row->cells);
+    else
+        slab_free(row->slab->cells, row->cells);
+    row->cells = NULL;
+}
+
+static struct row *
+row_alloc(struct grid_slab *slab)
+{
+    struct row *row = slab != NULL
+        ? slab_alloc(slab->rows)
+        : xmalloc(sizeof(*row));
+
+    row->cells = NULL;
+    row->dirty = false;
+    row->linebreak = false;
+    row->used = 0;
+    row->extra = NULL;
+    row->compressed = NULL;
+    row->slab = slab;
+    row->shell_integration.prompt_marker = false;
+    row->shell_integration.cmd_start = -1;
+    row->shell_integration.cmd_end = -1;
+    return row;
+}
+
+struct row *
+grid_row_alloc(struct grid_slab *slab, int cols, bool initialize)
+{
+    struct row *row = row_alloc(slab);
+    row->cells = cells_alloc(slab, cols);
+
+    if (initialize) {
+        memset(row->cells, 0, cols * sizeof(row->cells[0]));
+        for (size_t c = 0; c < cols; c++)
+            row->cells[c].attrs.clean = 1;
+    } else
+        row->used = cols;  /* Unknown; up to the caller */
+
+    return row;
+}
+
+void
+grid_row_free(struct row *row)
+{
+    if (row == NULL)
+        return;
+
+    grid_row_reset_extra(row);
+    free(row->extra);
+    free(row->compressed);
+    cells_free(row);
+
+    if (row->slab == NULL)
+        free(row);
+    else
+        slab_free(row->slab->rows, row);
 }
 
 struct grid *
@@ -273,10 +615,13 @@ grid_snapshot(const struct grid *grid)
     clone->num_cols = grid->num_cols;
     clone->offset = grid->offset;
     clone->view = grid->view;
+    clone->compress_watermark = grid->compress_watermark;
     clone->cursor = grid->cursor;
     clone->saved_cursor = grid->saved_cursor;
     clone->kitty_kbd = grid->kitty_kbd;
     clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
+    clone->slab = grid_slab_new(grid->num_cols);
+    clone->reflow = NULL;
     memset(&clone->scroll_damage, 0, sizeof(clone->scroll_damage));
     memset(&clone->sixel_images, 0, sizeof(clone->sixel_images));
 
@@ -289,16 +634,25 @@ grid_snapshot(const struct grid *grid)
         if (row == NULL)
             continue;
 
-        struct row *clone_row = xmalloc(sizeof(*row));
+        struct row *clone_row = row_alloc(clone->slab);
         clone->rows[r] = clone_row;
 
-        clone_row->cells = xmalloc(grid->num_cols * sizeof(clone_row->cells[0]));
         clone_row->linebreak = row->linebreak;
         clone_row->dirty = row->dirty;
+        clone_row->used = row->used;
         clone_row->shell_integration = row->shell_integration;
 
-        for (int c = 0; c < grid->num_cols; c++)
-            clone_row->cells[c] = row->cells[c];
+        if (row->compressed != NULL) {
+            const size_t size =
+                sizeof(*row->compressed) + row->compressed->size;
+
+            clone_row->compressed = xmemdup(row->compressed, size);
+        } else {
+            clone_row->cells = cells_alloc(clone->slab, grid->num_cols);
+
+            for (int c = 0; c < grid->num_cols; c++)
+                clone_row->cells[c] = row->cells[c];
+        }
 
         const struct row_data *extra = row->extra;
 
@@ -411,6 +765,10 @@ grid_free(struct grid *grid)
 
     free(grid->rows);
     tll_free(grid->scroll_damage);
+
+    grid_reflow_discard(grid);
+    grid_slab_destroy(grid->slab);
+    grid->slab = NULL;
 }
 
 void
@@ -429,175 +787,783 @@ grid_swap_row(struct grid *grid, int row_a, int row_b)
     grid->rows[real_b] = a;
 }
 
-struct row *
-grid_row_alloc(int cols, bool initialize)
+static_assert(sizeof(struct attributes) == sizeof(uint64_t),
+              "compressed rows store attributes as 64-bit integers");
+
+/* Max number of attribute table entries to search for duplicates */
+#define COMPRESS_MAX_ATTR_LOOKUP 64
+
+static inline uint64_t
+cell_attrs_as_u64(const struct attributes *attrs)
 {
-    struct row *row = xmalloc(sizeof(*row));
-    row->dirty = false;
-    row->linebreak = false;
-    row->extra = NULL;
-    row->shell_integration.prompt_marker = false;
-    row->shell_integration.cmd_start = -1;
-    row->shell_integration.cmd_end = -1;
+    struct attributes a = *attrs;
 
-    if (initialize) {
-        row->cells = xcalloc(cols, sizeof(row->cells[0]));
-        for (size_t c = 0; c < cols; c++)
-            row->cells[c].attrs.clean = 1;
-    } else
-        row->cells = xmalloc(cols * sizeof(row->cells[0]));
+    /* Render state; decoded rows are re-rendered from scratch anyway */
+    a.clean = false;
+    a.confined = false;
 
-    return row;
+    uint64_t v;
+    memcpy(&v, &a, sizeof(v));
+    return v;
 }
 
-void
-grid_row_free(struct row *row)
+static inline size_t
+leb128_put(uint8_t *p, uint32_t v)
 {
-    if (row == NULL)
-        return;
-
-    grid_row_reset_extra(row);
-    free(row->extra);
-    free(row->cells);
-    free(row);
+    size_t len = 0;
+    while (v >= 0x80) {
+        p[len++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    p[len++] = v;
+    return len;
 }
 
-void
-grid_resize_without_reflow(
-    struct grid *grid, int new_rows, int new_cols,
-    int old_screen_rows, int new_screen_rows)
+static inline uint32_t
+leb128_get(const uint8_t **p)
 {
-    struct row *const *old_grid = grid->rows;
-    const int old_rows = grid->num_rows;
-    const int old_cols = grid->num_cols;
+    uint32_t v = 0;
+    int shift = 0;
 
-    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    while (**p & 0x80) {
+        v |= (uint32_t)(**p & 0x7f) << shift;
+        shift += 7;
+        (*p)++;
+    }
 
-    tll(struct sixel) untranslated_sixels = tll_init();
-    tll_foreach(grid->sixel_images, it)
-        tll_push_back(untranslated_sixels, it->item);
-    tll_free(grid->sixel_images);
+    v |= (uint32_t)**p << shift;
+    (*p)++;
+    return v;
+}
 
-    int new_offset = 0;
+void
+grid_row_compress(struct row *row, int cols)
+{
+    if (row->cells == NULL)
+        return;
 
-    /* Copy old lines, truncating them if old rows were longer */
-    for (int r = 0, n = min(old_screen_rows, new_screen_rows); r < n; r++) {
-        const int old_row_idx = (grid->offset + r) & (old_rows - 1);
-        const int new_row_idx = (new_offset + r) & (new_rows - 1);
+    const struct cell *cells = row->cells;
 
-        const struct row *old_row = old_grid[old_row_idx];
-        xassert(old_row != NULL);
+    /* Trailing empty cells are implicit */
+    int used = cols;
+    while (used > 0 && cells[used - 1].wc == 0 &&
+           cell_attrs_as_u64(&cells[used - 1].attrs) == 0)
+    {
+        used--;
+    }
 
-        struct row *new_row = grid_row_alloc(new_cols, false);
-        new_grid[new_row_idx] = new_row;
+    /*
+     * Scratch space: the attribute table, each cell's index into it,
+     * and the encoded row. Worst case for the latter: a run per cell,
+     * each with a unique attribute, and a 5-byte character
+     */
+    const size_t buf_size = 5 + used * (sizeof(uint64_t) + 5 + 5 + 5);
+    uint64_t *const attr_table = xmalloc(
+        (used + 1) * (sizeof(uint64_t) + sizeof(int)) + buf_size);
+    int *const attr_idx = (int *)&attr_table[used + 1];
+    uint8_t *const buf = (uint8_t *)&attr_idx[used + 1];
 
-        memcpy(new_row->cells,
-               old_row->cells,
-               sizeof(struct cell) * min(old_cols, new_cols));
+    /* Intern the attributes */
+    int attr_count = 0;
 
-        new_row->dirty = old_row->dirty;
-        new_row->linebreak = false;
-        new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
-        new_row->shell_integration.cmd_start = min(old_row->shell_integration.cmd_start, new_cols - 1);
-        new_row->shell_integration.cmd_end = min(old_row->shell_integration.cmd_end, new_cols - 1);
+    for (int c = 0; c < used; c++) {
+        const uint64_t attrs = cell_attrs_as_u64(&cells[c].attrs);
 
-        if (new_cols > old_cols) {
-            /* Clear "new" columns */
-            memset(&new_row->cells[old_cols], 0,
-                   sizeof(struct cell) * (new_cols - old_cols));
-            new_row->dirty = true;
-        } else if (old_cols > new_cols) {
-            /* Make sure we don't cut a multi-column character in two */
-            for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
-                new_row->cells[i - 1].wc = 0;
+        if (c > 0 && attrs == attr_table[attr_idx[c - 1]]) {
+            attr_idx[c] = attr_idx[c - 1];
+            continue;
         }
 
-        /* Map sixels on current "old" row to current "new row" */
-        tll_foreach(untranslated_sixels, it) {
-            if (it->item.pos.row != old_row_idx)
-                continue;
-
-            struct sixel sixel = it->item;
-            sixel.pos.row = new_row_idx;
+        int idx = -1;
+        for (int i = 0; i < min(attr_count, COMPRESS_MAX_ATTR_LOOKUP); i++) {
+            if (attr_table[i] == attrs) {
+                idx = i;
+                break;
+            }
+        }
 
-            if (sixel.pos.col < new_cols)
-                tll_push_back(grid->sixel_images, sixel);
-            else
-                sixel_destroy(&it->item);
-            tll_remove(untranslated_sixels, it);
+        if (idx < 0) {
+            idx = attr_count++;
+            attr_table[idx] = attrs;
         }
 
-        /* Copy URI ranges, truncating them if necessary */
-        const struct row_data *old_extra = old_row->extra;
-        if (old_extra == NULL)
-            continue;
+        attr_idx[c] = idx;
+    }
 
-        ensure_row_has_extra_data(new_row);
-        struct row_data *new_extra = new_row->extra;
+    uint8_t *p = buf;
 
-        range_ensure_size(&new_extra->uri_ranges, old_extra->uri_ranges.count);
-        range_ensure_size(&new_extra->underline_ranges, old_extra->underline_ranges.count);
+    p += leb128_put(p, attr_count);
+    memcpy(p, attr_table, attr_count * sizeof(attr_table[0]));
+    p += attr_count * sizeof(attr_table[0]);
 
-        for (int i = 0; i < old_extra->uri_ranges.count; i++) {
-            const struct row_range *range = &old_extra->uri_ranges.v[i];
+    for (int c = 0; c < used;) {
+        const int idx = attr_idx[c];
 
-            if (range->start >= new_cols) {
-                /* The whole range is truncated */
-                continue;
-            }
+        int len = 1;
+        while (c + len < used && attr_idx[c + len] == idx)
+            len++;
 
-            const int start = range->start;
-            const int end = min(range->end, new_cols - 1);
-            range_append(&new_extra->uri_ranges, start, end, ROW_RANGE_URI, &range->data);
-        }
+        p += leb128_put(p, len);
+        p += leb128_put(p, idx);
 
-        for (int i = 0; i < old_extra->underline_ranges.count; i++) {
-            const struct row_range *range = &old_extra->underline_ranges.v[i];
+        for (int i = 0; i < len; i++)
+            p += leb128_put(p, cells[c + i].wc);
 
-            if (range->start >= new_cols) {
-                /* The whole range is truncated */
-                continue;
-            }
+        c += len;
+    }
 
-            const int start = range->start;
-            const int end = min(range->end, new_cols - 1);
-            range_append_by_ref(&new_extra->underline_ranges, start, end, ROW_RANGE_UNDERLINE, &range->data);
-        }
-}
+    const size_t size = p - buf;
+    xassert(size <= buf_size);
 
-    /* Clear "new" lines */
-    for (int r = min(old_screen_rows, new_screen_rows); r < new_screen_rows; r++) {
-        struct row *new_row = grid_row_alloc(new_cols, false);
-        new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
+    struct row_compressed *compressed = xmalloc(sizeof(*compressed) + size);
+    compressed->cols = cols;
+    compressed->size = size;
+    memcpy(compressed->data, buf, size);
+    free(attr_table);
 
-        memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
-        new_row->dirty = true;
-    }
+    cells_free(row);
+    row->compressed = compressed;
+}
 
-#if defined(_DEBUG)
-    for (size_t r = 0; r < new_rows; r++) {
-        const struct row *row = new_grid[r];
+size_t
+grid_memory_usage(const struct grid *grid)
+{
+    size_t size = grid->num_rows * sizeof(grid->rows[0]);
 
+    for (int r = 0; r < grid->num_rows; r++) {
+        const struct row *row = grid->rows[r];
         if (row == NULL)
             continue;
-        if (row->extra == NULL)
-            continue;
 
-        verify_no_overlapping_ranges(row->extra);
-        verify_ranges_are_sorted(row->extra);
+        size += sizeof(*row);
+
+        if (row->compressed != NULL)
+            size += sizeof(*row->compressed) + row->compressed->size;
+        else
+            size += grid->num_cols * sizeof(row->cells[0]);
     }
-#endif
 
-    /* Free old grid */
-    for (int r = 0; r < grid->num_rows; r++)
-        grid_row_free(old_grid[r]);
-    free(grid->rows);
+    return size;
+}
 
-    grid->rows = new_grid;
+int
+grid_resize_ring_size(const struct grid *grid, int new_cols,
+                      int new_screen_rows, int scrollback_lines)
+{
+    const int max_rows = grid_max_rows(new_screen_rows, scrollback_lines);
+    const int min_rows = 1 << (32 - __builtin_clz(new_screen_rows));
+
+    /*
+     * Reflowing to fewer columns may split each line into multiple
+     * lines. Assume the worst, to avoid throwing away scrollback
+     */
+    const int old_cols = grid->num_cols;
+    const int split = old_cols > new_cols
+        ? (old_cols + new_cols - 1) / new_cols
+        : 1;
+
+    int used = 0;
+    for (int r = 0; r < grid->num_rows; r++) {
+        if (grid->rows[r] != NULL)
+            used++;
+    }
+
+    int64_t needed = (int64_t)used * split + new_screen_rows;
+
+    /* Rows not yet reflowed (see grid_reflow_step()) */
+    if (grid->reflow != NULL) {
+        tll_foreach(grid->reflow->segments, it) {
+            const int seg_cols = it->item.num_cols;
+            const int seg_split = seg_cols > new_cols
+                ? (seg_cols + new_cols - 1) / new_cols
+                : 1;
+            needed += (int64_t)it->item.count * seg_split;
+        }
+    }
+
+    if (needed >= max_rows)
+        return max_rows;
+
+    int ring_size = min_rows;
+    while (ring_size < needed)
+        ring_size *= 2;
+
+    return min(ring_size, max_rows);
+}
+
+void
+grid_grow_for_scroll(struct grid *grid, int screen_rows, int rows,
+                     int scrollback_lines, size_t max_bytes)
+{
+    const int old_rows = grid->num_rows;
+
+    /*
+     * Only grow when the bottom of the screen is about to wrap
+     * around. At that point, the ring's oldest row is at index 0,
+     * and its newest at old_rows - 1. The added rows are appended at
+     * the end, leaving all absolute row numbers (view, selection,
+     * sixels etc) intact.
+     */
+    const int bottom = grid->offset + screen_rows - 1;
+    if (likely(bottom >= old_rows || bottom + rows < old_rows))
+        return;
+
+    /* Ring hasn't been filled yet */
+    if (grid->rows[0] == NULL)
+        return;
+
+    if (old_rows >= grid_max_rows(screen_rows, scrollback_lines))
+        return;
+
+    /*
+     * Assume the grown ring will eventually use twice the memory of
+     * the current ring. Note that this also takes compression into
+     * account
+     */
+    if (max_bytes > 0 && grid_memory_usage(grid) * 2 > max_bytes) {
+        LOG_DBG("scrollback memory budget reached: %zu bytes", max_bytes);
+        return;
+    }
+
+    const int new_rows = old_rows * 2;
+    xassert(bottom + rows < new_rows);
+
+    LOG_DBG("growing scrollback ring: %d -> %d rows", old_rows, new_rows);
+
+    grid->rows = xrealloc(grid->rows, new_rows * sizeof(grid->rows[0]));
+    memset(&grid->rows[old_rows], 0, old_rows * sizeof(grid->rows[0]));
+    grid->num_rows = new_rows;
+}
+
+/*
+ * 'cells' must be large enough to hold 'compressed->cols' cells.
+ * Returns the row's used width (see struct row)
+ */
+static int
+row_decode(const struct row_compressed *compressed, struct cell *cells)
+{
+    const int cols = compressed->cols;
+    memset(cells, 0, cols * sizeof(cells[0]));
+
+    const uint8_t *p = compressed->data;
+    const uint8_t *const end = p + compressed->size;
+
+    const uint32_t attr_count = leb128_get(&p);
+    const uint8_t *const attr_table = p;
+    p += attr_count * sizeof(uint64_t);
+
+    int used = 0;
+
+    for (int c = 0; p < end;) {
+        const uint32_t len = leb128_get(&p);
+        const uint32_t idx = leb128_get(&p);
+        xassert(c + len <= cols);
+        xassert(idx < attr_count);
+
+        struct attributes attrs;
+        memcpy(&attrs, &attr_table[idx * sizeof(uint64_t)], sizeof(attrs));
+
+        for (uint32_t i = 0; i < len; i++, c++) {
+            cells[c].wc = leb128_get(&p);
+            cells[c].attrs = attrs;
+
+            if (cells[c].wc != 0)
+                used = c + 1;
+        }
+    }
+
+    xassert(p == end);
+    return used;
+}
+
+void
+grid_row_uncompress(struct row *row)
+{
+    struct row_compressed *compressed = row->compressed;
+    xassert(row->cells == NULL);
+    xassert(compressed != NULL);
+
+    struct cell *cells = cells_alloc(row->slab, compressed->cols);
+    row->used = row_decode(compressed, cells);
+
+    free(compressed);
+    row->compressed = NULL;
+    row->cells = cells;
+
+    /* The 'clean' bit isn't preserved */
+    row->dirty = true;
+}
+
+void
+grid_row_uncompress_abs(struct grid *grid, int abs_row)
+{
+    grid_row_uncompress(grid->rows[abs_row]);
+
+    /*
+     * Rows on the screen end up "deeper" than any scrollback row
+     * here. That only makes the next grid_compress_scrollback() scan
+     * more than it has to.
+     */
+    const int depth = (grid->offset - abs_row) & (grid->num_rows - 1);
+    grid->compress_watermark = max(grid->compress_watermark, depth);
+}
+
+const struct row *
+grid_row_abs_peek(const struct grid *grid, int abs_row, struct row *scratch)
+{
+    const struct row *row = grid->rows[abs_row];
+    if (row == NULL || row->cells != NULL)
+        return row;
+
+    xassert(row->compressed->cols == grid->num_cols);
+
+    scratch->used = row_decode(row->compressed, scratch->cells);
+    scratch->linebreak = row->linebreak;
+    scratch->shell_integration = row->shell_integration;
+    return scratch;
+}
+
+/*
+ * Spilled row format:
+ *
+ *   - a flags byte
+ *   - the shell integration command start and end columns (int)
+ *   - the compressed row (struct row_compressed, including its data)
+ *   - the number of URI ranges (int), followed by, for each range,
+ *     its start and end columns (int), the hyperlink ID (uint64_t),
+ *     the length of the hyperlink URI (size_t), and the NUL
+ *     terminated URI itself
+ *   - the number of underline ranges (int), followed by, for each
+ *     range, its start and end columns (int), and its
+ *     struct underline_range_data
+ *
+ * Blobs aren't aligned; everything is accessed with memcpy()
+ */
+#define SPILL_LINEBREAK (1u << 0)
+#define SPILL_PROMPT_MARKER (1u << 1)
+
+static void
+spill_put(uint8_t **p, const void *src, size_t size)
+{
+    memcpy(*p, src, size);
+    *p += size;
+}
+
+static void
+spill_take(const uint8_t **p, void *dst, size_t size)
+{
+    memcpy(dst, *p, size);
+    *p += size;
+}
+
+static size_t
+spill_extra_size(const struct row_data *extra)
+{
+    size_t size = 2 * sizeof(int);
+    if (extra == NULL)
+        return size;
+
+    for (int i = 0; i < extra->uri_ranges.count; i++) {
+        const struct hyperlink *link = extra->uri_ranges.v[i].uri.link;
+        size += 2 * sizeof(int) + sizeof(uint64_t) + sizeof(size_t) +
+            strlen(link->uri) + 1;
+    }
+
+    size += extra->underline_ranges.count *
+        (2 * sizeof(int) + sizeof(struct underline_range_data));
+    return size;
+}
+
+bool
+grid_row_spill(struct spill *spill, struct row *row, int cols)
+{
+    grid_row_compress(row, cols);
+
+    const struct row_compressed *compressed = row->compressed;
+    const struct row_data *extra = row->extra;
+    const size_t compressed_size = sizeof(*compressed) + compressed->size;
+    const size_t size =
+        1 + 2 * sizeof(int) + compressed_size + spill_extra_size(extra);
+
+    uint8_t *blob = spill_append(spill, size);
+    if (blob == NULL)
+        return false;
+
+    uint8_t *p = blob;
+
+    *p++ = (row->linebreak ? SPILL_LINEBREAK : 0) |
+           (row->shell_integration.prompt_marker ? SPILL_PROMPT_MARKER : 0);
+    spill_put(&p, &row->shell_integration.cmd_start, sizeof(int));
+    spill_put(&p, &row->shell_integration.cmd_end, sizeof(int));
+    spill_put(&p, compressed, compressed_size);
+
+    const int uri_count = extra != NULL ? extra->uri_ranges.count : 0;
+    spill_put(&p, &uri_count, sizeof(uri_count));
+
+    for (int i = 0; i < uri_count; i++) {
+        const struct row_range *range = &extra->uri_ranges.v[i];
+        const struct hyperlink *link = range->uri.link;
+        const size_t len = strlen(link->uri) + 1;
+
+        spill_put(&p, &range->start, sizeof(range->start));
+        spill_put(&p, &range->end, sizeof(range->end));
+        spill_put(&p, &link->id, sizeof(link->id));
+        spill_put(&p, &len, sizeof(len));
+        spill_put(&p, link->uri, len);
+    }
+
+    const int underline_count = extra != NULL ? extra->underline_ranges.count : 0;
+    spill_put(&p, &underline_count, sizeof(underline_count));
+
+    for (int i = 0; i < underline_count; i++) {
+        const struct row_range *range = &extra->underline_ranges.v[i];
+        spill_put(&p, &range->start, sizeof(range->start));
+        spill_put(&p, &range->end, sizeof(range->end));
+        spill_put(&p, &range->underline, sizeof(range->underline));
+    }
+
+    xassert(p == blob + size);
+    return true;
+}
+
+struct row *
+grid_row_unspill(const struct spill *spill, size_t idx,
+                 struct hyperlinks *links, int *cols)
+{
+    size_t size;
+    const uint8_t *blob = spill_get(spill, idx, &size);
+    xassert(size >= 1 + 2 * sizeof(int) + sizeof(struct row_compressed) +
+                    2 * sizeof(int));
+
+    const uint8_t *p = blob;
+    const uint8_t flags = *p++;
+
+    struct row *row = row_alloc(NULL);
+    row->linebreak = flags & SPILL_LINEBREAK;
+    row->shell_integration.prompt_marker = flags & SPILL_PROMPT_MARKER;
+    spill_take(&p, &row->shell_integration.cmd_start, sizeof(int));
+    spill_take(&p, &row->shell_integration.cmd_end, sizeof(int));
+
+    struct row_compressed header;
+    memcpy(&header, p, sizeof(header));
+    const size_t compressed_size = sizeof(header) + header.size;
+
+    row->compressed = xmalloc(compressed_size);
+    spill_take(&p, row->compressed, compressed_size);
+
+    *cols = row->compressed->cols;
+    grid_row_uncompress(row);
+
+    int uri_count;
+    spill_take(&p, &uri_count, sizeof(uri_count));
+
+    for (int i = 0; i < uri_count; i++) {
+        int start, end;
+        uint64_t id;
+        size_t len;
+
+        spill_take(&p, &start, sizeof(start));
+        spill_take(&p, &end, sizeof(end));
+        spill_take(&p, &id, sizeof(id));
+        spill_take(&p, &len, sizeof(len));
+
+        const char *uri = (const char *)p;
+        xassert(len > 0 && uri[len - 1] == '\0');
+        p += len;
+
+        ensure_row_has_extra_data(row);
+        range_append_by_ref(
+            &row->extra->uri_ranges, start, end, ROW_RANGE_URI,
+            &(union row_range_data){
+                .uri = {.link = hyperlink_get(links, id, uri)}});
+    }
+
+    int underline_count;
+    spill_take(&p, &underline_count, sizeof(underline_count));
+
+    for (int i = 0; i < underline_count; i++) {
+        int start, end;
+        union row_range_data data;
+
+        spill_take(&p, &start, sizeof(start));
+        spill_take(&p, &end, sizeof(end));
+        spill_take(&p, &data.underline, sizeof(data.underline));
+
+        ensure_row_has_extra_data(row);
+        range_append_by_ref(
+            &row->extra->underline_ranges, start, end, ROW_RANGE_UNDERLINE,
+            &data);
+    }
+
+    xassert(p == blob + size);
+    return row;
+}
+
+/*
+ * Doubles the ring, inserting the new (empty) slots in front of the
+ * oldest row, 'oldest'. Absolute row numbers at, or after, 'oldest'
+ * are moved.
+ */
+static void
+ring_grow_before(struct grid *grid, int oldest,
+                 size_t tracking_points_count,
+                 struct coord *const tracking_points[])
+{
+    const int old_rows = grid->num_rows;
+    const int new_rows = old_rows * 2;
+
+    LOG_DBG("growing scrollback ring for spilled rows: %d -> %d rows",
+            old_rows, new_rows);
+
+    grid->rows = xrealloc(grid->rows, new_rows * sizeof(grid->rows[0]));
+    memcpy(&grid->rows[oldest + old_rows], &grid->rows[oldest],
+           (old_rows - oldest) * sizeof(grid->rows[0]));
+    memset(&grid->rows[oldest], 0, old_rows * sizeof(grid->rows[0]));
+    grid->num_rows = new_rows;
+
+#define MOVE(r) ((r) >= oldest ? (r) + old_rows : (r))
+    grid->offset = MOVE(grid->offset);
+    grid->view = MOVE(grid->view);
+
+    tll_foreach(grid->sixel_images, it) {
+        struct sixel *six = &it->item;
+
+        /* Would cross the (new) gap */
+        if (six->pos.row < oldest && six->pos.row + six->rows > oldest) {
+            sixel_destroy(six);
+            tll_remove(grid->sixel_images, it);
+            continue;
+        }
+
+        six->pos.row = MOVE(six->pos.row);
+    }
+
+    for (size_t i = 0; i < tracking_points_count; i++) {
+        struct coord *pt = tracking_points[i];
+        if (pt->row >= 0)
+            pt->row = MOVE(pt->row);
+    }
+#undef MOVE
+}
+
+int
+grid_spill_page_in(struct grid *grid, int screen_rows, struct spill *spill,
+                   struct hyperlinks *links, int max_rows, int max_ring_rows, bool compress,
+                   size_t tracking_points_count,
+                   struct coord *const tracking_points[])
+{
+    xassert(grid->reflow == NULL);
+    xassert(grid->slab != NULL);
+
+    const size_t spilled = spill_count(spill);
+    if (spilled == 0)
+        return 0;
+
+    int oldest = grid_sb_start_ignore_uninitialized(grid, screen_rows);
+    const int bottom = grid_row_absolute(grid, screen_rows - 1);
+    int free_rows = (oldest - bottom - 1) & (grid->num_rows - 1);
+
+    if (free_rows == 0) {
+        if (grid->num_rows * 2 > max_ring_rows)
+            return 0;
+
+        ring_grow_before(grid, oldest, tracking_points_count, tracking_points);
+        oldest += grid->num_rows / 2;
+        free_rows = grid->num_rows / 2;
+    }
+
+    const int mask = grid->num_rows - 1;
+    const int count = min(min(free_rows, max_rows), (int)min(spilled, INT_MAX));
+    const int new_cols = grid->num_cols;
+
+    /* Newest first, i.e. from the end of the spill */
+    for (int i = 0; i < count; i++) {
+        int old_cols;
+        struct row *old_row = grid_row_unspill(
+            spill, spilled - 1 - i, links, &old_cols);
+        struct row *row = grid_row_alloc(grid->slab, new_cols, true);
+
+        /* Truncated, or padded; not reflowed */
+        memcpy(row->cells, old_row->cells,
+               min(old_cols, new_cols) * sizeof(row->cells[0]));
+        row->used = min(old_row->used, new_cols);
+        row->linebreak = old_row->linebreak;
+        row->dirty = true;
+        row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
+        row->shell_integration.cmd_start = min(old_row->shell_integration.cmd_start, new_cols - 1);
+        row->shell_integration.cmd_end = min(old_row->shell_integration.cmd_end, new_cols - 1);
+
+        /* Make sure we don't cut a multi-column character in two */
+        if (old_cols > new_cols) {
+            for (int c = new_cols; c > 0 && old_row->cells[c].wc > CELL_SPACER; c--)
+                row->cells[c - 1].wc = 0;
+        }
+
+        if (old_row->extra != NULL)
+            row_extra_copy_truncated(row, old_row->extra, new_cols);
+
+        grid_row_free(old_row);
+
+        if (compress)
+            grid_row_compress(row, new_cols);
+
+        const int slot = (oldest - 1 - i) & mask;
+        xassert(grid->rows[slot] == NULL);
+        grid->rows[slot] = row;
+    }
+
+    spill_truncate(spill, spilled - count);
+    return count;
+}
+
+/*
+ * Compresses all scrollback rows that are more than 'distance' rows
+ * above the screen's top row. Rows in the current view are left
+ * alone.
+ *
+ * Only rows up to the grid's compress watermark are scanned; rows
+ * further up are known to already be compressed.
+ */
+void
+grid_compress_scrollback(struct grid *grid, int screen_rows, int distance)
+{
+    xassert(distance > 0);
+
+    const int view_sb_start = grid_row_abs_to_sb(grid, screen_rows, grid->view);
+    const int max_depth = min(grid->compress_watermark,
+                              grid->num_rows - screen_rows);
+    int watermark = distance;
+
+    for (int r = distance + 1; r <= max_depth; r++) {
+        const int abs_row = grid_row_absolute(grid, -r);
+        struct row *row = grid->rows[abs_row];
+
+        if (row == NULL || row->cells == NULL)
+            continue;
+
+        const int sb_row = grid_row_abs_to_sb(grid, screen_rows, abs_row);
+        if (sb_row >= view_sb_start && sb_row < view_sb_start + screen_rows) {
+            watermark = r;
+            continue;
+        }
+
+        grid_row_compress(row, grid->num_cols);
+    }
+
+    grid->compress_watermark = watermark;
+}
+
+void
+grid_resize_without_reflow(
+    struct grid *grid, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows)
+{
+    /* Only the screen is kept; throw away not-yet-reflowed scrollback */
+    grid_reflow_discard(grid);
+
+    struct row *const *old_grid = grid->rows;
+    const int old_rows = grid->num_rows;
+    const int old_cols = grid->num_cols;
+
+    struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    struct grid_slab *new_slab = slab_for_resize(grid, new_cols);
+
+    tll(struct sixel) untranslated_sixels = tll_init();
+    tll_foreach(grid->sixel_images, it)
+        tll_push_back(untranslated_sixels, it->item);
+    tll_free(grid->sixel_images);
+
+    int new_offset = 0;
+
+    /* Copy old lines, truncating them if old rows were longer */
+    for (int r = 0, n = min(old_screen_rows, new_screen_rows); r < n; r++) {
+        const int old_row_idx = (grid->offset + r) & (old_rows - 1);
+        const int new_row_idx = (new_offset + r) & (new_rows - 1);
+
+        const struct row *old_row = grid_row_abs(grid, old_row_idx);
+        xassert(old_row != NULL);
+
+        struct row *new_row = grid_row_alloc(new_slab, new_cols, false);
+        new_grid[new_row_idx] = new_row;
+
+        memcpy(new_row->cells,
+               old_row->cells,
+               sizeof(struct cell) * min(old_cols, new_cols));
+
+        new_row->dirty = old_row->dirty;
+        new_row->linebreak = false;
+        new_row->used = min(old_row->used, new_cols);
+        new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
+        new_row->shell_integration.cmd_start = min(old_row->shell_integration.cmd_start, new_cols - 1);
+        new_row->shell_integration.cmd_end = min(old_row->shell_integration.cmd_end, new_cols - 1);
+
+        if (new_cols > old_cols) {
+            /* Clear "new" columns */
+            memset(&new_row->cells[old_cols], 0,
+                   sizeof(struct cell) * (new_cols - old_cols));
+            new_row->dirty = true;
+        } else if (old_cols > new_cols) {
+            /* Make sure we don't cut a multi-column character in two */
+            for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
+                new_row->cells[i - 1].wc = 0;
+        }
+
+        /* Map sixels on current "old" row to current "new row" */
+        tll_foreach(untranslated_sixels, it) {
+            if (it->item.pos.row != old_row_idx)
+                continue;
+
+            struct sixel sixel = it->item;
+            sixel.pos.row = new_row_idx;
+
+            if (sixel.pos.col < new_cols)
+                tll_push_back(grid->sixel_images, sixel);
+            else
+                sixel_destroy(&it->item);
+            tll_remove(untranslated_sixels, it);
+        }
+
+        /* Copy URI ranges, truncating them if necessary */
+        if (old_row->extra != NULL)
+            row_extra_copy_truncated(new_row, old_row->extra, new_cols);
+}
+
+    /* Clear "new" lines */
+    for (int r = min(old_screen_rows, new_screen_rows); r < new_screen_rows; r++) {
+        struct row *new_row = grid_row_alloc(new_slab, new_cols, false);
+        new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
+
+        memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
+        new_row->dirty = true;
+        new_row->used = 0;
+    }
+
+#if defined(_DEBUG)
+    for (size_t r = 0; r < new_rows; r++) {
+        const struct row *row = new_grid[r];
+
+        if (row == NULL)
+            continue;
+        if (row->extra == NULL)
+            continue;
+
+        verify_no_overlapping_ranges(row->extra);
+        verify_ranges_are_sorted(row->extra);
+    }
+#endif
+
+    /* Free old grid */
+    for (int r = 0; r < grid->num_rows; r++)
+        grid_row_free(old_grid[r]);
+    free(grid->rows);
+    slab_replace(grid, new_slab);
+
+    grid->rows = new_grid;
     grid->num_rows = new_rows;
     grid->num_cols = new_cols;
 
     grid->view = grid->offset = new_offset;
+    grid->compress_watermark = new_rows;
 
     /* Keep cursor at current position, but clamp to new dimensions */
     struct coord cursor = grid->cursor.point;
@@ -651,7 +1617,7 @@ reflow_range_start(struct row_range *range, enum row_range_type type,
     range_append_by_ref(new_ranges, new_col_idx, -1, type, &range->data);
 
     switch (type) {
-    case ROW_RANGE_URI: range->uri.uri = NULL; break; /* Owned by new_ranges */
+    case ROW_RANGE_URI: range->uri.link = NULL; break; /* Owned by new_ranges */
     case ROW_RANGE_UNDERLINE: break;
     }
 }
@@ -678,7 +1644,9 @@ reflow_range_end(struct row_range *range, enum row_range_type type,
 
     switch (type) {
     case ROW_RANGE_URI:
-        xassert(new_range->uri.id == range->uri.id);
+        /* The reference was moved to 'new_range' by reflow_range_start() */
+        xassert(range->uri.link == NULL);
+        xassert(new_range->uri.link != NULL);
         break;
 
     case ROW_RANGE_UNDERLINE:
@@ -692,7 +1660,8 @@ reflow_range_end(struct row_range *range, enum row_range_type type,
 }
 
 static struct row *
-_line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
+_line_wrap(struct grid *old_grid, struct row **new_grid,
+           struct grid_slab *slab, struct row *row,
            int *row_idx, int *col_idx, int row_count, int col_count)
 {
     *col_idx = 0;
@@ -702,12 +1671,13 @@ _line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
 
     if (new_row == NULL) {
         /* Scrollback not yet full, allocate a completely new row */
-        new_row = grid_row_alloc(col_count, false);
+        new_row = grid_row_alloc(slab, col_count, false);
         new_grid[*row_idx] = new_row;
     } else {
         /* Scrollback is full, need to reuse a row */
         grid_row_reset_extra(new_row);
         new_row->linebreak = false;
+        new_row->used = 0;
         new_row->shell_integration.prompt_marker = false;
         new_row->shell_integration.cmd_start = -1;
         new_row->shell_integration.cmd_end = -1;
@@ -771,7 +1741,7 @@ _line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
     return new_row;
 }
 
-static struct {
+static thread_local struct {
     int scrollback_start;
     int rows;
 } tp_cmp_ctx;
@@ -809,10 +1779,361 @@ tp_cmp(const void *_a, const void *_b)
     return 0;
 }
 
-void
-grid_resize_and_reflow(
+/*
+ * Returns the number of (oldest) scrollback rows to defer, when
+ * reflowing 'grid'. 'first_tp' is the first (oldest) tracking point.
+ */
+static int
+reflow_split(const struct grid *grid, int sb_start, int screen_rows,
+             const struct coord *first_tp)
+{
+    const int rows = grid->num_rows;
+    const int mask = rows - 1;
+
+    /* Skip the not-yet-used part of the ring */
+    int used_start = 0;
+    while (used_start < rows &&
+           grid->rows[(sb_start + used_start) & mask] == NULL)
+    {
+        used_start++;
+    }
+
+    if (rows - used_start < REFLOW_LAZY_MIN_ROWS)
+        return 0;
+
+    int split = rows - screen_rows - REFLOW_LAZY_MARGIN;
+    split = min(split, (first_tp->row - sb_start) & mask);
+
+    /* Don't split logical lines */
+    while (split > used_start) {
+        const struct row *row = grid->rows[(sb_start + split - 1) & mask];
+        if (row == NULL || row->linebreak)
+            break;
+        split--;
+    }
+
+    return split > used_start ? split : 0;
+}
+
+static void resize_and_reflow(
     struct grid *grid, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows,
+    enum reflow_flags flags, size_t thread_count,
+    size_t tracking_points_count,
+    struct coord *const _tracking_points[static tracking_points_count]);
+
+/* Moves all rows, and cell arrays, from 'src' to 'dst' */
+static void
+grid_slab_merge(struct grid_slab *dst, struct grid_slab *src)
+{
+    xassert(dst->cols == src->cols);
+    xassert(src->refs == 1);
+
+    slab_merge(dst->rows, src->rows);
+    slab_merge(dst->cells, src->cells);
+    free(src);
+}
+
+struct reflow_job {
+    struct grid grid;           /* The chunk, as a grid of its own */
+    int new_rows;
+    int new_cols;
+
+    /* The chunk's rows in the original grid, free:d when done */
+    struct grid *src;
+    int src_first;              /* Absolute row index */
+
+    /* Tracking points on the chunk, in chunk coordinates */
+    size_t tp_count;
+    struct coord *tp_coords;
+    struct coord **tps;
+};
+
+struct reflow_jobs {
+    struct reflow_job *v;
+    size_t count;
+    size_t next;
+    mtx_t lock;  /* Also protects the original grid's rows, and slab */
+};
+
+static int
+reflow_worker_thread(void *data)
+{
+    struct reflow_jobs *jobs = data;
+
+    while (true) {
+        mtx_lock(&jobs->lock);
+        const size_t idx = jobs->next++;
+        mtx_unlock(&jobs->lock);
+
+        if (idx >= jobs->count)
+            break;
+
+        struct reflow_job *job = &jobs->v[idx];
+        const int count = job->grid.offset + 1;
+
+        resize_and_reflow(
+            &job->grid, job->new_rows, job->new_cols, 1, 1,
+            REFLOW_KEEP_OLD_ROWS | REFLOW_NO_CURSORS, 1,
+            job->tp_count, job->tps);
+
+        /*
+         * Free the chunk's old rows right away, rather than when all
+         * chunks are done; the old and the new grid would otherwise
+         * both be fully allocated at the same time
+         */
+        struct grid *src = job->src;
+        const int mask = src->num_rows - 1;
+
+        mtx_lock(&jobs->lock);
+        for (int r = 0; r < count; r++) {
+            const int src_idx = (job->src_first + r) & mask;
+            grid_row_free(src->rows[src_idx]);
+            src->rows[src_idx] = NULL;
+        }
+        mtx_unlock(&jobs->lock);
+    }
+
+    return 0;
+}
+
+/*
+ * Reflows the old rows, from 'first' (scrollback relative) and on, in
+ * chunks, on up to 'thread_count' threads (including the calling
+ * thread).
+ *
+ * The old rows are free:d, a chunk at a time, as soon as the chunk has
+ * been reflowed. The reflowed rows are stitched together in
+ * 'new_grid', starting at index 0, exactly like the regular (serial)
+ * walk would have placed them. The (sorted) tracking points, and the
+ * untranslated sixels, are translated to the new grid.
+ *
+ * Returns the index of the last new row, or -1 if the rows could not
+ * be split into multiple chunks (in which case nothing has been done).
+ */
+static int
+reflow_parallel(struct grid *grid, int sb_start, int first,
+                size_t thread_count,
+                struct row **new_grid, int new_rows, int new_cols,
+                struct grid_slab *new_slab,
+                size_t tp_count, struct coord *const *tracking_points,
+                sixel_list_t *untranslated_sixels)
+{
+    const int old_rows = grid->num_rows;
+    const int old_cols = grid->num_cols;
+    const int mask = old_rows - 1;
+
+    /* Skip the not-yet-used part of the ring */
+    int start = first;
+    while (start < old_rows && grid->rows[(sb_start + start) & mask] == NULL)
+        start++;
+
+    const size_t max_jobs = thread_count * REFLOW_JOBS_PER_THREAD;
+    const int chunk_size = (old_rows - start + max_jobs - 1) / max_jobs;
+
+    /* Chunk boundaries (scrollback relative). Chunks end at hard
+     * linebreaks, since logical lines are reflowed as a whole */
+    int bounds[max_jobs + 1];
+    size_t job_count = 0;
+    bounds[0] = start;
+
+    while (bounds[job_count] < old_rows) {
+        int end = min(bounds[job_count] + chunk_size, old_rows);
+
+        while (end < old_rows) {
+            const struct row *row = grid->rows[(sb_start + end - 1) & mask];
+            if (row == NULL || row->linebreak)
+                break;
+            end++;
+        }
+
+        bounds[++job_count] = end;
+    }
+
+    if (job_count < 2)
+        return -1;
+
+    LOG_DBG("reflowing %d rows in %zu chunks",
+            old_rows - start, job_count);
+
+    struct reflow_jobs jobs = {
+        .v = xcalloc(job_count, sizeof(jobs.v[0])),
+        .count = job_count,
+    };
+
+    /* Upper bound of new rows per old row (with room for wide
+     * characters pushed to the next row) */
+    const int split = (old_cols + new_cols - 1) / new_cols + 1;
+
+    for (size_t i = 0, tp_idx = 0; i < job_count; i++) {
+        struct reflow_job *job = &jobs.v[i];
+        const int count = bounds[i + 1] - bounds[i];
+
+        job->grid = (struct grid){
+            .num_rows = 1 << (32 - __builtin_clz(count)),
+            .num_cols = old_cols,
+            .offset = count - 1,
+            .view = count - 1,
+            .slab = grid_slab_new(new_cols),
+            .scroll_damage = tll_init(),
+            .sixel_images = tll_init(),
+        };
+        job->grid.rows = xcalloc(job->grid.num_rows, sizeof(job->grid.rows[0]));
+
+        for (int r = 0; r < count; r++)
+            job->grid.rows[r] = grid->rows[(sb_start + bounds[i] + r) & mask];
+
+        job->new_rows = 1 << (32 - __builtin_clz(
+            min((int64_t)count * split, new_rows)));
+        job->new_cols = new_cols;
+        job->src = grid;
+        job->src_first = (sb_start + bounds[i]) & mask;
+
+        const size_t tp_first = tp_idx;
+        while (tp_idx < tp_count &&
+               ((tracking_points[tp_idx]->row - sb_start) & mask) < bounds[i + 1])
+        {
+            tp_idx++;
+        }
+
+        job->tp_count = tp_idx - tp_first;
+        job->tp_coords = xmalloc((job->tp_count + 1) * sizeof(job->tp_coords[0]));
+        job->tps = xmalloc((job->tp_count + 1) * sizeof(job->tps[0]));
+
+        for (size_t j = 0; j < job->tp_count; j++) {
+            const struct coord *tp = tracking_points[tp_first + j];
+            const int sb_row = (tp->row - sb_start) & mask;
+
+            xassert(sb_row >= bounds[i]);
+            job->tp_coords[j] = (struct coord){
+                .col = tp->col,
+                .row = sb_row - bounds[i],
+            };
+            job->tps[j] = &job->tp_coords[j];
+        }
+    }
+
+    tll_foreach(*untranslated_sixels, it) {
+        const int sb_row = (it->item.pos.row - sb_start) & mask;
+        if (sb_row < start)
+            continue;
+
+        size_t i = 0;
+        while (sb_row >= bounds[i + 1])
+            i++;
+
+        struct sixel sixel = it->item;
+        sixel.pos.row = sb_row - bounds[i];
+        tll_push_back(jobs.v[i].grid.sixel_images, sixel);
+        tll_remove(*untranslated_sixels, it);
+    }
+
+    /* Reflow the chunks */
+    const size_t thread_total = min(thread_count, job_count) - 1;
+    thrd_t tids[thread_total];
+    size_t threads_started = 0;
+
+    mtx_init(&jobs.lock, mtx_plain);
+
+    for (size_t i = 0; i < thread_total; i++) {
+        int ret = thrd_create(&tids[i], &reflow_worker_thread, &jobs);
+        if (ret != thrd_success) {
+            LOG_ERR("failed to create reflow thread: %s (%d)",
+                    thrd_err_as_string(ret), ret);
+            break;
+        }
+        threads_started++;
+    }
+
+    reflow_worker_thread(&jobs);
+
+    for (size_t i = 0; i < threads_started; i++)
+        thrd_join(tids[i], NULL);
+
+    mtx_destroy(&jobs.lock);
+
+    /* The old rows have been free:d by the workers */
+#if defined(_DEBUG)
+    for (int r = first; r < old_rows; r++)
+        xassert(grid->rows[(sb_start + r) & mask] == NULL);
+#endif
+
+    /* The caller's first row; we start over from scratch */
+    grid_row_free(new_grid[0]);
+    new_grid[0] = NULL;
+
+    /* Count the reflowed rows; the oldest ones may not fit in the ring */
+    int total = 0;
+    for (size_t i = 0; i < job_count; i++) {
+        const struct grid *g = &jobs.v[i].grid;
+        const bool wrapped = g->rows[(g->offset + 1) & (g->num_rows - 1)] != NULL;
+        total += wrapped ? g->num_rows : g->offset + 1;
+    }
+
+    const int new_mask = new_rows - 1;
+    const int skip = max(total - new_rows, 0);
+
+    /* Stitch */
+    for (size_t i = 0, pos = 0; i < job_count; i++) {
+        struct reflow_job *job = &jobs.v[i];
+        struct grid *g = &job->grid;
+        const int chunk_mask = g->num_rows - 1;
+        const bool wrapped = g->rows[(g->offset + 1) & chunk_mask] != NULL;
+        const int count = wrapped ? g->num_rows : g->offset + 1;
+        const int oldest = (g->offset - count + 1) & chunk_mask;
+
+        for (size_t j = 0; j < job->tp_count; j++) {
+            const struct coord *tp = &job->tp_coords[j];
+            const int chunk_row = (tp->row - oldest) & chunk_mask;
+
+            tracking_points[0]->row = (pos + chunk_row) & new_mask;
+            tracking_points[0]->col = tp->col;
+            tracking_points++;
+        }
+
+        tll_foreach(g->sixel_images, it) {
+            const int chunk_row = (it->item.pos.row - oldest) & chunk_mask;
+
+            if (pos + chunk_row < skip)
+                sixel_destroy(&it->item);
+            else {
+                struct sixel sixel = it->item;
+                sixel.pos.row = (pos + chunk_row) & new_mask;
+                tll_push_back(grid->sixel_images, sixel);
+            }
+            tll_remove(g->sixel_images, it);
+        }
+
+        for (int j = 0; j < count; j++, pos++) {
+            const int idx = (oldest + j) & chunk_mask;
+            struct row *row = g->rows[idx];
+            g->rows[idx] = NULL;
+
+            if (pos < skip) {
+                grid_row_free(row);
+                continue;
+            }
+
+            row->slab = new_slab;
+            new_grid[pos & new_mask] = row;
+        }
+
+        free(g->rows);
+        grid_slab_merge(new_slab, g->slab);
+
+        free(job->tp_coords);
+        free(job->tps);
+    }
+
+    free(jobs.v);
+    return (total - 1) & new_mask;
+}
+
+static void
+resize_and_reflow(
+    struct grid *grid, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows,
+    enum reflow_flags flags, size_t thread_count,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count])
 {
@@ -832,17 +2153,18 @@ grid_resize_and_reflow(
     int new_row_idx = 0;
 
     struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
+    struct grid_slab *new_slab = slab_for_resize(grid, new_cols);
     struct row *new_row = new_grid[new_row_idx];
 
     xassert(new_row == NULL);
-    new_row = grid_row_alloc(new_cols, false);
+    new_row = grid_row_alloc(new_slab, new_cols, false);
     new_grid[new_row_idx] = new_row;
 
     /* Start at the beginning of the old grid's scrollback. That is,
      * at the output that is *oldest* */
     int offset = grid->offset + old_screen_rows;
 
-    tll(struct sixel) untranslated_sixels = tll_init();
+    sixel_list_t untranslated_sixels = tll_init();
     tll_foreach(grid->sixel_images, it)
         tll_push_back(untranslated_sixels, it->item);
     tll_free(grid->sixel_images);
@@ -856,23 +2178,29 @@ grid_resize_and_reflow(
     saved_cursor.row += grid->offset;
     saved_cursor.row &= old_rows - 1;
 
+    /* Chunks of a larger grid have no cursors of their own */
+    const bool track_cursors = !(flags & REFLOW_NO_CURSORS);
+
     size_t tp_count =
         tracking_points_count +
-        1 +                       /* cursor */
-        1 +                       /* saved cursor */
+        2 * track_cursors +       /* cursor + saved cursor */
         !view_follows +           /* viewport */
         1;                        /* terminator */
 
     struct coord *tracking_points[tp_count];
     memcpy(tracking_points, _tracking_points, tracking_points_count * sizeof(_tracking_points[0]));
-    tracking_points[tracking_points_count] = &cursor;
-    tracking_points[tracking_points_count + 1] = &saved_cursor;
+
+    size_t tp_idx = tracking_points_count;
+    if (track_cursors) {
+        tracking_points[tp_idx++] = &cursor;
+        tracking_points[tp_idx++] = &saved_cursor;
+    }
 
     struct coord viewport = {0, grid->view};
     if (!view_follows)
-        tracking_points[tracking_points_count + 2] = &viewport;
+        tracking_points[tp_idx++] = &viewport;
 
-    /* Not thread safe! */
+    /* Thread local; see reflow_parallel() */
     tp_cmp_ctx.scrollback_start = offset;
     tp_cmp_ctx.rows = old_rows;
     qsort(
@@ -889,18 +2217,61 @@ grid_resize_and_reflow(
                 i, tracking_points[i]->row, tracking_points[i]->col);
     }
 
+    /* Number of old rows (from the scrollback start) to defer */
+    const int deferred = flags & REFLOW_LAZY
+        ? reflow_split(grid, offset, old_screen_rows, tracking_points[0])
+        : 0;
+
+    if (deferred > 0)
+        LOG_DBG("deferring reflow of %d rows", deferred);
+
+    /* Large grids are reflowed in chunks, in parallel */
+    int walk_start = deferred;
+
+    if (thread_count > 1 && old_rows - deferred >= REFLOW_PARALLEL_MIN_ROWS) {
+        const int last_idx = reflow_parallel(
+            grid, offset, deferred, thread_count,
+            new_grid, new_rows, new_cols, new_slab,
+            tp_count - 1, tracking_points, &untranslated_sixels);
+
+        if (last_idx >= 0) {
+            new_row_idx = last_idx;
+            new_row = new_grid[new_row_idx];
+            new_col_idx = new_cols;
+            next_tp = &tracking_points[tp_count - 1];
+            walk_start = old_rows;
+        }
+    }
+
+    /* Compressed rows are decoded into a scratch buffer, rather than
+     * being uncompressed in place */
+    struct cell *scratch = NULL;
+
     /*
      * Walk the old grid
      */
-    for (int r = 0; r < old_rows; r++) {
+    for (int r = walk_start; r < old_rows; r++) {
 
         const size_t old_row_idx = (offset + r) & (old_rows - 1);
 
         /* Unallocated (empty) rows we can simply skip */
-        const struct row *old_row = old_grid[old_row_idx];
+        const struct row *old_row = grid->rows[old_row_idx];
         if (old_row == NULL)
             continue;
 
+        struct row decoded;
+        if (old_row->compressed != NULL) {
+            xassert(old_row->compressed->cols == old_cols);
+
+            if (scratch == NULL)
+                scratch = xmalloc(old_cols * sizeof(scratch[0]));
+
+            row_decode(old_row->compressed, scratch);
+            decoded = *old_row;
+            decoded.cells = scratch;
+            old_row = &decoded;
+        }
+
         /* Map sixels on current "old" row to current "new row" */
         tll_foreach(untranslated_sixels, it) {
             if (it->item.pos.row != old_row_idx)
@@ -915,12 +2286,12 @@ grid_resize_and_reflow(
 
 #define line_wrap()                                                 \
         new_row = _line_wrap(                                       \
-            grid, new_grid, new_row, &new_row_idx, &new_col_idx,    \
-            new_rows, new_cols)
+            grid, new_grid, new_slab, new_row,                      \
+            &new_row_idx, &new_col_idx, new_rows, new_cols)
 
         /* Find last non-empty cell */
         int col_count = 0;
-        for (int c = old_cols - 1; c >= 0; c--) {
+        for (int c = min(old_row->used, old_cols) - 1; c >= 0; c--) {
             const struct cell *cell = &old_row->cells[c];
             if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
                 col_count = c + 1;
@@ -1076,6 +2447,7 @@ grid_resize_and_reflow(
                 count -= amount;
                 from += amount;
                 new_col_idx += amount;
+                new_row->used = new_col_idx;
 
                 xassert(new_col_idx <= new_cols);
 
@@ -1088,6 +2460,8 @@ grid_resize_and_reflow(
                         new_row->cells[new_col_idx].wc = CELL_SPACER;
                         new_row->cells[new_col_idx].attrs = cell->attrs;
                     }
+
+                    new_row->used = new_col_idx;
                 }
             }
 
@@ -1161,6 +2535,7 @@ grid_resize_and_reflow(
             /* Erase the remaining cells */
             memset(&new_row->cells[new_col_idx], 0,
                    (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
+            new_row->used = min(new_row->used, new_col_idx);
             new_row->linebreak = true;
 
             if (r + 1 < old_rows)
@@ -1188,15 +2563,20 @@ grid_resize_and_reflow(
             }
         }
 
-        grid_row_free(old_grid[old_row_idx]);
-        grid->rows[old_row_idx] = NULL;
+        if (!(flags & REFLOW_KEEP_OLD_ROWS)) {
+            grid_row_free(old_grid[old_row_idx]);
+            grid->rows[old_row_idx] = NULL;
+        }
 
 #undef line_wrap
     }
 
+    free(scratch);
+
     /* Erase the remaining cells */
     memset(&new_row->cells[new_col_idx], 0,
            (new_cols - new_col_idx) * sizeof(new_row->cells[0]));
+    new_row->used = min(new_row->used, new_col_idx);
 
     for (struct coord **tp = next_tp; *tp != &terminator; tp++) {
         LOG_DBG("TP: row=%d, col=%d (old cols: %d, new cols: %d)",
@@ -1211,6 +2591,11 @@ grid_resize_and_reflow(
 
         if (row == NULL)
             continue;
+
+        xassert(row->used <= new_cols);
+        for (int c = row->used; c < new_cols; c++)
+            xassert(row->cells[c].wc == 0);
+
         if (row->extra == NULL)
             continue;
 
@@ -1223,9 +2608,11 @@ grid_resize_and_reflow(
         verify_ranges_are_sorted(row->extra);
     }
 
-    /* Verify all old rows have been free:d */
-    for (int i = 0; i < old_rows; i++)
-        xassert(grid->rows[i] == NULL);
+    /* Verify all (non-deferred) old rows have been free:d */
+    for (int r = deferred; r < old_rows; r++) {
+        xassert(flags & REFLOW_KEEP_OLD_ROWS ||
+                grid->rows[(offset + r) & (old_rows - 1)] == NULL);
+    }
 #endif
 
     /* Set offset such that the last reflowed row is at the bottom */
@@ -1240,11 +2627,47 @@ grid_resize_and_reflow(
     for (int r = 0; r < new_screen_rows; r++) {
         int idx = (grid->offset + r) & (new_rows - 1);
         if (new_grid[idx] == NULL)
-            new_grid[idx] = grid_row_alloc(new_cols, true);
+            new_grid[idx] = grid_row_alloc(new_slab, new_cols, true);
     }
 
-    /* Free old grid (rows already free:d) */
-    free(grid->rows);
+    if (deferred > 0) {
+        /* Hand the old grid, with the deferred rows, over to a new
+         * segment, reflowed by grid_reflow_step() */
+        if (grid->reflow == NULL) {
+            grid->reflow = xmalloc(sizeof(*grid->reflow));
+            *grid->reflow = (struct grid_reflow){.segments = tll_init()};
+        }
+
+        tll_push_front(grid->reflow->segments, ((struct reflow_segment){
+            .rows = grid->rows,
+            .num_rows = old_rows,
+            .num_cols = old_cols,
+            .first = offset & (old_rows - 1),
+            .count = deferred,
+            .slab = slab_ref(grid->slab),
+            .sixel_images = tll_init(),
+        }));
+
+        struct reflow_segment *seg = &tll_front(grid->reflow->segments);
+        tll_foreach(untranslated_sixels, it) {
+            if (((it->item.pos.row - offset) & (old_rows - 1)) >= deferred)
+                continue;
+
+            tll_push_back(seg->sixel_images, it->item);
+            tll_remove(untranslated_sixels, it);
+        }
+    } else {
+        /* Free old grid (rows already free:d) */
+        free(grid->rows);
+    }
+
+    /* Deferred rows are prepended to the (newly reflowed) oldest row */
+    if (grid->reflow != NULL) {
+        grid->reflow->top = 0;
+        grid->reflow->thread_count = thread_count;
+    }
+
+    slab_replace(grid, new_slab);
 
     grid->rows = new_grid;
     grid->num_rows = new_rows;
@@ -1301,14 +2724,223 @@ grid_resize_and_reflow(
 #endif
 }
 
+void
+grid_resize_and_reflow(
+    struct grid *grid, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows, size_t thread_count,
+    size_t tracking_points_count,
+    struct coord *const _tracking_points[static tracking_points_count])
+{
+    resize_and_reflow(
+        grid, new_rows, new_cols, old_screen_rows, new_screen_rows,
+        REFLOW_LAZY, thread_count, tracking_points_count, _tracking_points);
+
+    /* Reflowed rows are uncompressed */
+    grid->compress_watermark = grid->num_rows;
+}
+
+static void
+reflow_segment_destroy(struct reflow_segment *seg)
+{
+    for (int i = 0; i < seg->count; i++)
+        grid_row_free(seg->rows[(seg->first + i) & (seg->num_rows - 1)]);
+    free(seg->rows);
+
+    tll_foreach(seg->sixel_images, it)
+        sixel_destroy(&it->item);
+    tll_free(seg->sixel_images);
+
+    grid_slab_destroy(seg->slab);
+}
+
+bool
+grid_reflow_is_pending(const struct grid *grid)
+{
+    return grid->reflow != NULL;
+}
+
+void
+grid_reflow_discard(struct grid *grid)
+{
+    struct grid_reflow *reflow = grid->reflow;
+    if (reflow == NULL)
+        return;
+
+    tll_foreach(reflow->segments, it) {
+        reflow_segment_destroy(&it->item);
+        tll_remove(reflow->segments, it);
+    }
+
+    free(reflow);
+    grid->reflow = NULL;
+}
+
+bool
+grid_reflow_step(struct grid *grid, int max_rows, bool compress)
+{
+    struct grid_reflow *reflow = grid->reflow;
+    if (reflow == NULL)
+        return false;
+
+    xassert(grid->slab != NULL);
+    xassert(tll_length(reflow->segments) > 0);
+
+    const int grid_mask = grid->num_rows - 1;
+
+    if (grid->rows[(reflow->top - 1) & grid_mask] != NULL) {
+        /* Ring is full; there's no room for older rows */
+        LOG_DBG("scrollback full; discarding not-yet-reflowed rows");
+        grid_reflow_discard(grid);
+        return false;
+    }
+
+    struct reflow_segment *seg = &tll_front(reflow->segments);
+    const int mask = seg->num_rows - 1;
+
+    /* Take the newest rows, but don't split logical lines */
+    int count = min(max_rows, seg->count);
+    while (count < seg->count) {
+        const struct row *row =
+            seg->rows[(seg->first + seg->count - count - 1) & mask];
+        if (row == NULL || row->linebreak)
+            break;
+        count++;
+    }
+
+    const int start = (seg->first + seg->count - count) & mask;
+
+    /*
+     * Reflow the chunk as a grid of its own, with the chunk's last
+     * row as the "screen". The chunk's rows are allocated from our
+     * slab, since they are moved over to us when done.
+     */
+    struct grid chunk = {
+        .num_rows = 1 << (32 - __builtin_clz(count)),
+        .num_cols = seg->num_cols,
+        .slab = slab_ref(grid->slab),
+        .scroll_damage = tll_init(),
+        .sixel_images = tll_init(),
+    };
+    chunk.rows = xcalloc(chunk.num_rows, sizeof(chunk.rows[0]));
+
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        const int idx = (start + i) & mask;
+        struct row *row = seg->rows[idx];
+
+        if (row == NULL)
+            continue;
+
+        tll_foreach(seg->sixel_images, it) {
+            if (it->item.pos.row != idx)
+                continue;
+
+            struct sixel sixel = it->item;
+            sixel.pos.row = used;
+            tll_push_back(chunk.sixel_images, sixel);
+            tll_remove(seg->sixel_images, it);
+        }
+
+        chunk.rows[used++] = row;
+        seg->rows[idx] = NULL;
+    }
+
+    seg->count -= count;
+
+    if (used > 0) {
+        chunk.offset = chunk.view = used - 1;
+
+        /* Worst case, each row is split into multiple rows */
+        const int split = (seg->num_cols + grid->num_cols - 1) / grid->num_cols;
+        const int chunk_rows = 1 << (32 - __builtin_clz(
+            min((int64_t)used * split, grid->num_rows)));
+
+        struct coord *const no_tracking_points[] = {NULL};
+        resize_and_reflow(
+            &chunk, chunk_rows, grid->num_cols, 1, 1,
+            0, reflow->thread_count, 0, no_tracking_points);
+    }
+
+    /* Prepend the reflowed rows, newest first */
+    const int chunk_mask = chunk.num_rows - 1;
+    const int top = reflow->top;
+    bool full = false;
+
+    for (int i = 0, idx = chunk.offset; used > 0 && i < chunk.num_rows;
+         i++, idx = (idx - 1) & chunk_mask)
+    {
+        struct row *row = chunk.rows[idx];
+        if (row == NULL)
+            break;
+
+        const int slot = (reflow->top - 1) & grid_mask;
+        if (grid->rows[slot] != NULL) {
+            full = true;
+            break;
+        }
+
+        if (compress)
+            grid_row_compress(row, grid->num_cols);
+
+        grid->rows[slot] = row;
+        chunk.rows[idx] = NULL;
+        reflow->top = slot;
+    }
+
+    tll_foreach(chunk.sixel_images, it) {
+        struct sixel *six = &it->item;
+
+        if (chunk.rows[six->pos.row] == NULL) {
+            /* Row was moved; sixels may not cross the ring's wrap-around */
+            const int distance = (chunk.offset - six->pos.row) & chunk_mask;
+            const int slot = (top - 1 - distance) & grid_mask;
+
+            if (six->rows <= grid->num_rows &&
+                slot + six->rows - 1 <= grid_mask)
+            {
+                six->pos.row = slot;
+                tll_push_back(grid->sixel_images, *six);
+                continue;
+            }
+        }
+
+        sixel_destroy(six);
+    }
+    tll_free(chunk.sixel_images);
+
+    for (int r = 0; r < chunk.num_rows; r++)
+        grid_row_free(chunk.rows[r]);
+    free(chunk.rows);
+    grid_slab_destroy(chunk.slab);
+
+    if (full) {
+        LOG_DBG("scrollback full; discarding not-yet-reflowed rows");
+        grid_reflow_discard(grid);
+        return false;
+    }
+
+    if (seg->count == 0) {
+        reflow_segment_destroy(seg);
+        tll_pop_front(reflow->segments);
+
+        if (tll_length(reflow->segments) == 0) {
+            free(reflow);
+            grid->reflow = NULL;
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static bool
 ranges_match(const struct row_range *r1, const struct row_range *r2,
              enum row_range_type type)
 {
     switch (type) {
     case ROW_RANGE_URI:
-        /* TODO: also match URI? */
-        return r1->uri.id == r2->uri.id;
+        /* Interned; equal pointers means equal ID *and* URI */
+        return r1->uri.link == r2->uri.link;
 
     case ROW_RANGE_UNDERLINE:
         return r1->underline.style == r2->underline.style &&
@@ -1326,7 +2958,7 @@ range_match_data(const struct row_range *r, const union row_range_data *data,
 {
     switch (type) {
     case ROW_RANGE_URI:
-        return r->uri.id == data->uri.id;
+        return r->uri.link == data->uri.link;
 
     case ROW_RANGE_UNDERLINE:
         return r->underline.style == data->underline.style &&
@@ -1346,66 +2978,62 @@ grid_row_range_put(struct row_ranges *ranges, int col,
     bool replace = false;
     bool run_merge_pass = false;
 
-    for (int i = ranges->count - 1; i >= 0; i--) {
-        struct row_range *r = &ranges->v[i];
+    const int i = range_find_end(ranges, col);
+    struct row_range *r = i < ranges->count ? &ranges->v[i] : NULL;
 
-        const bool matching = range_match_data(r, data, type);
+    if (r == NULL || r->start > col) {
+        /* Not covered by any range */
+        struct row_range *prev = i > 0 ? &ranges->v[i - 1] : NULL;
 
-        if (matching && r->end + 1 == col) {
+        if (prev != NULL && prev->end + 1 == col &&
+            range_match_data(prev, data, type))
+        {
             /* Extend existing range tail */
-            r->end++;
+            prev->end++;
             return;
         }
 
-        else if (r->end < col) {
-            insert_idx = i + 1;
-            break;
-        }
+        insert_idx = i;
+    }
 
-        else if (r->start > col)
-            continue;
+    else {
+        xassert(r->start <= col);
+        xassert(r->end >= col);
 
-        else {
-            xassert(r->start <= col);
-            xassert(r->end >= col);
-
-            if (matching)
-                return;
-
-            if (r->start == r->end) {
-                replace = true;
-                run_merge_pass = true;
-                insert_idx = i;
-            } else if (r->start == col) {
-                run_merge_pass = true;
-                r->start++;
-                insert_idx = i;
-            } else if (r->end == col) {
-                run_merge_pass = true;
-                r->end--;
-                insert_idx = i + 1;
-            } else {
-                xassert(r->start < col);
-                xassert(r->end > col);
-
-                union row_range_data insert_data;
-                switch (type) {
-                case ROW_RANGE_URI: insert_data.uri = r->uri; break;
-                case ROW_RANGE_UNDERLINE: insert_data.underline = r->underline; break;
-                }
+        if (range_match_data(r, data, type))
+            return;
 
-                range_insert(ranges, i + 1, col + 1, r->end, type, &insert_data);
+        if (r->start == r->end) {
+            replace = true;
+            run_merge_pass = true;
+            insert_idx = i;
+        } else if (r->start == col) {
+            run_merge_pass = true;
+            r->start++;
+            insert_idx = i;
+        } else if (r->end == col) {
+            run_merge_pass = true;
+            r->end--;
+            insert_idx = i + 1;
+        } else {
+            xassert(r->start < col);
+            xassert(r->end > col);
+
+            union row_range_data insert_data;
+            switch (type) {
+            case ROW_RANGE_URI: insert_data.uri = r->uri; break;
+            case ROW_RANGE_UNDERLINE: insert_data.underline = r->underline; break;
+            }
 
-                /* The insertion may xrealloc() the vector, making our
-                 * 'old' pointer invalid */
-                r = &ranges->v[i];
-                r->end = col - 1;
-                xassert(r->start <= r->end);
+            range_insert(ranges, i + 1, col + 1, r->end, type, &insert_data);
 
-                insert_idx = i + 1;
-            }
+            /* The insertion may xrealloc() the vector, making our
+             * 'old' pointer invalid */
+            r = &ranges->v[i];
+            r->end = col - 1;
+            xassert(r->start <= r->end);
 
-            break;
+            insert_idx = i + 1;
         }
     }
 
@@ -1420,8 +3048,7 @@ grid_row_range_put(struct row_ranges *ranges, int col,
 
         switch (type) {
         case ROW_RANGE_URI:
-            ranges->v[insert_idx].uri.id = data->uri.id;
-            ranges->v[insert_idx].uri.uri = xstrdup(data->uri.uri);
+            ranges->v[insert_idx].uri.link = hyperlink_ref(data->uri.link);
             break;
 
         case ROW_RANGE_UNDERLINE:
@@ -1432,27 +3059,30 @@ grid_row_range_put(struct row_ranges *ranges, int col,
         range_insert(ranges, insert_idx, col, col, type, data);
 
     if (run_merge_pass) {
-        for (size_t i = 1; i < ranges->count; i++) {
-            struct row_range *r1 = &ranges->v[i - 1];
-            struct row_range *r2 = &ranges->v[i];
+        /* Only the new range's neighbours can have become mergeable */
+        for (size_t j = insert_idx + 1; j >= max(insert_idx, 1); j--) {
+            if (j >= ranges->count)
+                continue;
+
+            struct row_range *r1 = &ranges->v[j - 1];
+            struct row_range *r2 = &ranges->v[j];
 
             if (ranges_match(r1, r2, type) && r1->end + 1 == r2->start) {
                 r1->end = r2->end;
-                range_delete(ranges, type, i);
-                i--;
+                range_delete(ranges, type, j);
             }
         }
     }
 }
 
 void
-grid_row_uri_range_put(struct row *row, int col, const char *uri, uint64_t id)
+grid_row_uri_range_put(struct row *row, int col, struct hyperlink *link)
 {
     ensure_row_has_extra_data(row);
 
     grid_row_range_put(
         &row->extra->uri_ranges, col,
-        &(union row_range_data){.uri = {.id = id, .uri = (char *)uri}},
+        &(union row_range_data){.uri = {.link = link}},
         ROW_RANGE_URI);
 
     verify_no_overlapping_ranges(row->extra);
@@ -1478,62 +3108,78 @@ UNITTEST
     struct row_data row_data = {.uri_ranges = {0}};
     struct row row = {.extra = &row_data};
 
+    struct hyperlinks *links = hyperlinks_init();
+    struct hyperlink *foo = hyperlink_get(links, 123, "http://foo.bar");
+    struct hyperlink *head = hyperlink_get(links, 456, "http://head");
+    struct hyperlink *tail = hyperlink_get(links, 789, "http://tail");
+    struct hyperlink *splice = hyperlink_get(links, 000, "http://splice");
+
 #define verify_range(idx, _start, _end, _id)                     \
     do {                                                         \
         xassert(idx < row_data.uri_ranges.count);                \
         xassert(row_data.uri_ranges.v[idx].start == _start);     \
         xassert(row_data.uri_ranges.v[idx].end == _end);         \
-        xassert(row_data.uri_ranges.v[idx].uri.id == _id);       \
+        xassert(row_data.uri_ranges.v[idx].uri.link->id == _id); \
     } while (0)
 
-    grid_row_uri_range_put(&row, 0, "http://foo.bar", 123);
-    grid_row_uri_range_put(&row, 1, "http://foo.bar", 123);
-    grid_row_uri_range_put(&row, 2, "http://foo.bar", 123);
-    grid_row_uri_range_put(&row, 3, "http://foo.bar", 123);
+    grid_row_uri_range_put(&row, 0, foo);
+    grid_row_uri_range_put(&row, 1, foo);
+    grid_row_uri_range_put(&row, 2, foo);
+    grid_row_uri_range_put(&row, 3, foo);
     xassert(row_data.uri_ranges.count == 1);
     verify_range(0, 0, 3, 123);
 
     /* No-op */
-    grid_row_uri_range_put(&row, 0, "http://foo.bar", 123);
+    grid_row_uri_range_put(&row, 0, foo);
     xassert(row_data.uri_ranges.count == 1);
     verify_range(0, 0, 3, 123);
 
     /* Replace head */
-    grid_row_uri_range_put(&row, 0, "http://head", 456);
+    grid_row_uri_range_put(&row, 0, head);
     xassert(row_data.uri_ranges.count == 2);
     verify_range(0, 0, 0, 456);
     verify_range(1, 1, 3, 123);
 
     /* Replace tail */
-    grid_row_uri_range_put(&row, 3, "http://tail", 789);
+    grid_row_uri_range_put(&row, 3, tail);
     xassert(row_data.uri_ranges.count == 3);
     verify_range(1, 1, 2, 123);
     verify_range(2, 3, 3, 789);
 
     /* Replace tail + extend head */
-    grid_row_uri_range_put(&row, 2, "http://tail", 789);
+    grid_row_uri_range_put(&row, 2, tail);
     xassert(row_data.uri_ranges.count == 3);
     verify_range(1, 1, 1, 123);
     verify_range(2, 2, 3, 789);
 
     /* Replace + extend tail */
-    grid_row_uri_range_put(&row, 1, "http://head", 456);
+    grid_row_uri_range_put(&row, 1, head);
     xassert(row_data.uri_ranges.count == 2);
     verify_range(0, 0, 1, 456);
     verify_range(1, 2, 3, 789);
 
     /* Replace + extend, then splice */
-    grid_row_uri_range_put(&row, 1, "http://tail", 789);
-    grid_row_uri_range_put(&row, 2, "http://splice", 000);
+    grid_row_uri_range_put(&row, 1, tail);
+    grid_row_uri_range_put(&row, 2, splice);
     xassert(row_data.uri_ranges.count == 4);
     verify_range(0, 0, 0, 456);
     verify_range(1, 1, 1, 789);
     verify_range(2, 2, 2, 000);
     verify_range(3, 3, 3, 789);
 
-    for (size_t i = 0; i < row_data.uri_ranges.count; i++)
-        grid_row_uri_range_destroy(&row_data.uri_ranges.v[i]);
+    xassert(hyperlinks_count(links) == 4);
+    hyperlink_unref(foo);
+    hyperlink_unref(head);
+    xassert(hyperlinks_count(links) == 3);  /* 'foo' is no longer used */
+
+    grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
     free(row_data.uri_ranges.v);
+    xassert(hyperlinks_count(links) == 2);
+
+    hyperlink_unref(tail);
+    hyperlink_unref(splice);
+    xassert(hyperlinks_count(links) == 0);
+    hyperlinks_destroy(links);
 
 #undef verify_range
 }
@@ -1544,52 +3190,52 @@ grid_row_range_erase(struct row_ranges *ranges, enum row_range_type type,
 {
     xassert(start <= end);
 
-    /* Split up, or remove, URI ranges affected by the erase */
-    for (int i = ranges->count - 1; i >= 0; i--) {
-        struct row_range *old = &ranges->v[i];
+    /* The ranges affected by the erase are [first, last) */
+    const int first = range_find_end(ranges, start);
+    const int last = range_find_start(ranges, end);
 
-        if (old->end < start)
-            return;
+    if (first >= last)
+        return;
 
-        if (old->start > end)
-            continue;
+    struct row_range *head = &ranges->v[first];
+    struct row_range *tail = &ranges->v[last - 1];
 
-        if (start <= old->start && end >= old->end) {
-            /* Erase range covers URI completely - remove it */
-            range_delete(ranges, type, i);
-        }
+    if (head == tail && start > head->start && end < head->end) {
+        /*
+         * Erase range erases a part in the middle of the URI
+         *
+         * Must copy, since range_insert() may xrealloc() (thus
+         * causing 'head' to be invalid) before it dereferences
+         * head->data
+         */
+        union row_range_data data = head->data;
+        range_insert(ranges, first + 1, end + 1, head->end, type, &data);
 
-        else if (start > old->start && end < old->end) {
-            /*
-             * Erase range erases a part in the middle of the URI
-             *
-             * Must copy, since range_insert() may xrealloc() (thus
-             * causing 'old' to be invalid) before it dereferences
-             * old->data
-             */
-            union row_range_data data = old->data;
-            range_insert(ranges, i + 1, end + 1, old->end, type, &data);
+        /* The insertion may xrealloc() the vector, making our
+         * 'old' pointer invalid */
+        head = &ranges->v[first];
+        head->end = start - 1;
+        return;
+    }
 
-            /* The insertion may xrealloc() the vector, making our
-             * 'old' pointer invalid */
-            old = &ranges->v[i];
-            old->end = start - 1;
-            return;  /* There can be no more URIs affected by the erase range */
-        }
+    int delete_first = first;
+    int delete_last = last;
 
-        else if (start <= old->start && end >= old->start) {
-            /* Erase range erases the head of the URI */
-            xassert(start <= old->start);
-            old->start = end + 1;
-        }
+    if (start > head->start) {
+        /* Erase range erases the tail of the URI */
+        head->end = start - 1;
+        delete_first++;
+    }
 
-        else if (start <= old->end && end >= old->end) {
-            /* Erase range erases the tail of the URI */
-            xassert(end >= old->end);
-            old->end = start - 1;
-            return;  /* There can be no more overlapping URIs */
-        }
+    if (end < tail->end && delete_first < last) {
+        /* Erase range erases the head of the URI */
+        tail->start = end + 1;
+        delete_last--;
     }
+
+    /* Remove the URIs covered completely by the erase range */
+    if (delete_first < delete_last)
+        range_delete_n(ranges, type, delete_first, delete_last - delete_first);
 }
 
 void
@@ -1606,15 +3252,140 @@ grid_row_underline_range_erase(struct row *row, int start, int end)
     grid_row_range_erase(&row->extra->underline_ranges, ROW_RANGE_UNDERLINE, start, end);
 }
 
+/*
+ * Puts a range spanning multiple columns. This is equivalent to
+ * calling grid_row_range_put() once for each column in [start, end],
+ * but only touches the range vector a constant number of times.
+ */
+static void
+grid_row_range_put_span(struct row_ranges *ranges, int start, int end,
+                        const union row_range_data *data,
+                        enum row_range_type type)
+{
+    xassert(start <= end);
+
+    /* Remove, or cut, whatever is currently covering the span */
+    grid_row_range_erase(ranges, type, start, end);
+
+    /* Find insertion point */
+    const int idx = range_find_start(ranges, end);
+
+    xassert(idx == 0 || ranges->v[idx - 1].end < start);
+    xassert(idx == ranges->count || ranges->v[idx].start > end);
+
+    struct row_range *prev = idx > 0 ? &ranges->v[idx - 1] : NULL;
+    struct row_range *next = idx < ranges->count ? &ranges->v[idx] : NULL;
+
+    const bool merge_prev = prev != NULL &&
+        prev->end + 1 == start && range_match_data(prev, data, type);
+    const bool merge_next = next != NULL &&
+        next->start == end + 1 && range_match_data(next, data, type);
+
+    if (merge_prev && merge_next) {
+        prev->end = next->end;
+        range_delete(ranges, type, idx);
+    } else if (merge_prev)
+        prev->end = end;
+    else if (merge_next)
+        next->start = start;
+    else
+        range_insert(ranges, idx, start, end, type, data);
+}
+
+void
+grid_row_uri_range_put_span(struct row *row, int start, int end,
+                            struct hyperlink *link)
+{
+    ensure_row_has_extra_data(row);
+
+    grid_row_range_put_span(
+        &row->extra->uri_ranges, start, end,
+        &(union row_range_data){.uri = {.link = link}},
+        ROW_RANGE_URI);
+
+    verify_no_overlapping_ranges(row->extra);
+    verify_ranges_are_sorted(row->extra);
+}
+
+void
+grid_row_underline_range_put_span(struct row *row, int start, int end,
+                                  struct underline_range_data data)
+{
+    ensure_row_has_extra_data(row);
+
+    grid_row_range_put_span(
+        &row->extra->underline_ranges, start, end,
+        &(union row_range_data){.underline = data},
+        ROW_RANGE_UNDERLINE);
+
+    verify_no_overlapping_ranges(row->extra);
+    verify_ranges_are_sorted(row->extra);
+}
+
+UNITTEST
+{
+    struct row_data row_data = {.uri_ranges = {0}};
+    struct row row = {.extra = &row_data};
+
+    struct hyperlinks *links = hyperlinks_init();
+    struct hyperlink *foo = hyperlink_get(links, 123, "http://foo.bar");
+    struct hyperlink *splice = hyperlink_get(links, 456, "http://splice");
+    struct hyperlink *all = hyperlink_get(links, 789, "http://all");
+
+#define verify_range(idx, _start, _end, _id)                     \
+    do {                                                         \
+        xassert(idx < row_data.uri_ranges.count);                \
+        xassert(row_data.uri_ranges.v[idx].start == _start);     \
+        xassert(row_data.uri_ranges.v[idx].end == _end);         \
+        xassert(row_data.uri_ranges.v[idx].uri.link->id == _id); \
+    } while (0)
+
+    grid_row_uri_range_put_span(&row, 10, 19, foo);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 10, 19, 123);
+
+    /* Extend tail, and head */
+    grid_row_uri_range_put_span(&row, 20, 24, foo);
+    grid_row_uri_range_put_span(&row, 5, 9, foo);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 5, 24, 123);
+
+    /* Splice */
+    grid_row_uri_range_put_span(&row, 10, 14, splice);
+    xassert(row_data.uri_ranges.count == 3);
+    verify_range(0, 5, 9, 123);
+    verify_range(1, 10, 14, 456);
+    verify_range(2, 15, 24, 123);
+
+    /* Replace the splice, merging all three */
+    grid_row_uri_range_put_span(&row, 8, 16, foo);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 5, 24, 123);
+
+    /* Cover everything */
+    grid_row_uri_range_put_span(&row, 0, 30, all);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 0, 30, 789);
+
+    grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
+    free(row_data.uri_ranges.v);
+
+    hyperlink_unref(foo);
+    hyperlink_unref(splice);
+    hyperlink_unref(all);
+    xassert(hyperlinks_count(links) == 0);
+    hyperlinks_destroy(links);
+
+#undef verify_range
+}
+
 UNITTEST
 {
     struct row_data row_data = {.uri_ranges = {0}};
     struct row row = {.extra = &row_data};
+    struct hyperlinks *links = hyperlinks_init();
     const union row_range_data data = {
-        .uri = {
-            .id = 0,
-            .uri = (char *)"dummy",
-        },
+        .uri = {.link = hyperlink_get(links, 0, "dummy")},
     };
 
     /* Try erasing a row without any URIs */
@@ -1692,4 +3463,708 @@ UNITTEST
 
     grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
     free(row_data.uri_ranges.v);
+
+    hyperlink_unref(data.uri.link);
+    xassert(hyperlinks_count(links) == 0);
+    hyperlinks_destroy(links);
+}
+
+UNITTEST
+{
+    struct row_data row_data = {.uri_ranges = {0}};
+    struct row row = {.extra = &row_data};
+    const struct row_ranges *ranges = &row_data.uri_ranges;
+
+    struct hyperlinks *links = hyperlinks_init();
+    struct hyperlink *link[12];
+    for (size_t i = 0; i < ALEN(link); i++)
+        link[i] = hyperlink_get(links, i, "http://foo.bar");
+
+    /* Ranges 10-12, 20-22, ..., 90-92 */
+    for (int i = 1; i < 10; i++)
+        grid_row_uri_range_put_span(&row, i * 10, i * 10 + 2, link[i]);
+    xassert(ranges->count == 9);
+
+    /* Lookups, random access and right-to-left/left-to-right walks */
+    struct row_range_cursor cursor = {.ranges = ranges, .idx = ranges->count - 1};
+
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < 100; i++) {
+            const int col = pass == 1 ? i : 99 - i;
+            const bool covered = col >= 10 && col % 10 <= 2;
+
+            const struct row_range *r = pass == 2
+                ? grid_row_range_lookup(ranges, col)
+                : grid_row_range_cursor_lookup(&cursor, col);
+
+            xassert((r != NULL) == covered);
+            xassert(r == NULL || r->uri.link == link[col / 10]);
+        }
+    }
+
+    /* Cut the tail of 30-32, remove 40-42 and 50-52, cut the head of 60-62 */
+    grid_row_uri_range_erase(&row, 31, 60);
+    xassert(ranges->count == 7);
+    xassert(ranges->v[2].start == 30 && ranges->v[2].end == 30);
+    xassert(ranges->v[3].start == 61 && ranges->v[3].end == 62);
+    xassert(ranges->v[3].uri.link == link[6]);
+
+    /* Split 80-82 */
+    grid_row_uri_range_erase(&row, 81, 81);
+    xassert(ranges->count == 8);
+    xassert(ranges->v[5].start == 80 && ranges->v[5].end == 80);
+    xassert(ranges->v[6].start == 82 && ranges->v[6].end == 82);
+
+    /* Nothing to erase */
+    grid_row_uri_range_erase(&row, 95, 99);
+    grid_row_uri_range_erase(&row, 0, 9);
+    xassert(ranges->count == 8);
+
+    /* Extends the range to the left */
+    grid_row_uri_range_put(&row, 81, link[8]);
+    xassert(ranges->count == 8);
+    xassert(ranges->v[5].start == 80 && ranges->v[5].end == 81);
+
+    /* Replacing a single-cell range merges it with its neighbours */
+    grid_row_uri_range_put_span(&row, 0, 1, link[10]);
+    grid_row_uri_range_put_span(&row, 2, 2, link[11]);
+    grid_row_uri_range_put_span(&row, 3, 4, link[10]);
+    xassert(ranges->count == 11);
+
+    grid_row_uri_range_put(&row, 2, link[10]);
+    xassert(ranges->count == 9);
+    xassert(ranges->v[0].start == 0 && ranges->v[0].end == 4);
+    xassert(ranges->v[1].start == 10);
+
+    grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
+    free(row_data.uri_ranges.v);
+
+    for (size_t i = 0; i < ALEN(link); i++)
+        hyperlink_unref(link[i]);
+    xassert(hyperlinks_count(links) == 0);
+    hyperlinks_destroy(links);
+}
+
+UNITTEST
+{
+    const int cols = 80;
+    struct row *row = grid_row_alloc(NULL, cols, true);
+
+    /* Mix of ASCII, wide characters, spacers, combining chars and attributes */
+    const char32_t text[] = U"hello, 世界 wörld";
+    for (size_t i = 0; i < ALEN(text) - 1; i++) {
+        row->cells[i].wc = text[i];
+        row->cells[i].attrs.fg = i < 5 ? 0xff0000 : 0x00ff00;
+        row->cells[i].attrs.bold = i >= 7;
+    }
+    row->cells[40].wc = CELL_SPACER + 1;
+    row->cells[41].wc = CELL_COMB_CHARS_LO + 17;
+    row->cells[50].attrs.bg = 0x123456;
+    row->cells[50].attrs.bg_src = COLOR_RGB;
+
+    /* Alternating attributes; should re-use attribute table entries */
+    for (int c = 60; c < 70; c++) {
+        row->cells[c].wc = U'x';
+        row->cells[c].attrs.fg = c % 2 ? 0xff0000 : 0x00ff00;
+    }
+
+    struct cell orig[cols];
+    memcpy(orig, row->cells, sizeof(orig));
+
+    grid_row_compress(row, cols);
+    xassert(row->cells == NULL);
+    xassert(row->compressed != NULL);
+    xassert(row->compressed->size < cols * sizeof(struct cell) / 4);
+
+    /* red, green, green+bold, default, default+bg (cell 50) */
+    xassert(row->compressed->data[0] == 5);
+
+    /* Compressing an already compressed row is a no-op */
+    grid_row_compress(row, cols);
+
+    grid_row_uncompress(row);
+    xassert(row->cells != NULL);
+    xassert(row->compressed == NULL);
+    xassert(row->dirty);
+
+    /* Cell 50 is empty, despite its attributes */
+    xassert(row->used == 70);
+
+    for (int c = 0; c < cols; c++) {
+        struct attributes a = orig[c].attrs;
+        a.clean = false;
+
+        xassert(row->cells[c].wc == orig[c].wc);
+        xassert(memcmp(&row->cells[c].attrs, &a, sizeof(a)) == 0);
+    }
+
+    /* Empty row */
+    memset(row->cells, 0, cols * sizeof(row->cells[0]));
+    grid_row_compress(row, cols);
+    xassert(row->compressed->size == 1);
+    grid_row_uncompress(row);
+    for (int c = 0; c < cols; c++)
+        xassert(row->cells[c].wc == 0);
+
+    grid_row_free(row);
+}
+
+UNITTEST
+{
+    /*
+     * A row that has been rendered: every cell is clean and confined.
+     * The empty tail is still implicit
+     */
+    const int cols = 80;
+    struct row *row = grid_row_alloc(NULL, cols, true);
+    struct row *rendered = grid_row_alloc(NULL, cols, true);
+
+    for (int c = 0; c < 5; c++) {
+        row->cells[c].wc = U'a' + c;
+        rendered->cells[c].wc = U'a' + c;
+    }
+
+    for (int c = 0; c < cols; c++) {
+        row->cells[c].attrs.clean = false;
+        rendered->cells[c].attrs.clean = true;
+        rendered->cells[c].attrs.confined = true;
+    }
+
+    grid_row_compress(row, cols);
+    grid_row_compress(rendered, cols);
+
+    xassert(rendered->compressed->size == row->compressed->size);
+    xassert(memcmp(rendered->compressed->data, row->compressed->data,
+                   row->compressed->size) == 0);
+
+    grid_row_uncompress(rendered);
+    xassert(rendered->used == 5);
+    for (int c = 0; c < cols; c++) {
+        xassert(rendered->cells[c].wc == (c < 5 ? U'a' + c : 0));
+        xassert(!rendered->cells[c].attrs.confined);
+    }
+
+    grid_row_free(row);
+    grid_row_free(rendered);
+}
+
+UNITTEST
+{
+    /* Compress watermark, and decoding compressed rows without uncompressing them */
+    const int screen_rows = 4;
+    struct grid grid = {
+        .num_rows = 16,
+        .num_cols = 8,
+        .offset = 8,
+        .view = 8,
+        .compress_watermark = 16,
+    };
+
+    grid.rows = xcalloc(grid.num_rows, sizeof(grid.rows[0]));
+    for (int r = 0; r < grid.num_rows; r++) {
+        grid.rows[r] = grid_row_alloc(NULL, grid.num_cols, true);
+        grid.rows[r]->cells[0].wc = U'a' + r;
+        grid.rows[r]->used = 1;
+    }
+
+    /* Rows 3-12 above the screen get compressed */
+    grid_compress_scrollback(&grid, screen_rows, 2);
+    xassert(grid.compress_watermark == 2);
+    xassert(grid.rows[grid_row_absolute(&grid, -2)]->cells != NULL);
+    for (int r = 3; r <= 12; r++)
+        xassert(grid.rows[grid_row_absolute(&grid, -r)]->cells == NULL);
+
+    /* Peeking leaves the row compressed */
+    struct row *scratch = grid_row_alloc(NULL, grid.num_cols, false);
+    const int abs_row = grid_row_absolute(&grid, -5);
+    const struct row *peeked = grid_row_abs_peek(&grid, abs_row, scratch);
+    xassert(peeked == scratch);
+    xassert(scratch->cells[0].wc == U'a' + abs_row);
+    xassert(scratch->used == 1);
+    xassert(grid.rows[abs_row]->cells == NULL);
+    xassert(grid.compress_watermark == 2);
+
+    /* Uncompressed rows are returned as is... */
+    xassert(grid_row_abs_peek(&grid, grid_row_absolute(&grid, -1), scratch)
+            == grid.rows[grid_row_absolute(&grid, -1)]);
+    grid_row_free(scratch);
+
+    /* ...but uncompressing raises the watermark */
+    xassert(grid_row_abs(&grid, abs_row)->cells[0].wc == U'a' + abs_row);
+    xassert(grid.compress_watermark == 5);
+
+    grid_compress_scrollback(&grid, screen_rows, 2);
+    xassert(grid.rows[abs_row]->cells == NULL);
+    xassert(grid.compress_watermark == 2);
+
+    /* Rows in view are left uncompressed, and stay below the watermark */
+    grid.view = 0;
+    for (int r = 0; r < screen_rows; r++)
+        grid_row_in_view(&grid, r);
+    xassert(grid.compress_watermark == 8);
+
+    grid_compress_scrollback(&grid, screen_rows, 2);
+    xassert(grid.compress_watermark == 8);
+    for (int r = 0; r < screen_rows; r++)
+        xassert(grid.rows[r]->cells != NULL);
+
+    for (int r = 0; r < grid.num_rows; r++)
+        grid_row_free(grid.rows[r]);
+    free(grid.rows);
+}
+
+UNITTEST
+{
+    /* Scrollback ring grows when the screen is about to wrap around */
+    const int cols = 4;
+    const int screen_rows = 3;
+
+    struct grid grid = {
+        .num_rows = 4,
+        .num_cols = cols,
+        .offset = 1,
+        .rows = xcalloc(4, sizeof(grid.rows[0])),
+    };
+
+    for (int r = 0; r < grid.num_rows; r++)
+        grid.rows[r] = grid_row_alloc(NULL, cols, true);
+
+    struct row *first = grid.rows[0];
+    struct row *last = grid.rows[3];
+
+    /* Ring already at its maximum size */
+    grid_grow_for_scroll(&grid, screen_rows, 1, 1, 0);
+    xassert(grid.num_rows == 4);
+
+    /* Not wrapping around */
+    grid.offset = 0;
+    grid_grow_for_scroll(&grid, screen_rows, 1, 100, 0);
+    xassert(grid.num_rows == 4);
+
+    /* Memory budget exceeded */
+    grid.offset = 1;
+    grid_grow_for_scroll(&grid, screen_rows, 1, 100, 1);
+    xassert(grid.num_rows == 4);
+
+    grid_grow_for_scroll(&grid, screen_rows, 1, 100, 0);
+    xassert(grid.num_rows == 8);
+    xassert(grid.rows[0] == first);
+    xassert(grid.rows[3] == last);
+    for (int r = 4; r < 8; r++)
+        xassert(grid.rows[r] == NULL);
+
+    /* Ring size needed to reflow the grid to half the columns */
+    xassert(grid_resize_ring_size(&grid, cols / 2, screen_rows, 100) == 16);
+    xassert(grid_resize_ring_size(&grid, cols / 2, screen_rows, 4) == 8);
+    xassert(grid_resize_ring_size(&grid, cols, screen_rows, 100) == 8);
+
+    grid_free(&grid);
+}
+
+UNITTEST
+{
+    /* Spilled rows round-trip */
+    const int cols = 8;
+
+    const char *tmpdir = getenv("TMPDIR");
+    char *dir = xstrjoin(
+        tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp",
+        "/foot-grid-test-XXXXXX");
+    xassert(mkdtemp(dir) != NULL);
+
+    struct spill *spill = spill_init(dir, 4096, 0);
+    struct hyperlinks *links = hyperlinks_init();
+
+    struct row *row = grid_row_alloc(NULL, cols, true);
+    row->cells[0].wc = U'a';
+    row->cells[1].wc = U'b';
+    row->cells[1].attrs.bold = true;
+    row->linebreak = true;
+    row->shell_integration.prompt_marker = true;
+    row->shell_integration.cmd_start = 2;
+    row->shell_integration.cmd_end = 5;
+
+    struct hyperlink *link = hyperlink_get(links, 123, "http://foo.bar");
+    grid_row_uri_range_put(row, 0, link);
+    grid_row_uri_range_put(row, 1, link);
+    hyperlink_unref(link);
+
+    const struct underline_range_data curly = {
+        .style = UNDERLINE_CURLY,
+        .color_src = COLOR_RGB,
+        .color = 0xff0000,
+    };
+    grid_row_underline_range_put(row, 3, curly);
+
+    xassert(grid_row_spill(spill, row, cols));
+    grid_row_free(row);
+
+    /* The spilled row doesn't hold a reference to the hyperlink */
+    xassert(hyperlinks_count(links) == 0);
+
+    row = grid_row_alloc(NULL, cols, true);
+    xassert(grid_row_spill(spill, row, cols));
+    grid_row_free(row);
+
+    xassert(spill_count(spill) == 2);
+
+    int spilled_cols;
+    row = grid_row_unspill(spill, 0, links, &spilled_cols);
+    xassert(spilled_cols == cols);
+    xassert(row->linebreak);
+    xassert(row->cells[0].wc == U'a');
+    xassert(row->cells[1].wc == U'b');
+    xassert(row->cells[1].attrs.bold);
+    xassert(row->cells[2].wc == 0);
+    xassert(row->shell_integration.prompt_marker);
+    xassert(row->shell_integration.cmd_start == 2);
+    xassert(row->shell_integration.cmd_end == 5);
+
+    xassert(row->extra != NULL);
+    xassert(row->extra->uri_ranges.count == 1);
+    const struct row_range *uri = &row->extra->uri_ranges.v[0];
+    xassert(uri->start == 0);
+    xassert(uri->end == 1);
+    xassert(uri->uri.link->id == 123);
+    xassert(streq(uri->uri.link->uri, "http://foo.bar"));
+    xassert(hyperlinks_count(links) == 1);
+
+    xassert(row->extra->underline_ranges.count == 1);
+    const struct row_range *underline = &row->extra->underline_ranges.v[0];
+    xassert(underline->start == 3);
+    xassert(underline->end == 3);
+    xassert(underline->underline.style == UNDERLINE_CURLY);
+    xassert(underline->underline.color_src == COLOR_RGB);
+    xassert(underline->underline.color == 0xff0000);
+    grid_row_free(row);
+    xassert(hyperlinks_count(links) == 0);
+
+    row = grid_row_unspill(spill, 1, links, &spilled_cols);
+    xassert(!row->linebreak);
+    xassert(row->cells[0].wc == 0);
+    xassert(!row->shell_integration.prompt_marker);
+    xassert(row->shell_integration.cmd_start == -1);
+    xassert(row->shell_integration.cmd_end == -1);
+    xassert(row->extra == NULL);
+    grid_row_free(row);
+
+    hyperlinks_destroy(links);
+    spill_destroy(spill);
+    xassert(rmdir(dir) == 0);
+    free(dir);
+}
+
+UNITTEST
+{
+    /* Spilled rows are paged back in, in front of the oldest row */
+    const int cols = 4;
+    const int spilled_cols = 6;
+    const int screen_rows = 3;
+
+    const char *tmpdir = getenv("TMPDIR");
+    char *dir = xstrjoin(
+        tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp",
+        "/foot-grid-test-XXXXXX");
+    xassert(mkdtemp(dir) != NULL);
+
+    struct spill *spill = spill_init(dir, 4096, 0);
+    struct hyperlinks *links = hyperlinks_init();
+    struct hyperlink *link = hyperlink_get(links, 0, "http://foo.bar");
+
+    /* Wider than the grid; the last column is cut off */
+    for (int i = 0; i < 3; i++) {
+        struct row *row = grid_row_alloc(NULL, spilled_cols, true);
+        row->cells[0].wc = U'A' + i;
+        row->cells[spilled_cols - 1].wc = U'z';
+        grid_row_mark_used(row, spilled_cols);
+        row->linebreak = i == 1;
+
+        if (i == 0) {
+            /* Truncated, and dropped, respectively */
+            for (int c = 2; c < spilled_cols; c++)
+                grid_row_uri_range_put(row, c, link);
+            grid_row_underline_range_put(
+                row, spilled_cols - 1,
+                (struct underline_range_data){.style = UNDERLINE_DOUBLE});
+            row->shell_integration.cmd_end = spilled_cols - 1;
+        }
+
+        xassert(grid_row_spill(spill, row, spilled_cols));
+        grid_row_free(row);
+    }
+
+    /* Full ring, with a single scrollback row (index 0) */
+    struct grid grid = {
+        .num_rows = 4,
+        .num_cols = cols,
+        .offset = 1,
+        .view = 1,
+        .rows = xcalloc(4, sizeof(grid.rows[0])),
+        .slab = grid_slab_new(cols),
+    };
+
+    for (int r = 0; r < grid.num_rows; r++)
+        grid.rows[r] = grid_row_alloc(grid.slab, cols, true);
+
+    struct row *oldest = grid.rows[0];
+    struct row *bottom = grid.rows[3];
+    struct coord tp = {.col = 0, .row = 2};
+    struct coord *const tracking_points[] = {&tp};
+
+    /* Not allowed to grow the ring */
+    xassert(grid_spill_page_in(
+        &grid, screen_rows, spill, links, 10, 4, false, 1, tracking_points) == 0);
+    xassert(grid.num_rows == 4);
+    xassert(spill_count(spill) == 3);
+
+    /* Ring is doubled; the new slots are inserted before the oldest row */
+    xassert(grid_spill_page_in(
+        &grid, screen_rows, spill, links, 2, 8, false, 1, tracking_points) == 2);
+    xassert(grid.num_rows == 8);
+    xassert(grid.offset == 5);
+    xassert(grid.view == 5);
+    xassert(tp.row == 6);
+    xassert(grid.rows[4] == oldest);
+    xassert(grid.rows[7] == bottom);
+    xassert(spill_count(spill) == 1);
+
+    xassert(grid.rows[3]->cells[0].wc == U'C');
+    xassert(grid.rows[2]->cells[0].wc == U'B');
+    xassert(grid.rows[2]->linebreak);
+    xassert(!grid.rows[3]->linebreak);
+    xassert(grid.rows[3]->used <= cols);
+    xassert(grid.rows[3]->cells[cols - 1].wc == 0);
+
+    /* Remaining free slots */
+    xassert(grid_spill_page_in(
+        &grid, screen_rows, spill, links, 10, 8, true, 1, tracking_points) == 1);
+    xassert(spill_count(spill) == 0);
+    xassert(grid.rows[1]->compressed != NULL);
+    grid_row_uncompress(grid.rows[1]);
+    xassert(grid.rows[1]->cells[0].wc == U'A');
+    xassert(grid.rows[1]->shell_integration.cmd_end == cols - 1);
+    xassert(grid.rows[1]->extra->uri_ranges.count == 1);
+    xassert(grid.rows[1]->extra->uri_ranges.v[0].start == 2);
+    xassert(grid.rows[1]->extra->uri_ranges.v[0].end == cols - 1);
+    xassert(grid.rows[1]->extra->uri_ranges.v[0].uri.link == link);
+    xassert(grid.rows[1]->extra->underline_ranges.count == 0);
+    xassert(grid.rows[0] == NULL);
+
+    xassert(grid_sb_start_ignore_uninitialized(&grid, screen_rows) == 1);
+    xassert(grid_spill_page_in(
+        &grid, screen_rows, spill, links, 10, 8, false, 1, tracking_points) == 0);
+
+    grid_free(&grid);
+    hyperlink_unref(link);
+    xassert(hyperlinks_count(links) == 0);
+    hyperlinks_destroy(links);
+    spill_destroy(spill);
+    xassert(rmdir(dir) == 0);
+    free(dir);
+}
+
+UNITTEST
+{
+    /* Lazy reflow; the deferred rows are reflowed, in order, by
+     * grid_reflow_step() */
+    const int old_cols = 8;
+    const int new_cols = 4;
+    const int screen_rows = 4;
+    const int old_rows = 16384;
+
+    struct grid grid = {
+        .num_rows = old_rows,
+        .num_cols = old_cols,
+        .offset = old_rows - screen_rows,
+        .view = old_rows - screen_rows,
+        .rows = xcalloc(old_rows, sizeof(grid.rows[0])),
+        .slab = grid_slab_new(old_cols),
+    };
+
+    /* Every third row ends a logical line */
+    for (int r = 0; r < old_rows; r++) {
+        struct row *row = grid_row_alloc(grid.slab, old_cols, true);
+        for (int c = 0; c < old_cols; c++)
+            row->cells[c].wc = 0x1000 + r * old_cols + c;
+        grid_row_mark_used(row, old_cols);
+        row->linebreak = r % 3 == 2;
+        grid.rows[r] = row;
+    }
+
+    grid.cur_row = grid.rows[grid.offset];
+
+    const int new_rows =
+        grid_resize_ring_size(&grid, new_cols, screen_rows, 100000);
+    xassert(new_rows == 65536);
+
+    struct coord *const no_tracking_points[] = {NULL};
+    grid_resize_and_reflow(
+        &grid, new_rows, new_cols, screen_rows, screen_rows, 1,
+        0, no_tracking_points);
+
+    xassert(grid_reflow_is_pending(&grid));
+    xassert(grid.num_rows == new_rows);
+    xassert(grid.num_cols == new_cols);
+
+    /* The screen is reflowed right away */
+    const struct row *last = grid.rows[(grid.offset + screen_rows - 1) & (new_rows - 1)];
+    xassert(last->cells[new_cols - 1].wc == 0x1000 + old_rows * old_cols - 1);
+
+    int steps = 0;
+    while (grid_reflow_step(&grid, 1000, false))
+        steps++;
+    xassert(steps > 1);
+    xassert(!grid_reflow_is_pending(&grid));
+
+    /* All cells, in order */
+    const int sb_start = grid_sb_start_ignore_uninitialized(&grid, screen_rows);
+    char32_t expected = 0x1000;
+
+    for (int r = sb_start;; r = (r + 1) & (new_rows - 1)) {
+        const struct row *row = grid.rows[r];
+        xassert(row != NULL);
+        for (int c = 0; c < new_cols; c++)
+            xassert(row->cells[c].wc == expected++);
+
+        if (r == ((grid.offset + screen_rows - 1) & (new_rows - 1)))
+            break;
+    }
+
+    xassert(expected == 0x1000 + old_rows * old_cols);
+
+    /* Deferred rows can be thrown away, e.g. when erasing the scrollback */
+    grid_resize_and_reflow(
+        &grid, new_rows, old_cols, screen_rows, screen_rows, 1,
+        0, no_tracking_points);
+    xassert(grid_reflow_is_pending(&grid));
+    grid_reflow_discard(&grid);
+    xassert(!grid_reflow_is_pending(&grid));
+
+    grid_free(&grid);
+}
+
+UNITTEST
+{
+    /* Parallel reflow gives the same result as a serial reflow */
+    const int old_cols = 8;
+    const int new_cols = 5;
+    const int screen_rows = 5;
+    const int old_rows = 32768;
+
+    struct grid grids[2];
+    struct coord tps[2][2];
+    int new_rows = 0;
+
+    /* Shared by both grids; the reflow threads (un)reference them concurrently */
+    struct hyperlinks *links = hyperlinks_init();
+    struct hyperlink *link[4];
+    for (size_t i = 0; i < ALEN(link); i++)
+        link[i] = hyperlink_get(links, i, "http://foo.bar");
+
+    for (size_t i = 0; i < ALEN(grids); i++) {
+        struct grid *grid = &grids[i];
+
+        /* Viewport at the top of the scrollback; nothing is deferred */
+        *grid = (struct grid){
+            .num_rows = old_rows,
+            .num_cols = old_cols,
+            .offset = old_rows - screen_rows,
+            .view = 0,
+            .rows = xcalloc(old_rows, sizeof(grid->rows[0])),
+            .slab = grid_slab_new(old_cols),
+        };
+
+        for (int r = 0; r < old_rows; r++) {
+            struct row *row = grid_row_alloc(grid->slab, old_cols, true);
+            const int len = r % 11 < old_cols ? r % 11 : old_cols;
+
+            for (int c = 0; c < len; c++) {
+                row->cells[c].wc = 0x1000 + r * old_cols + c;
+                row->cells[c].attrs.fg = r % 13;
+            }
+            grid_row_mark_used(row, len);
+
+            if (r % 3 == 0 && len > 1)
+                grid_row_uri_range_put_span(row, 1, len - 1, link[r % 4]);
+
+            row->linebreak = r % 5 == 1 || r % 5 == 4 || len < old_cols;
+            grid->rows[r] = row;
+
+            if (r % 7 == 0 && r < grid->offset)
+                grid_row_compress(row, old_cols);
+        }
+
+        grid->cur_row = grid->rows[grid->offset];
+
+        if (i == 0) {
+            new_rows = grid_resize_ring_size(
+                grid, new_cols, screen_rows, 100000);
+        }
+
+        tps[i][0] = (struct coord){3, 12345};
+        tps[i][1] = (struct coord){6, 20001};
+
+        struct coord *const tracking_points[] = {&tps[i][0], &tps[i][1]};
+        grid_resize_and_reflow(
+            grid, new_rows, new_cols, screen_rows, screen_rows,
+            i == 0 ? 1 : 4, ALEN(tracking_points), tracking_points);
+
+        xassert(!grid_reflow_is_pending(grid));
+    }
+
+    const struct grid *serial = &grids[0];
+    const struct grid *parallel = &grids[1];
+
+    xassert(serial->num_rows == parallel->num_rows);
+    xassert(grid_row_abs_to_sb(serial, screen_rows, serial->offset) ==
+            grid_row_abs_to_sb(parallel, screen_rows, parallel->offset));
+    xassert(grid_row_abs_to_sb(serial, screen_rows, serial->view) ==
+            grid_row_abs_to_sb(parallel, screen_rows, parallel->view));
+    xassert(serial->cursor.point.row == parallel->cursor.point.row);
+    xassert(serial->cursor.point.col == parallel->cursor.point.col);
+
+    for (size_t i = 0; i < ALEN(tps[0]); i++) {
+        xassert(tps[0][i].col == tps[1][i].col);
+        xassert(grid_row_abs_to_sb(serial, screen_rows, tps[0][i].row) ==
+                grid_row_abs_to_sb(parallel, screen_rows, tps[1][i].row));
+    }
+
+    for (int r = 0; r < new_rows; r++) {
+        const struct row *row_a =
+            serial->rows[grid_row_sb_to_abs(serial, screen_rows, r)];
+        const struct row *row_b =
+            parallel->rows[grid_row_sb_to_abs(parallel, screen_rows, r)];
+
+        xassert((row_a == NULL) == (row_b == NULL));
+        if (row_a == NULL)
+            continue;
+
+        xassert(row_a->linebreak == row_b->linebreak);
+        for (int c = 0; c < new_cols; c++) {
+            xassert(row_a->cells[c].wc == row_b->cells[c].wc);
+            xassert(row_a->cells[c].attrs.fg == row_b->cells[c].attrs.fg);
+        }
+
+        xassert((row_a->extra == NULL) == (row_b->extra == NULL));
+        if (row_a->extra == NULL)
+            continue;
+
+        const struct row_ranges *uris_a = &row_a->extra->uri_ranges;
+        const struct row_ranges *uris_b = &row_b->extra->uri_ranges;
+
+        xassert(uris_a->count == uris_b->count);
+        for (int i = 0; i < uris_a->count; i++) {
+            xassert(uris_a->v[i].start == uris_b->v[i].start);
+            xassert(uris_a->v[i].end == uris_b->v[i].end);
+            xassert(uris_a->v[i].uri.link == uris_b->v[i].uri.link);
+        }
+    }
+
+    grid_free(&grids[0]);
+    grid_free(&grids[1]);
+
+    for (size_t i = 0; i < ALEN(link); i++)
+        hyperlink_unref(link[i]);
+    xassert(hyperlinks_count(links) == 0);
+    hyperlinks_destroy(links);
 }
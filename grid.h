@@ -8,19 +8,126 @@ struct grid *grid_snapshot(const struct grid *grid);
 void grid_free(struct grid *grid);
 
 void grid_swap_row(struct grid *grid, int row_a, int row_b);
-struct row *grid_row_alloc(int cols, bool initialize);
+
+/*
+ * Per-grid row allocator. Packs row headers, and cell arrays of a
+ * fixed width, into large chunks.
+ */
+struct grid_slab *grid_slab_new(int cols);
+void grid_slab_destroy(struct grid_slab *slab);
+
+/* 'slab' may be NULL, in which case the row is malloc:ed */
+struct row *grid_row_alloc(struct grid_slab *slab, int cols, bool initialize);
 void grid_row_free(struct row *row);
 
+/*
+ * Scrollback compression. Compressed rows have their cell array
+ * replaced with a run-length encoded, packed, representation, and
+ * must be uncompressed before their cells are accessed.
+ *
+ * grid_row(), grid_row_and_alloc(), grid_row_in_view() and
+ * grid_row_abs() always return uncompressed rows. They uncompress
+ * through grid_row_uncompress_abs(), which raises the grid's compress
+ * watermark, limiting how much of the scrollback
+ * grid_compress_scrollback() has to scan.
+ */
+void grid_row_compress(struct row *row, int cols);
+void grid_row_uncompress(struct row *row);
+void grid_row_uncompress_abs(struct grid *grid, int abs_row);
+void grid_compress_scrollback(
+    struct grid *grid, int screen_rows, int distance);
+
+/*
+ * Returns the row at the absolute row index 'abs_row', or NULL,
+ * without uncompressing it. A compressed row is instead decoded into
+ * 'scratch' (from grid_row_alloc(NULL, grid->num_cols, false)), of
+ * which only the cells, 'used', 'linebreak' and 'shell_integration'
+ * are valid. For read-only scans of the scrollback, e.g. searching.
+ */
+const struct row *grid_row_abs_peek(
+    const struct grid *grid, int abs_row, struct row *scratch);
+
+/*
+ * Disk-spilled scrollback. grid_row_spill() appends the (compressed)
+ * row, including its URI and underline ranges, and its shell
+ * integration marks, to 'spill'. grid_row_unspill() returns a newly
+ * allocated copy of a spilled row (with 'cols' columns; the grid's
+ * width at the time it was spilled), to be free:d with
+ * grid_row_free(). Its hyperlinks are looked up in 'links'.
+ */
+struct spill;
+struct hyperlinks;
+bool grid_row_spill(struct spill *spill, struct row *row, int cols);
+struct row *grid_row_unspill(
+    const struct spill *spill, size_t idx, struct hyperlinks *links,
+    int *cols);
+
+/*
+ * Moves up to 'max_rows' of the newest spilled rows back into the
+ * ring, in front of its oldest row. When the ring is full, it is
+ * doubled first, provided that doesn't exceed 'max_ring_rows'; the
+ * tracking points are updated accordingly. Rows are truncated, or
+ * padded, to the grid's width; they are not reflowed.
+ *
+ * Returns the number of rows paged in; 0 when there are no spilled
+ * rows, or no room for them.
+ */
+int grid_spill_page_in(
+    struct grid *grid, int screen_rows, struct spill *spill,
+    struct hyperlinks *links, int max_rows, int max_ring_rows, bool compress,
+    size_t tracking_points_count, struct coord *const tracking_points[]);
+
+/* Number of bytes used by the grid's rows and cells */
+size_t grid_memory_usage(const struct grid *grid);
+
+/*
+ * The scrollback ring starts out small, and is grown (doubled) on
+ * demand, up to the size needed to hold 'scrollback_lines' lines.
+ */
+static inline int
+grid_max_rows(int screen_rows, int scrollback_lines)
+{
+    return 1 << (32 - __builtin_clz(screen_rows + scrollback_lines - 1));
+}
+
+int grid_resize_ring_size(
+    const struct grid *grid, int new_cols, int new_screen_rows,
+    int scrollback_lines);
+
+/*
+ * Grows the ring, if scrolling 'rows' lines would recycle scrollback
+ * lines. 'max_bytes' is the memory budget; 0 means no limit.
+ */
+void grid_grow_for_scroll(
+    struct grid *grid, int screen_rows, int rows,
+    int scrollback_lines, size_t max_bytes);
+
 void grid_resize_without_reflow(
     struct grid *grid, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows);
 
+/*
+ * With a large scrollback, only the rows close to the screen (and
+ * the viewport, and the tracking points) are reflowed right away. The
+ * remaining rows are reflowed by grid_reflow_step().
+ *
+ * Large grids are reflowed in chunks, on up to 'thread_count' threads.
+ */
 void grid_resize_and_reflow(
     struct grid *grid, int new_rows, int new_cols,
-    int old_screen_rows, int new_screen_rows,
+    int old_screen_rows, int new_screen_rows, size_t thread_count,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count]);
 
+/*
+ * Reflows (roughly) 'max_rows' of the not-yet-reflowed rows, and
+ * prepends them to the scrollback, optionally compressing them.
+ * Returns false when there are no more rows to reflow.
+ */
+bool grid_reflow_step(struct grid *grid, int max_rows, bool compress);
+bool grid_reflow_is_pending(const struct grid *grid);
+void grid_reflow_discard(struct grid *grid);
+
 /* Convert row numbers between scrollback-relative and absolute coordinates */
 int grid_row_abs_to_sb(const struct grid *grid, int screen_rows, int abs_row);
 int grid_row_sb_to_abs(const struct grid *grid, int screen_rows, int sb_rel_row);
@@ -52,11 +159,14 @@ _grid_row_maybe_alloc(struct grid *grid, int row_no, bool alloc_if_null)
     struct row *row = grid->rows[real_row];
 
     if (row == NULL && alloc_if_null) {
-        row = grid_row_alloc(grid->num_cols, false);
+        row = grid_row_alloc(grid->slab, grid->num_cols, false);
         grid->rows[real_row] = row;
     }
 
     xassert(row != NULL);
+
+    if (unlikely(row->cells == NULL))
+        grid_row_uncompress_abs(grid, real_row);
     return row;
 }
 
@@ -81,21 +191,64 @@ grid_row_in_view(struct grid *grid, int row_no)
     struct row *row = grid->rows[real_row];
 
     xassert(row != NULL);
+
+    if (unlikely(row->cells == NULL))
+        grid_row_uncompress_abs(grid, real_row);
+    return row;
+}
+
+/* Call after writing (non-empty) cells up to, but not including, 'end' */
+static inline void
+grid_row_mark_used(struct row *row, int end)
+{
+    if (end > row->used)
+        row->used = end;
+}
+
+/* Returns the row at the absolute row index 'abs_row', or NULL */
+static inline struct row *
+grid_row_abs(struct grid *grid, int abs_row)
+{
+    struct row *row = grid->rows[abs_row];
+
+    if (unlikely(row != NULL && row->cells == NULL))
+        grid_row_uncompress_abs(grid, abs_row);
     return row;
 }
 
-void grid_row_uri_range_put(
-    struct row *row, int col, const char *uri, uint64_t id);
+/* The ranges take their own references to 'link' */
+void grid_row_uri_range_put(struct row *row, int col, struct hyperlink *link);
+void grid_row_uri_range_put_span(
+    struct row *row, int start, int end, struct hyperlink *link);
 void grid_row_uri_range_erase(struct row *row, int start, int end);
 
 void grid_row_underline_range_put(
     struct row *row, int col, struct underline_range_data data);
+void grid_row_underline_range_put_span(
+    struct row *row, int start, int end, struct underline_range_data data);
 void grid_row_underline_range_erase(struct row *row, int start, int end);
 
+/* Returns the range covering 'col', or NULL. O(log n) */
+const struct row_range *grid_row_range_lookup(
+    const struct row_ranges *ranges, int col);
+
+/*
+ * Range lookups for a (mostly) monotonic column walk, e.g. when
+ * rendering a row. Each lookup continues from where the previous one
+ * stopped, making a full walk O(n) in total.
+ */
+struct row_range_cursor {
+    const struct row_ranges *ranges;  /* May be NULL */
+    int idx;
+};
+
+const struct row_range *grid_row_range_cursor_lookup(
+    struct row_range_cursor *cursor, int col);
+
 static inline void
 grid_row_uri_range_destroy(struct row_range *range)
 {
-    free(range->uri.uri);
+    hyperlink_unref(range->uri.link);
 }
 
 static inline void
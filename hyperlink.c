@@ -0,0 +1,232 @@
+#include "hyperlink.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#define LOG_MODULE "hyperlink"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+#include "xsnprintf.h"
+
+struct hyperlinks {
+    struct hyperlink **buckets;
+    size_t bucket_count;   /* Power of two */
+    size_t count;
+
+    /* Protects the buckets; hyperlinks may be released from the
+     * reflow threads */
+    mtx_t lock;
+};
+
+static uint64_t
+hyperlink_hash(uint64_t id, const char *uri)
+{
+    return sdbm_hash(uri) ^ (id * 0x9e3779b97f4a7c15ull);
+}
+
+struct hyperlinks *
+hyperlinks_init(void)
+{
+    struct hyperlinks *links = xmalloc(sizeof(*links));
+    *links = (struct hyperlinks){
+        .buckets = xcalloc(64, sizeof(links->buckets[0])),
+        .bucket_count = 64,
+    };
+
+    mtx_init(&links->lock, mtx_plain);
+    return links;
+}
+
+void
+hyperlinks_destroy(struct hyperlinks *links)
+{
+    if (links == NULL)
+        return;
+
+    LOG_DBG("%zu hyperlinks left at destruction", links->count);
+
+    for (size_t i = 0; i < links->bucket_count; i++) {
+        struct hyperlink *link = links->buckets[i];
+        while (link != NULL) {
+            struct hyperlink *next = link->next;
+            free(link);
+            link = next;
+        }
+    }
+
+    mtx_destroy(&links->lock);
+    free(links->buckets);
+    free(links);
+}
+
+size_t
+hyperlinks_count(const struct hyperlinks *links)
+{
+    return links->count;
+}
+
+static void
+grow(struct hyperlinks *links)
+{
+    const size_t new_count = links->bucket_count * 2;
+    struct hyperlink **new_buckets = xcalloc(new_count, sizeof(new_buckets[0]));
+
+    for (size_t i = 0; i < links->bucket_count; i++) {
+        struct hyperlink *link = links->buckets[i];
+        while (link != NULL) {
+            struct hyperlink *next = link->next;
+            struct hyperlink **bucket = &new_buckets[link->hash & (new_count - 1)];
+
+            link->next = *bucket;
+            *bucket = link;
+            link = next;
+        }
+    }
+
+    free(links->buckets);
+    links->buckets = new_buckets;
+    links->bucket_count = new_count;
+}
+
+struct hyperlink *
+hyperlink_get(struct hyperlinks *links, uint64_t id, const char *uri)
+{
+    const uint64_t hash = hyperlink_hash(id, uri);
+
+    mtx_lock(&links->lock);
+
+    struct hyperlink **bucket = &links->buckets[hash & (links->bucket_count - 1)];
+
+    for (struct hyperlink *link = *bucket; link != NULL; link = link->next) {
+        if (link->hash != hash || link->id != id || !streq(link->uri, uri))
+            continue;
+
+        /*
+         * Don't resurrect a hyperlink whose last reference has just
+         * been dropped (by another thread); it is about to be
+         * removed, and free:d. Add a new one instead.
+         */
+        size_t refcount = atomic_load(&link->refcount);
+        while (refcount > 0) {
+            if (atomic_compare_exchange_weak(
+                    &link->refcount, &refcount, refcount + 1))
+            {
+                mtx_unlock(&links->lock);
+                return link;
+            }
+        }
+    }
+
+    const size_t len = strlen(uri);
+    struct hyperlink *link = xmalloc(sizeof(*link) + len + 1);
+    link->id = id;
+    atomic_init(&link->refcount, 1);
+    link->hash = hash;
+    link->table = links;
+    memcpy(link->uri, uri, len + 1);
+
+    link->next = *bucket;
+    *bucket = link;
+
+    if (++links->count > links->bucket_count / 4 * 3)
+        grow(links);
+
+    mtx_unlock(&links->lock);
+
+    LOG_DBG("new hyperlink: id=%" PRIu64 ", uri=%s", id, uri);
+    return link;
+}
+
+struct hyperlink *
+hyperlink_ref(struct hyperlink *link)
+{
+    xassert(atomic_load(&link->refcount) > 0);
+    atomic_fetch_add_explicit(&link->refcount, 1, memory_order_relaxed);
+    return link;
+}
+
+void
+hyperlink_unref(struct hyperlink *link)
+{
+    if (link == NULL)
+        return;
+
+    xassert(atomic_load(&link->refcount) > 0);
+    if (atomic_fetch_sub(&link->refcount, 1) > 1)
+        return;
+
+    /* Last reference; no one can find, or reference, it anymore */
+    struct hyperlinks *links = link->table;
+
+    mtx_lock(&links->lock);
+
+    struct hyperlink **prev = &links->buckets[link->hash & (links->bucket_count - 1)];
+    while (*prev != link) {
+        xassert(*prev != NULL);
+        prev = &(*prev)->next;
+    }
+
+    *prev = link->next;
+    links->count--;
+
+    mtx_unlock(&links->lock);
+    free(link);
+}
+
+UNITTEST
+{
+    struct hyperlinks *links = hyperlinks_init();
+
+    struct hyperlink *a = hyperlink_get(links, 1, "http://foo.bar");
+    struct hyperlink *b = hyperlink_get(links, 1, "http://foo.bar");
+    struct hyperlink *c = hyperlink_get(links, 2, "http://foo.bar");
+    struct hyperlink *d = hyperlink_get(links, 1, "http://bar.foo");
+
+    xassert(a == b);
+    xassert(a != c);
+    xassert(a != d);
+    xassert(c != d);
+    xassert(a->id == 1 && streq(a->uri, "http://foo.bar"));
+    xassert(hyperlinks_count(links) == 3);
+
+    hyperlink_unref(b);
+    xassert(hyperlinks_count(links) == 3);
+    hyperlink_unref(a);
+    xassert(hyperlinks_count(links) == 2);
+
+    xassert(hyperlink_ref(c) == c);
+    hyperlink_unref(c);
+    hyperlink_unref(c);
+    hyperlink_unref(d);
+    xassert(hyperlinks_count(links) == 0);
+
+    /* Force the table to grow a couple of times */
+    struct hyperlink *many[1000];
+    for (size_t i = 0; i < ALEN(many); i++) {
+        char uri[32];
+        xsnprintf(uri, sizeof(uri), "http://%zu", i);
+        many[i] = hyperlink_get(links, i % 7, uri);
+    }
+    xassert(hyperlinks_count(links) == ALEN(many));
+
+    for (size_t i = 0; i < ALEN(many); i++) {
+        char uri[32];
+        xsnprintf(uri, sizeof(uri), "http://%zu", i);
+        struct hyperlink *link = hyperlink_get(links, i % 7, uri);
+        xassert(link == many[i]);
+        hyperlink_unref(link);
+    }
+
+    for (size_t i = 0; i < ALEN(many); i++)
+        hyperlink_unref(many[i]);
+    xassert(hyperlinks_count(links) == 0);
+
+    hyperlinks_destroy(links);
+}
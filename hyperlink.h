@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Interned, reference counted, OSC-8 hyperlinks.
+ *
+ * Each unique (id, URI) pair is stored once per table. Row URI ranges
+ * hold a reference to the hyperlink, rather than a copy of the URI,
+ * making copying, splitting and erasing ranges cheap. A hyperlink is
+ * removed from its table, and free:d, when its last reference is
+ * dropped.
+ *
+ * Referencing, and dereferencing, existing hyperlinks is thread
+ * safe. Looking up (creating) hyperlinks is too, but is expected to be
+ * done from the main thread only.
+ */
+struct hyperlinks;
+
+struct hyperlink {
+    uint64_t id;
+
+    /* Private */
+    atomic_size_t refcount;
+    uint64_t hash;
+    struct hyperlink *next;     /* Bucket chain */
+    struct hyperlinks *table;
+
+    char uri[];
+};
+
+struct hyperlinks *hyperlinks_init(void);
+
+/* Frees the table, and any hyperlinks still in it */
+void hyperlinks_destroy(struct hyperlinks *links);
+
+/* Number of (live) hyperlinks in the table */
+size_t hyperlinks_count(const struct hyperlinks *links);
+
+/*
+ * Returns a new reference to the hyperlink matching both 'id' and
+ * 'uri', creating it if it doesn't already exist.
+ */
+struct hyperlink *hyperlink_get(
+    struct hyperlinks *links, uint64_t id, const char *uri);
+
+struct hyperlink *hyperlink_ref(struct hyperlink *link);
+
+/* Drops a reference. 'link' may be NULL */
+void hyperlink_unref(struct hyperlink *link);
@@ -254,6 +254,12 @@ execute_binding(struct seat *seat, struct terminal *term,
             goto pipe_err;
         }
 
+        if (action == BIND_ACTION_PIPE_SCROLLBACK ||
+            action == BIND_ACTION_PIPE_COMMAND_OUTPUT)
+        {
+            term_reflow_finish(term);
+        }
+
         bool success;
         switch (action) {
         case BIND_ACTION_PIPE_SCROLLBACK:
@@ -280,6 +286,8 @@ execute_binding(struct seat *seat, struct terminal *term,
             break;
         }
 
+        term_compress_scrollback(term);
+
         if (!success)
             goto pipe_err;
 
@@ -364,6 +372,8 @@ execute_binding(struct seat *seat, struct terminal *term,
         if (term->grid != &term->normal)
             return false;
 
+        term_reflow_finish(term);
+
         struct grid *grid = term->grid;
         const int sb_start =
             grid_sb_start_ignore_uninitialized(grid, term->rows);
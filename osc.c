@@ -1343,6 +1343,7 @@ osc_dispatch(struct terminal *term)
             LOG_DBG("resetting all colors");
             for (size_t i = 0; i < ALEN(term->colors.table); i++)
                 term->colors.table[i] = term->conf->colors.table[i];
+            term_colors_changed(term);
             term_damage_view(term);
         }
 
@@ -3,6 +3,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -13,6 +16,7 @@
 
 #include "async.h"
 #include "config.h"
+#include "grid.h"
 #include "key-binding.h"
 #include "reaper.h"
 #include "sixel.h"
@@ -25,10 +29,61 @@ static void
 usage(const char *prog_name)
 {
     printf(
-        "Usage: %s stimuli-file1 stimuli-file2 ... stimuli-fileN\n",
+        "Usage: %s [OPTIONS...] stimuli-file1 stimuli-file2 ... stimuli-fileN\n"
+        "\n"
+        "Options:\n"
+        "  -i,--iterations=N        feed each stimuli file N times (1)\n"
+        "  -r,--rows=N              number of terminal rows (67)\n"
+        "  -c,--cols=N              number of terminal columns (135)\n"
+        "  -s,--scrollback=N        number of scrollback lines (16317)\n"
+        "  -C,--compress-after=N    compress scrollback lines N lines above the screen (0=disabled)\n"
+        "  -j,--json                print results as JSON\n"
+        "  -h,--help                show this help and exit\n",
         prog_name);
 }
 
+static bool
+parse_uint(const char *prog_name, const char *opt, const char *s,
+           unsigned min_value, unsigned *value)
+{
+    char *end;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 10);
+
+    if (errno != 0 || *s == '\0' || *end != '\0' || v < min_value || v > INT32_MAX) {
+        fprintf(stderr, "%s: %s: invalid value: %s\n", prog_name, opt, s);
+        return false;
+    }
+
+    *value = v;
+    return true;
+}
+
+struct result {
+    const char *name;
+    uint64_t bytes;
+    unsigned iterations;
+    double seconds;
+    uint64_t cells_written;
+    uint64_t lines_scrolled;
+    size_t grid_bytes;
+};
+
+static void
+print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
 enum async_write_status
 async_write(int fd, const void *data, size_t len, size_t *idx)
 {
@@ -59,6 +114,12 @@ fdm_event_del(struct fdm *fdm, int fd, int events)
     return true;
 }
 
+int
+fdm_pending_events(const struct fdm *fdm)
+{
+    return 0;
+}
+
 bool
 render_resize(
     struct terminal *term, int width, int height, uint8_t resize_options)
@@ -118,11 +179,10 @@ slave_spawn(
     return 0;
 }
 
-int
-render_worker_thread(void *_ctx)
-{
-    return 0;
-}
+bool render_workers_acquire(size_t count) { return true; }
+void render_workers_release(void) {}
+void render_reset_glyph_caches(struct terminal *term) {}
+void render_reset_color_caches(struct terminal *term) {}
 
 struct extraction_context *
 extract_begin(enum selection_kind kind, bool strip_trailing_empty)
@@ -240,16 +300,82 @@ key_binding_unref(struct key_binding_manager *mgr, const struct config *conf)
 }
 
 int
-main(int argc, const char *const *argv)
+main(int argc, char *const *argv)
 {
-    if (argc < 2) {
-        usage(argv[0]);
+    static const struct option longopts[] = {
+        {"iterations", required_argument, NULL, 'i'},
+        {"rows",       required_argument, NULL, 'r'},
+        {"cols",       required_argument, NULL, 'c'},
+        {"scrollback", required_argument, NULL, 's'},
+        {"compress-after", required_argument, NULL, 'C'},
+        {"json",       no_argument,       NULL, 'j'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL,         no_argument,       NULL, 0},
+    };
+
+    const char *const prog_name = argv[0];
+
+    unsigned iterations = 1;
+    unsigned row_count = 67;
+    unsigned col_count = 135;
+    unsigned scrollback_lines = 16384 - 67;
+    unsigned compress_after = 0;
+    bool json = false;
+
+    while (true) {
+        int c = getopt_long(argc, argv, "i:r:c:s:C:jh", longopts, NULL);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'i':
+            if (!parse_uint(prog_name, "iterations", optarg, 1, &iterations))
+                return EXIT_FAILURE;
+            break;
+
+        case 'r':
+            if (!parse_uint(prog_name, "rows", optarg, 1, &row_count))
+                return EXIT_FAILURE;
+            break;
+
+        case 'c':
+            if (!parse_uint(prog_name, "cols", optarg, 1, &col_count))
+                return EXIT_FAILURE;
+            break;
+
+        case 's':
+            if (!parse_uint(prog_name, "scrollback", optarg, 0, &scrollback_lines))
+                return EXIT_FAILURE;
+            break;
+
+        case 'C':
+            if (!parse_uint(prog_name, "compress-after", optarg, 0, &compress_after))
+                return EXIT_FAILURE;
+            break;
+
+        case 'j':
+            json = true;
+            break;
+
+        case 'h':
+            usage(prog_name);
+            return EXIT_SUCCESS;
+
+        case '?':
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(prog_name);
         return EXIT_FAILURE;
     }
 
-    const int row_count = 67;
-    const int col_count = 135;
-    const int grid_row_count = 16384;
+    /* Grid row count must be a power of two */
+    int grid_row_count = 1;
+    while (grid_row_count < (int)(row_count + scrollback_lines))
+        grid_row_count <<= 1;
 
     int lower_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
     if (lower_fd < 0)
@@ -272,9 +398,13 @@ main(int argc, const char *const *argv)
     }
 
     struct config conf = {
+        .scrollback = {
+            .compress_after = compress_after,
+        },
         .tweak = {
             .delayed_render_lower_ns = 500000,         /* 0.5ms */
             .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
+            .ptmx_read_budget_ns = 4000000,            /* 4ms */
         },
     };
 
@@ -326,13 +456,17 @@ main(int argc, const char *const *argv)
             .max_width = SIXEL_MAX_WIDTH,
             .max_height = SIXEL_MAX_HEIGHT,
         },
+        .hyperlinks = hyperlinks_init(),
     };
 
     tll_push_back(wayl.terms, &term);
 
     int ret = EXIT_FAILURE;
 
-    for (int i = 1; i < argc; i++) {
+    const size_t file_count = argc - optind;
+    struct result *results = calloc(file_count, sizeof(results[0]));
+
+    for (int i = optind; i < argc; i++) {
         struct stat st;
         if (stat(argv[i], &st) < 0) {
             fprintf(stderr, "error: %s: failed to stat: %s\n",
@@ -347,7 +481,7 @@ main(int argc, const char *const *argv)
             goto out;
         }
 
-        int fd = open(argv[1], O_RDONLY);
+        int fd = open(argv[i], O_RDONLY);
         if (fd < 0) {
             fprintf(stderr, "error: %s: failed to open: %s\n",
                     argv[i], strerror(errno));
@@ -387,24 +521,91 @@ main(int argc, const char *const *argv)
         free(data);
 
         term.ptmx = mem_fd;
-        lseek(mem_fd, 0, SEEK_SET);
 
-        printf("Feeding VT parser with %s (%lld bytes)\n",
-               argv[i], (long long)st.st_size);
+        if (!json) {
+            printf("Feeding VT parser with %s (%lld bytes, %u iteration%s)\n",
+                   argv[i], (long long)st.st_size, iterations,
+                   iterations == 1 ? "" : "s");
+        }
+
+        const uint64_t cells_written = term.stats.cells_written;
+        const uint64_t lines_scrolled = term.stats.lines_scrolled;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
 
-        while (lseek(mem_fd, 0, SEEK_CUR) < st.st_size) {
-            if (!fdm_ptmx(NULL, -1, EPOLLIN, &term)) {
-                fprintf(stderr, "error: fdm_ptmx() failed\n");
-                close(mem_fd);
-                goto out;
+        for (unsigned j = 0; j < iterations; j++) {
+            lseek(mem_fd, 0, SEEK_SET);
+
+            while (lseek(mem_fd, 0, SEEK_CUR) < st.st_size) {
+                if (!fdm_ptmx(NULL, -1, EPOLLIN, &term)) {
+                    fprintf(stderr, "error: fdm_ptmx() failed\n");
+                    close(mem_fd);
+                    goto out;
+                }
             }
         }
+
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
         close(mem_fd);
+
+        struct result *res = &results[i - optind];
+        *res = (struct result){
+            .name = argv[i],
+            .bytes = (uint64_t)st.st_size * iterations,
+            .iterations = iterations,
+            .seconds = (stop.tv_sec - start.tv_sec) +
+                       (stop.tv_nsec - start.tv_nsec) / 1e9,
+            .cells_written = term.stats.cells_written - cells_written,
+            .lines_scrolled = term.stats.lines_scrolled - lines_scrolled,
+            .grid_bytes = grid_memory_usage(&term.normal),
+        };
+
+        if (!json) {
+            printf("  %.2f MB/s, %.3f ns/byte, "
+                   "%"PRIu64" cells written, %"PRIu64" lines scrolled, "
+                   "%.1f MB grid\n",
+                   res->bytes / res->seconds / 1e6,
+                   res->seconds * 1e9 / res->bytes,
+                   res->cells_written, res->lines_scrolled,
+                   res->grid_bytes / 1e6);
+        }
+    }
+
+    if (json) {
+        printf("{\n"
+               "  \"rows\": %u,\n"
+               "  \"cols\": %u,\n"
+               "  \"scrollback\": %u,\n"
+               "  \"compress_after\": %u,\n"
+               "  \"workloads\": [\n",
+               row_count, col_count, scrollback_lines, compress_after);
+
+        for (size_t i = 0; i < file_count; i++) {
+            const struct result *res = &results[i];
+
+            printf("    {\"name\": ");
+            print_json_string(res->name);
+            printf(", \"bytes\": %"PRIu64", \"iterations\": %u, "
+                   "\"seconds\": %.6f, \"mb_per_s\": %.3f, "
+                   "\"ns_per_byte\": %.4f, \"cells_written\": %"PRIu64", "
+                   "\"lines_scrolled\": %"PRIu64", \"grid_bytes\": %zu}%s\n",
+                   res->bytes, res->iterations, res->seconds,
+                   res->seconds > 0 ? res->bytes / res->seconds / 1e6 : 0.,
+                   res->bytes > 0 ? res->seconds * 1e9 / res->bytes : 0.,
+                   res->cells_written, res->lines_scrolled, res->grid_bytes,
+                   i + 1 < file_count ? "," : "");
+        }
+
+        printf("  ]\n"
+               "}\n");
     }
 
     ret = EXIT_SUCCESS;
 
 out:
+    free(results);
     tll_free(wayl.terms);
 
     for (int i = 0; i < grid_row_count; i++) {
@@ -419,6 +620,7 @@ out:
 
     free(normal_rows);
     free(alt_rows);
+    hyperlinks_destroy(term.hyperlinks);
     close(lower_fd);
     close(upper_fd);
     return ret;
@@ -9,6 +9,8 @@
 #include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <threads.h>
 
 #include "macros.h"
 #if HAS_INCLUDE(<pthread_np.h>)
@@ -45,11 +47,36 @@
 
 #define TIME_SCROLL_DAMAGE 0
 
+/* Minimum number of dirty rows per woken up render worker */
+#define RENDER_WORKER_MIN_ROWS 4
+
 struct renderer {
     struct fdm *fdm;
     struct wayland *wayl;
 };
 
+/*
+ * Render worker threads, shared by all terminals in the process (i.e.
+ * all windows, in server mode). Idle terminals don't cost any threads.
+ *
+ * Frames are only submitted from the main thread, which waits for
+ * them to finish. Thus, there's never more than one frame in flight.
+ */
+static struct {
+    size_t ref_count;     /* Terminals using the pool */
+    size_t count;         /* Threads */
+    thrd_t *threads;
+    sem_t start;
+    sem_t done;
+    bool quit;
+
+    struct {
+        struct terminal *term;
+        int slot_count;
+        atomic_int next_slot;
+    } frame;
+} worker_pool = {0};
+
 static struct {
     size_t total;
     size_t zero;  /* commits presented in less than one frame interval */
@@ -303,6 +330,143 @@ color_brighten(const struct terminal *term, uint32_t color)
     return hsl_to_rgb(hue, sat, min(lum, 100));
 }
 
+enum {
+    COLOR_VARIANT_DIM = 1 << 0,
+    COLOR_VARIANT_BRIGHT = 1 << 1,
+    COLOR_VARIANT_BLINK_OFF = 1 << 2,
+};
+
+/* Color cache keys; 0-255 are palette indices */
+enum {
+    COLOR_IDX_RGB = -1,
+    COLOR_IDX_FG = 256,
+    COLOR_IDX_BG = 257,
+    COLOR_IDX_COUNT,
+};
+
+static uint32_t
+color_resolve(const struct terminal *term, uint32_t color, unsigned variant)
+{
+    if (variant & COLOR_VARIANT_DIM)
+        color = color_dim(term, color);
+    if (variant & COLOR_VARIANT_BRIGHT)
+        color = color_brighten(term, color);
+    if (variant & COLOR_VARIANT_BLINK_OFF)
+        color = color_decrease_luminance(color);
+    return color;
+}
+
+struct color_cache_entry {
+    pixman_color_t color;
+    pixman_image_t *fill;   /* Solid fill source; created on demand */
+    bool valid;
+};
+
+/*
+ * Resolved colors, one cache per render thread.
+ *
+ * Palette colors (including the default foreground and background)
+ * are cached in all their dim/bright variants. Everything else (RGB
+ * colors, and blinking text) goes into a small LRU.
+ *
+ * Both are dropped as soon as the terminal's colors change, i.e. when
+ * term->render.color_generation no longer matches.
+ */
+struct color_cache {
+    uint64_t generation;
+
+    /* Indexed by variant (dim/bright only), and palette index */
+    struct color_cache_entry palette[4][COLOR_IDX_COUNT];
+
+    struct {
+        struct color_cache_entry entry;
+        uint32_t rgb;
+        unsigned variant;
+        uint64_t last_used;   /* 0 - unused */
+    } lru[16];
+    uint64_t clock;
+};
+
+static void
+color_cache_entry_clear(struct color_cache_entry *entry)
+{
+    if (entry->fill != NULL)
+        pixman_image_unref(entry->fill);
+    *entry = (struct color_cache_entry){0};
+}
+
+static void
+color_cache_clear(struct color_cache *cache)
+{
+    for (size_t v = 0; v < ALEN(cache->palette); v++) {
+        for (size_t i = 0; i < ALEN(cache->palette[v]); i++)
+            color_cache_entry_clear(&cache->palette[v][i]);
+    }
+
+    for (size_t i = 0; i < ALEN(cache->lru); i++) {
+        color_cache_entry_clear(&cache->lru[i].entry);
+        cache->lru[i].last_used = 0;
+    }
+
+    cache->clock = 0;
+}
+
+/*
+ * Returns the resolved color. 'rgb' is the unresolved color, i.e. the
+ * palette color when 'idx' is a palette index.
+ *
+ * The returned entry is valid until the next RGB (or blinking)
+ * lookup; palette lookups never evict anything.
+ */
+static struct color_cache_entry *
+color_cache_get(struct color_cache *cache, const struct terminal *term,
+                int idx, uint32_t rgb, unsigned variant)
+{
+    struct color_cache_entry *entry = NULL;
+
+    if (idx != COLOR_IDX_RGB && !(variant & COLOR_VARIANT_BLINK_OFF)) {
+        xassert(idx >= 0 && idx < COLOR_IDX_COUNT);
+        xassert(variant < ALEN(cache->palette));
+        entry = &cache->palette[variant][idx];
+    } else {
+        size_t lru_idx = 0;
+
+        for (size_t i = 0; i < ALEN(cache->lru); i++) {
+            if (cache->lru[i].last_used > 0 &&
+                cache->lru[i].rgb == rgb &&
+                cache->lru[i].variant == variant)
+            {
+                cache->lru[i].last_used = ++cache->clock;
+                return &cache->lru[i].entry;
+            }
+
+            if (cache->lru[i].last_used < cache->lru[lru_idx].last_used)
+                lru_idx = i;
+        }
+
+        color_cache_entry_clear(&cache->lru[lru_idx].entry);
+        cache->lru[lru_idx].rgb = rgb;
+        cache->lru[lru_idx].variant = variant;
+        cache->lru[lru_idx].last_used = ++cache->clock;
+        entry = &cache->lru[lru_idx].entry;
+    }
+
+    if (likely(entry->valid))
+        return entry;
+
+    entry->color = color_hex_to_pixman(color_resolve(term, rgb, variant));
+    entry->valid = true;
+    return entry;
+}
+
+static pixman_image_t *
+color_cache_fill(struct color_cache_entry *entry)
+{
+    if (unlikely(entry->fill == NULL))
+        entry->fill = pixman_image_create_solid_fill(&entry->color);
+    return entry->fill;
+}
+
 static void
 draw_hollow_block(const struct terminal *term, pixman_image_t *pix,
                   const pixman_color_t *color, int x, int y, int cell_cols)
@@ -645,9 +809,252 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
     }
 }
 
+/*
+ * Deferred, batched, drawing of a row's cells.
+ *
+ * Adjacent cells with identical background are filled with a single
+ * rectangle, and added to the damage region as a single box. Glyphs
+ * sharing foreground color are composited together, with a single
+ * pixman call, instead of one call (and clip region) per cell.
+ *
+ * Only cells drawn completely within their own bounds, without a
+ * cursor or any decorations, are batched. Their glyphs aren't affected
+ * by the per-cell clip region, and nothing they draw overlaps other
+ * cells. The exception is overflowing glyphs, before which the batch
+ * is flushed.
+ */
+struct row_batch {
+    int y;
+
+    /* Adjacent cells, same background color */
+    struct {
+        pixman_color_t color;
+        int x_start;
+        int x_end;   /* Empty span when equal to x_start */
+    } bg;
+
+    /* Same foreground color */
+    struct {
+        pixman_glyph_cache_t *cache;  /* Frozen; NULL disables glyph runs */
+        pixman_color_t color;
+        pixman_image_t *src;          /* Solid fill, in 'color' */
+        int x_start;
+        int x_end;
+        size_t count;
+        pixman_glyph_t *v;
+    } glyphs;
+};
+
+static pixman_glyph_cache_t *
+render_glyph_cache(struct terminal *term, int thread_id)
+{
+    pixman_glyph_cache_t **cache = &term->render.glyph_caches[thread_id];
+
+    if (unlikely(*cache == NULL)) {
+        *cache = pixman_glyph_cache_create();
+        if (*cache == NULL)
+            LOG_ERR("failed to create glyph cache");
+    }
+
+    return *cache;
+}
+
+static struct color_cache *
+render_color_cache(struct terminal *term, int thread_id)
+{
+    struct color_cache **cache = &term->render.color_caches[thread_id];
+
+    if (unlikely(*cache == NULL)) {
+        *cache = xcalloc(1, sizeof(**cache));
+        (*cache)->generation = term->render.color_generation;
+    }
+
+    else if (unlikely((*cache)->generation != term->render.color_generation)) {
+        color_cache_clear(*cache);
+        (*cache)->generation = term->render.color_generation;
+    }
+
+    return *cache;
+}
+
+void
+render_reset_color_caches(struct terminal *term)
+{
+    if (term->render.color_caches == NULL)
+        return;
+
+    for (size_t i = 0; i < 1 + term->render.workers.count; i++) {
+        if (term->render.color_caches[i] != NULL) {
+            color_cache_clear(term->render.color_caches[i]);
+            free(term->render.color_caches[i]);
+        }
+        term->render.color_caches[i] = NULL;
+    }
+}
+
+void
+render_reset_glyph_caches(struct terminal *term)
+{
+    if (term->render.glyph_caches == NULL)
+        return;
+
+    /* Keyed by fcft glyph pointers; re-created on demand */
+    for (size_t i = 0; i < 1 + term->render.workers.count; i++) {
+        if (term->render.glyph_caches[i] != NULL)
+            pixman_glyph_cache_destroy(term->render.glyph_caches[i]);
+        term->render.glyph_caches[i] = NULL;
+    }
+}
+
+static inline bool
+pixman_color_equal(const pixman_color_t *a, const pixman_color_t *b)
+{
+    return a->red == b->red && a->green == b->green &&
+           a->blue == b->blue && a->alpha == b->alpha;
+}
+
+static void
+row_batch_flush_bg(const struct terminal *term, pixman_image_t *pix,
+                   pixman_region32_t *damage, struct row_batch *batch)
+{
+    const int x = batch->bg.x_start;
+    const int width = batch->bg.x_end - x;
+
+    if (width == 0)
+        return;
+
+    pixman_image_fill_rectangles(
+        PIXMAN_OP_SRC, pix, &batch->bg.color, 1,
+        &(pixman_rectangle16_t){x, batch->y, width, term->cell_height});
+
+    if (damage != NULL) {
+        pixman_region32_union_rect(
+            damage, damage, x, batch->y, width, term->cell_height);
+    }
+
+    batch->bg.x_end = batch->bg.x_start;
+}
+
+static void
+row_batch_flush(const struct terminal *term, pixman_image_t *pix,
+                pixman_region32_t *damage, struct row_batch *batch)
+{
+    /* Glyphs are drawn on top of the background */
+    row_batch_flush_bg(term, pix, damage, batch);
+
+    if (batch->glyphs.count == 0)
+        return;
+
+    /* Vertically, glyphs are clipped to the cell, just like in
+     * render_cell() */
+    pixman_region32_t clip;
+    pixman_region32_init_rect(
+        &clip, batch->glyphs.x_start, batch->y,
+        batch->glyphs.x_end - batch->glyphs.x_start, term->cell_height);
+    pixman_image_set_clip_region32(pix, &clip);
+    pixman_region32_fini(&clip);
+
+    pixman_composite_glyphs_no_mask(
+        PIXMAN_OP_OVER, batch->glyphs.src, pix, 0, 0, 0, 0,
+        batch->glyphs.cache, batch->glyphs.count, batch->glyphs.v);
+    pixman_image_unref(batch->glyphs.src);
+    batch->glyphs.src = NULL;
+
+    pixman_image_set_clip_region32(pix, NULL);
+    batch->glyphs.count = 0;
+}
+
+/*
+ * Returns the cached (pixman) glyph, or NULL if the glyph cannot be
+ * batched.
+ */
+static const void *
+row_batch_glyph(const struct terminal *term, struct row_batch *batch,
+                const struct fcft_font *font, const struct fcft_glyph *glyph,
+                int cell_cols)
+{
+    if (batch->glyphs.cache == NULL)
+        return NULL;
+
+    /* Color glyphs (emojis), and subpixel antialiased glyphs, would
+     * lose their component alpha in the glyph cache */
+    if (PIXMAN_FORMAT_TYPE(pixman_image_get_format(glyph->pix)) != PIXMAN_TYPE_A)
+        return NULL;
+
+    const int x_ofs = term->font_x_ofs + glyph->x;
+    if (x_ofs < 0 || x_ofs + glyph->width > cell_cols * term->cell_width)
+        return NULL;
+
+    const void *cached = pixman_glyph_cache_lookup(
+        batch->glyphs.cache, (void *)font, (void *)glyph);
+
+    if (cached == NULL) {
+        cached = pixman_glyph_cache_insert(
+            batch->glyphs.cache, (void *)font, (void *)glyph,
+            -glyph->x, glyph->y, glyph->pix);
+    }
+
+    return cached;
+}
+
+/*
+ * Columns are walked right-to-left; cells are added in that order.
+ *
+ * 'fg_src' is an (optional) solid fill source in the 'fg' color.
+ */
+static void
+row_batch_add(const struct terminal *term, pixman_image_t *pix,
+              pixman_region32_t *damage, struct row_batch *batch,
+              int x, int cell_cols,
+              const pixman_color_t *bg, const pixman_color_t *fg,
+              pixman_image_t *fg_src, const void *glyph)
+{
+    const int x_end = x + cell_cols * term->cell_width;
+
+    if (batch->bg.x_end > batch->bg.x_start &&
+        (batch->bg.x_start != x_end ||
+         !pixman_color_equal(&batch->bg.color, bg)))
+    {
+        row_batch_flush_bg(term, pix, damage, batch);
+    }
+
+    if (batch->bg.x_end == batch->bg.x_start) {
+        batch->bg.color = *bg;
+        batch->bg.x_end = x_end;
+    }
+    batch->bg.x_start = x;
+
+    if (glyph == NULL)
+        return;
+
+    if (batch->glyphs.count > 0 &&
+        !pixman_color_equal(&batch->glyphs.color, fg))
+    {
+        row_batch_flush(term, pix, damage, batch);
+    }
+
+    if (batch->glyphs.count == 0) {
+        batch->glyphs.color = *fg;
+        batch->glyphs.src = fg_src != NULL
+            ? pixman_image_ref(fg_src)
+            : pixman_image_create_solid_fill(fg);
+        batch->glyphs.x_end = x_end;
+    }
+
+    batch->glyphs.x_start = x;
+    xassert(batch->glyphs.count < term->cols);
+    batch->glyphs.v[batch->glyphs.count++] = (pixman_glyph_t){
+        .x = x + term->font_x_ofs,
+        .y = batch->y + term->font_baseline,
+        .glyph = glyph,
+    };
+}
+
 static int
 render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damage,
-            struct row *row, int row_no, int col, bool has_cursor)
+            struct row *row, int row_no, int col, bool has_cursor,
+            struct row_range_cursor *underlines, struct row_batch *batch,
+            struct color_cache *colors)
 {
     struct cell *cell = &row->cells[col];
     if (cell->attrs.clean)
@@ -665,6 +1072,8 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
 
     uint32_t _fg = 0;
     uint32_t _bg = 0;
+    int fg_idx = COLOR_IDX_RGB;
+    int bg_idx = COLOR_IDX_RGB;
 
     uint16_t alpha = 0xffff;
 
@@ -682,10 +1091,12 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         case COLOR_BASE256:
             xassert(cell->attrs.fg < ALEN(term->colors.table));
             _fg = term->colors.table[cell->attrs.fg];
+            fg_idx = cell->attrs.fg;
             break;
 
         case COLOR_DEFAULT:
             _fg = term->reverse ? term->colors.bg : term->colors.fg;
+            fg_idx = term->reverse ? COLOR_IDX_BG : COLOR_IDX_FG;
             break;
         }
 
@@ -698,10 +1109,12 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         case COLOR_BASE256:
             xassert(cell->attrs.bg < ALEN(term->colors.table));
             _bg = term->colors.table[cell->attrs.bg];
+            bg_idx = cell->attrs.bg;
             break;
 
         case COLOR_DEFAULT:
             _bg = term->reverse ? term->colors.fg : term->colors.bg;
+            bg_idx = term->reverse ? COLOR_IDX_FG : COLOR_IDX_BG;
             break;
         }
 
@@ -709,6 +1122,10 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
             uint32_t swap = _fg;
             _fg = _bg;
             _bg = swap;
+
+            int swap_idx = fg_idx;
+            fg_idx = bg_idx;
+            bg_idx = swap_idx;
         }
 
         else if (cell->attrs.bg_src == COLOR_DEFAULT) {
@@ -755,19 +1172,34 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
     if (unlikely(is_selected && _fg == _bg)) {
         /* Invert bg when selected/highlighted text has same fg/bg */
         _bg = ~_bg;
+        bg_idx = COLOR_IDX_RGB;
         alpha = 0xffff;
     }
 
+    unsigned fg_variant = 0;
     if (cell->attrs.dim)
-        _fg = color_dim(term, _fg);
+        fg_variant |= COLOR_VARIANT_DIM;
     if (term->conf->bold_in_bright.enabled && cell->attrs.bold)
-        _fg = color_brighten(term, _fg);
-
+        fg_variant |= COLOR_VARIANT_BRIGHT;
     if (cell->attrs.blink && term->blink.state == BLINK_OFF)
-        _fg = color_decrease_luminance(_fg);
+        fg_variant |= COLOR_VARIANT_BLINK_OFF;
 
-    pixman_color_t fg = color_hex_to_pixman(_fg);
-    pixman_color_t bg = color_hex_to_pixman_with_alpha(_bg, alpha);
+    pixman_color_t fg;
+    pixman_color_t bg;
+    struct color_cache_entry *fg_entry = NULL;
+
+    if (colors != NULL) {
+        /* Background first; fg_entry must be the last lookup */
+        bg = bg_idx != COLOR_IDX_RGB && alpha == 0xffff
+            ? color_cache_get(colors, term, bg_idx, _bg, 0)->color
+            : color_hex_to_pixman_with_alpha(_bg, alpha);
+
+        fg_entry = color_cache_get(colors, term, fg_idx, _fg, fg_variant);
+        fg = fg_entry->color;
+    } else {
+        fg = color_hex_to_pixman(color_resolve(term, _fg, fg_variant));
+        bg = color_hex_to_pixman_with_alpha(_bg, alpha);
+    }
 
     struct fcft_font *font = attrs_to_font(term, &cell->attrs);
     const struct composed *composed = NULL;
@@ -908,23 +1340,58 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         }
     }
 
-    pixman_region32_t clip;
-    pixman_region32_init_rect(
-        &clip, x, y,
-        render_width, term->cell_height);
-    pixman_image_set_clip_region32(pix, &clip);
+    const bool no_glyph =
+        cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == U'\t' ||
+        (unlikely(cell->attrs.conceal) && !is_selected);
 
-    if (damage != NULL) {
-        pixman_region32_union_rect(
-            damage, damage, x, y, render_width, term->cell_height);
+    bool batched = false;
+    const void *batch_glyph = NULL;
+
+    if (batch != NULL && !has_cursor &&
+        render_width == cell_cols * width &&
+        !cell->attrs.underline && !cell->attrs.strikethrough &&
+        !cell->attrs.url)
+    {
+        if (no_glyph || glyph_count == 0)
+            batched = true;
+        else if (glyph_count == 1 && composed == NULL && glyphs[0] != NULL) {
+            batch_glyph = row_batch_glyph(term, batch, font, glyphs[0], cell_cols);
+            batched = batch_glyph != NULL;
+        }
     }
 
-    pixman_region32_fini(&clip);
+    if (batched) {
+        pixman_image_t *fg_src = batch_glyph != NULL && fg_entry != NULL
+            ? color_cache_fill(fg_entry) : NULL;
 
-    /* Background */
-    pixman_image_fill_rectangles(
-        PIXMAN_OP_SRC, pix, &bg, 1,
-        &(pixman_rectangle16_t){x, y, cell_cols * width, height});
+        row_batch_add(
+            term, pix, damage, batch, x, cell_cols, &bg, &fg, fg_src,
+            batch_glyph);
+    } else {
+        if (batch != NULL && render_width > cell_cols * width) {
+            /* Overflowing glyph; must be drawn on top of the cells
+             * to our right */
+            row_batch_flush(term, pix, damage, batch);
+        }
+
+        pixman_region32_t clip;
+        pixman_region32_init_rect(
+            &clip, x, y,
+            render_width, term->cell_height);
+        pixman_image_set_clip_region32(pix, &clip);
+
+        if (damage != NULL) {
+            pixman_region32_union_rect(
+                damage, damage, x, y, render_width, term->cell_height);
+        }
+
+        pixman_region32_fini(&clip);
+
+        /* Background */
+        pixman_image_fill_rectangles(
+            PIXMAN_OP_SRC, pix, &bg, 1,
+            &(pixman_rectangle16_t){x, y, cell_cols * width, height});
+    }
 
     if (cell->attrs.blink && term->blink.fd < 0) {
         /* TODO: use a custom lock for this? */
@@ -933,16 +1400,19 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         mtx_unlock(&term->render.workers.lock);
     }
 
+    if (batched)
+        return cell_cols;
+
     if (unlikely(has_cursor && term->cursor_style == CURSOR_BLOCK && term->kbd_focus))
         draw_cursor(term, cell, font, pix, &fg, &bg, x, y, cell_cols);
 
-    if (cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == U'\t' ||
-        (unlikely(cell->attrs.conceal) && !is_selected))
-    {
+    if (no_glyph)
         goto draw_cursor;
-    }
 
-    pixman_image_t *clr_pix = pixman_image_create_solid_fill(&fg);
+    /* The cursor may have changed the foreground color */
+    pixman_image_t *clr_pix = fg_entry != NULL && !has_cursor
+        ? pixman_image_ref(color_cache_fill(fg_entry))
+        : pixman_image_create_solid_fill(&fg);
 
     int pen_x = x;
     for (unsigned i = 0; i < glyph_count; i++) {
@@ -1025,39 +1495,35 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         pixman_color_t underline_color = fg;
         enum underline_style underline_style = UNDERLINE_SINGLE;
 
-        /* Check if cell has a styled underline. This lookup is fairly
-           expensive... */
+        /* Check if cell has a styled underline */
+        const struct row_range *range = NULL;
         if (row->extra != NULL) {
-            for (int i = 0; i < row->extra->underline_ranges.count; i++) {
-                const struct row_range *range = &row->extra->underline_ranges.v[i];
-
-                if (range->start > col)
-                    break;
-
-                if (range->start <= col && col <= range->end) {
-                    switch (range->underline.color_src) {
-                    case COLOR_BASE256:
-                        underline_color = color_hex_to_pixman(
-                            term->colors.table[range->underline.color]);
-                        break;
+            range = underlines != NULL
+                ? grid_row_range_cursor_lookup(underlines, col)
+                : grid_row_range_lookup(&row->extra->underline_ranges, col);
+        }
 
-                    case COLOR_RGB:
-                        underline_color =
-                            color_hex_to_pixman(range->underline.color);
-                        break;
+        if (range != NULL) {
+            switch (range->underline.color_src) {
+            case COLOR_BASE256:
+                underline_color = color_hex_to_pixman(
+                    term->colors.table[range->underline.color]);
+                break;
 
-                    case COLOR_DEFAULT:
-                        break;
+            case COLOR_RGB:
+                underline_color =
+                    color_hex_to_pixman(range->underline.color);
+                break;
 
-                    case COLOR_BASE16:
-                        BUG("underline color can't be base-16");
-                        break;
-                    }
+            case COLOR_DEFAULT:
+                break;
 
-                    underline_style = range->underline.style;
-                    break;
-                }
+            case COLOR_BASE16:
+                BUG("underline color can't be base-16");
+                break;
             }
+
+            underline_style = range->underline.style;
         }
 
         draw_styled_underline(
@@ -1085,12 +1551,42 @@ draw_cursor:
     return cell_cols;
 }
 
+/*
+ * 'glyph_buf' must have room for term->cols glyphs; each render
+ * thread has its own (see render_resize())
+ */
 static void
 render_row(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damage,
-           struct row *row, int row_no, int cursor_col)
+           struct row *row, int row_no, int cursor_col,
+           pixman_glyph_cache_t *glyph_cache, struct color_cache *colors,
+           pixman_glyph_t *glyph_buf)
 {
-    for (int col = term->cols - 1; col >= 0; col--)
-        render_cell(term, pix, damage, row, row_no, col, cursor_col == col);
+    /* Columns are walked right-to-left */
+    struct row_range_cursor underlines = {
+        .ranges = row->extra != NULL ? &row->extra->underline_ranges : NULL,
+        .idx = row->extra != NULL ? row->extra->underline_ranges.count - 1 : 0,
+    };
+
+    struct row_batch batch = {
+        .y = term->margins.top + row_no * term->cell_height,
+        .glyphs = {
+            .cache = glyph_cache,
+            .v = glyph_buf,
+        },
+    };
+
+    if (glyph_cache != NULL)
+        pixman_glyph_cache_freeze(glyph_cache);
+
+    for (int col = term->cols - 1; col >= 0; col--) {
+        render_cell(term, pix, damage, row, row_no, col, cursor_col == col,
+                    &underlines, &batch, colors);
+    }
+
+    row_batch_flush(term, pix, damage, &batch);
+
+    if (glyph_cache != NULL)
+        pixman_glyph_cache_thaw(glyph_cache);
 }
 
 static void
@@ -1496,7 +1992,7 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
         }
 
         /* Is the row dirty? */
-        struct row *row = term->grid->rows[abs_row_no];
+        struct row *row = grid_row_abs(term->grid, abs_row_no);
         xassert(row != NULL);  /* Should be visible */
 
         if (!row->dirty) {
@@ -1522,7 +2018,10 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
          */
         if (!sixel->opaque) {
             /* TODO: multithreading */
-            render_row(term, pix, damage, row, term_row_no, cursor_col);
+            render_row(term, pix, damage, row, term_row_no, cursor_col,
+                       render_glyph_cache(term, 0),
+                       render_color_cache(term, 0),
+                       term->render.glyph_bufs[0]);
         } else {
             for (int col = sixel->pos.col;
                  col < min(sixel->pos.col + sixel->cols, term->cols);
@@ -1537,7 +2036,8 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
                     if ((last_row_needs_erase && last_row) ||
                         (last_col_needs_erase && last_col))
                     {
-                        render_cell(term, pix, damage, row, term_row_no, col, cursor_col == col);
+                        render_cell(term, pix, damage, row, term_row_no, col,
+                                    cursor_col == col, NULL, NULL, NULL);
                     } else {
                         cell->attrs.clean = 1;
                         cell->attrs.confined = 1;
@@ -1709,7 +2209,7 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
             break;
 
         row->cells[col_idx + i] = *cell;
-        render_cell(term, buf->pix[0], NULL, row, row_idx, col_idx + i, false);
+        render_cell(term, buf->pix[0], NULL, row, row_idx, col_idx + i, false, NULL, NULL, NULL);
     }
 
     int start = seat->ime.preedit.cursor.start - ime_ofs;
@@ -2057,74 +2557,178 @@ render_overlay(struct terminal *term)
     term->render.last_overlay_style = style;
 }
 
-int
-render_worker_thread(void *_ctx)
+/*
+ * Renders rows from the terminal's queue, one at a time, until the
+ * queue is empty.
+ */
+static void
+render_worker_frame(struct terminal *term, int my_id)
 {
-    struct render_worker_context *ctx = _ctx;
-    struct terminal *term = ctx->term;
-    const int my_id = ctx->my_id;
-    free(ctx);
+    struct buffer *buf = term->render.workers.buf;
+    mtx_t *lock = &term->render.workers.lock;
+    xassert(buf != NULL);
+
+    /* Translate offset-relative cursor row to view-relative */
+    struct coord cursor = {-1, -1};
+    if (!term->hide_cursor) {
+        cursor = term->grid->cursor.point;
+        cursor.row += term->grid->offset;
+        cursor.row -= term->grid->view;
+        cursor.row &= term->grid->num_rows - 1;
+    }
+
+    while (true) {
+        mtx_lock(lock);
+        if (tll_length(term->render.workers.queue) == 0) {
+            mtx_unlock(lock);
+            break;
+        }
+
+        int row_no = tll_pop_front(term->render.workers.queue);
+        mtx_unlock(lock);
+
+        struct row *row = grid_row_in_view(term->grid, row_no);
+        int cursor_col = cursor.row == row_no ? cursor.col : -1;
+
+        render_row(term, buf->pix[my_id], &buf->dirty[my_id],
+                   row, row_no, cursor_col,
+                   render_glyph_cache(term, my_id),
+                   render_color_cache(term, my_id),
+                   term->render.glyph_bufs[my_id]);
+    }
+}
+
+static int
+render_worker_thread(void *data)
+{
+    const int thread_no = (int)(uintptr_t)data;
 
     sigset_t mask;
     sigfillset(&mask);
     pthread_sigmask(SIG_SETMASK, &mask, NULL);
 
     char proc_title[16];
-    snprintf(proc_title, sizeof(proc_title), "foot:render:%d", my_id);
+    snprintf(proc_title, sizeof(proc_title), "foot:render:%d", thread_no);
 
     if (pthread_setname_np(pthread_self(), proc_title) < 0)
-        LOG_ERRNO("render worker %d: failed to set process title", my_id);
-
-    sem_t *start = &term->render.workers.start;
-    sem_t *done = &term->render.workers.done;
-    mtx_t *lock = &term->render.workers.lock;
+        LOG_ERRNO("render worker %d: failed to set process title", thread_no);
 
     while (true) {
-        sem_wait(start);
-
-        struct buffer *buf = term->render.workers.buf;
-        bool frame_done = false;
-
-        /* Translate offset-relative cursor row to view-relative */
-        struct coord cursor = {-1, -1};
-        if (!term->hide_cursor) {
-            cursor = term->grid->cursor.point;
-            cursor.row += term->grid->offset;
-            cursor.row -= term->grid->view;
-            cursor.row &= term->grid->num_rows - 1;
+        sem_wait(&worker_pool.start);
+
+        if (worker_pool.quit)
+            return 0;
+
+        /*
+         * Slots (not threads) index the terminal's per-thread
+         * buffers and caches; each slot is handed out once per frame
+         */
+        struct terminal *term = worker_pool.frame.term;
+        const int my_id = 1 + atomic_fetch_add_explicit(
+            &worker_pool.frame.next_slot, 1, memory_order_relaxed);
+
+        xassert(my_id <= worker_pool.frame.slot_count);
+        render_worker_frame(term, my_id);
+
+        sem_post(&worker_pool.done);
+    }
+
+    return -1;
+}
+
+bool
+render_workers_acquire(size_t count)
+{
+    if (worker_pool.ref_count == 0) {
+        xassert(worker_pool.count == 0);
+
+        if (sem_init(&worker_pool.start, 0, 0) < 0 ||
+            sem_init(&worker_pool.done, 0, 0) < 0)
+        {
+            LOG_ERRNO("failed to instantiate render worker semaphores");
+            return false;
         }
 
-        while (!frame_done) {
-            mtx_lock(lock);
-            xassert(tll_length(term->render.workers.queue) > 0);
+        worker_pool.quit = false;
+    }
 
-            int row_no = tll_pop_front(term->render.workers.queue);
-            mtx_unlock(lock);
+    worker_pool.ref_count++;
 
-            switch (row_no) {
-            default: {
-                xassert(buf != NULL);
+    if (count <= worker_pool.count)
+        return true;
 
-                struct row *row = grid_row_in_view(term->grid, row_no);
-                int cursor_col = cursor.row == row_no ? cursor.col : -1;
+    LOG_INFO("growing render worker pool: %zu -> %zu threads",
+             worker_pool.count, count);
 
-                render_row(term, buf->pix[my_id], &buf->dirty[my_id],
-                           row, row_no, cursor_col);
-                break;
-            }
+    worker_pool.threads = xrealloc(
+        worker_pool.threads, count * sizeof(worker_pool.threads[0]));
 
-            case -1:
-                frame_done = true;
-                sem_post(done);
-                break;
+    while (worker_pool.count < count) {
+        int ret = thrd_create(
+            &worker_pool.threads[worker_pool.count], &render_worker_thread,
+            (void *)(uintptr_t)(1 + worker_pool.count));
 
-            case -2:
-                return 0;
-            }
+        if (ret != thrd_success) {
+            LOG_ERR("failed to create render worker thread: %s (%d)",
+                    thrd_err_as_string(ret), ret);
+            render_workers_release();
+            return false;
         }
-    };
 
-    return -1;
+        worker_pool.count++;
+    }
+
+    return true;
+}
+
+void
+render_workers_release(void)
+{
+    xassert(worker_pool.ref_count > 0);
+    if (--worker_pool.ref_count > 0)
+        return;
+
+    worker_pool.quit = true;
+    for (size_t i = 0; i < worker_pool.count; i++)
+        sem_post(&worker_pool.start);
+    for (size_t i = 0; i < worker_pool.count; i++)
+        thrd_join(worker_pool.threads[i], NULL);
+
+    sem_destroy(&worker_pool.start);
+    sem_destroy(&worker_pool.done);
+    free(worker_pool.threads);
+
+    worker_pool.threads = NULL;
+    worker_pool.count = 0;
+}
+
+/*
+ * Renders the dirty rows in term->render.workers.queue, using (at
+ * most) term->render.workers.count pool threads. Blocks until done.
+ */
+static void
+render_workers_run(struct terminal *term, struct buffer *buf, int dirty_count)
+{
+    /* No point in waking up threads that would find nothing to do */
+    const int slot_count = min(
+        term->render.workers.count,
+        (dirty_count + RENDER_WORKER_MIN_ROWS - 1) / RENDER_WORKER_MIN_ROWS);
+
+    xassert(slot_count > 0);
+    xassert((size_t)slot_count <= worker_pool.count);
+
+    term->render.workers.buf = buf;
+    worker_pool.frame.term = term;
+    worker_pool.frame.slot_count = slot_count;
+    atomic_store_explicit(&worker_pool.frame.next_slot, 0, memory_order_relaxed);
+
+    for (int i = 0; i < slot_count; i++)
+        sem_post(&worker_pool.start);
+    for (int i = 0; i < slot_count; i++)
+        sem_wait(&worker_pool.done);
+
+    worker_pool.frame.term = NULL;
+    term->render.workers.buf = NULL;
 }
 
 struct csd_data
@@ -3310,14 +3914,11 @@ grid_render(struct terminal *term)
 
     render_sixel_images(term, buf->pix[0], &damage, &cursor);
 
-    if (term->render.workers.count > 0) {
-        mtx_lock(&term->render.workers.lock);
-        term->render.workers.buf = buf;
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_post(&term->render.workers.start);
+    const int worker_count = term->render.workers.count;
+    int dirty_count = 0;
 
-        xassert(tll_length(term->render.workers.queue) == 0);
-    }
+    /* Workers aren't running; no need to lock the queue (yet) */
+    xassert(tll_length(term->render.workers.queue) == 0);
 
     for (int r = 0; r < term->rows; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
@@ -3327,26 +3928,23 @@ grid_render(struct terminal *term)
 
         row->dirty = false;
 
-        if (term->render.workers.count > 0)
+        if (worker_count > 0) {
             tll_push_back(term->render.workers.queue, r);
+            dirty_count++;
+        }
 
         else {
             /* TODO: damage region */
             int cursor_col = cursor.row == r ? cursor.col : -1;
-            render_row(term, buf->pix[0], &damage, row, r, cursor_col);
+            render_row(term, buf->pix[0], &damage, row, r, cursor_col,
+                       render_glyph_cache(term, 0),
+                       render_color_cache(term, 0),
+                       term->render.glyph_bufs[0]);
         }
     }
 
-    /* Signal workers the frame is done */
-    if (term->render.workers.count > 0) {
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            tll_push_back(term->render.workers.queue, -1);
-        mtx_unlock(&term->render.workers.lock);
-
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_wait(&term->render.workers.done);
-        term->render.workers.buf = NULL;
-    }
+    if (dirty_count > 0)
+        render_workers_run(term, buf, dirty_count);
 
     for (size_t i = 0; i < term->render.workers.count; i++)
         pixman_region32_union(&damage, &damage, &buf->dirty[i + 1]);
@@ -4115,6 +4713,15 @@ tiocswinsz(struct terminal *term)
     }
 }
 
+static size_t
+reflow_thread_count(const struct terminal *term)
+{
+    /* Parallel reflow is opt-in, see tweak.parallel-reflow */
+    return term->conf->tweak.parallel_reflow
+        ? term->render.workers.count
+        : 1;
+}
+
 static void
 delayed_reflow_of_normal_grid(struct terminal *term)
 {
@@ -4134,6 +4741,7 @@ delayed_reflow_of_normal_grid(struct terminal *term)
         term->interactive_resizing.grid,
         term->interactive_resizing.new_rows, term->normal.num_cols,
         term->interactive_resizing.old_screen_rows, term->rows,
+        reflow_thread_count(term),
         term->selection.coords.end.row >= 0 ? ALEN(tracking_points) : 0,
         tracking_points);
 
@@ -4143,6 +4751,13 @@ delayed_reflow_of_normal_grid(struct terminal *term)
     term->normal = *term->interactive_resizing.grid;
     free(term->interactive_resizing.grid);
 
+    if (term->conf->scrollback.compress_after > 0) {
+        grid_compress_scrollback(
+            &term->normal, term->rows, term->conf->scrollback.compress_after);
+    }
+
+    term_reflow_schedule(term);
+
     term->hide_cursor = term->interactive_resizing.old_hide_cursor;
 
     /* Reset */
@@ -4380,7 +4995,12 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
     const int new_rows = (term->height - 2 * pad_y) / term->cell_height;
 
     /* Grid rows/cols after resize */
-    const int new_normal_grid_rows = 1 << (32 - __builtin_clz(new_rows + scrollback_lines - 1));
+    /* Size the ring after the grid that will be reflowed; the
+     * original grid, if an interactive resize is in progress */
+    const int new_normal_grid_rows = grid_resize_ring_size(
+        term->interactive_resizing.grid != NULL
+            ? term->interactive_resizing.grid : &term->normal,
+        new_cols, new_rows, scrollback_lines);
     const int new_alt_grid_rows = 1 << (32  - __builtin_clz(new_rows));
 
     xassert(new_cols >= 1);
@@ -4473,6 +5093,7 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
             .saved_cursor = orig->saved_cursor,
             .rows = xcalloc(g.num_rows, sizeof(g.rows[0])),
             .cur_row = NULL,
+            .slab = grid_slab_new(term->interactive_resizing.old_cols),
             .scroll_damage = tll_init(),
             .sixel_images = tll_init(),
             .kitty_kbd = orig->kitty_kbd,
@@ -4485,13 +5106,16 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
              i < term->interactive_resizing.old_screen_rows;
              i++, j = (j + 1) & (orig->num_rows - 1))
         {
-            g.rows[i] = grid_row_alloc(g.num_cols, false);
+            const struct row *orig_row = grid_row_abs(orig, j);
+
+            g.rows[i] = grid_row_alloc(g.slab, g.num_cols, false);
             memcpy(g.rows[i]->cells,
-                   orig->rows[j]->cells,
+                   orig_row->cells,
                    g.num_cols * sizeof(g.rows[i]->cells[0]));
+            g.rows[i]->used = orig_row->used;
 
-            if (orig->rows[j]->extra == NULL ||
-                orig->rows[j]->extra->underline_ranges.count == 0)
+            if (orig_row->extra == NULL ||
+                orig_row->extra->underline_ranges.count == 0)
             {
                 continue;
             }
@@ -4500,7 +5124,7 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
              * Copy underline ranges
              */
 
-            const struct row_ranges *underline_src = &orig->rows[j]->extra->underline_ranges;
+            const struct row_ranges *underline_src = &orig_row->extra->underline_ranges;
 
             const int count = underline_src->count;
             g.rows[i]->extra = xcalloc(1, sizeof(*g.rows[i]->extra));
@@ -4581,8 +5205,16 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
 
         grid_resize_and_reflow(
             &term->normal, new_normal_grid_rows, new_cols, old_normal_rows, new_rows,
+            reflow_thread_count(term),
             term->selection.coords.end.row >= 0 ? ALEN(tracking_points) : 0,
             tracking_points);
+
+        if (term->conf->scrollback.compress_after > 0) {
+            grid_compress_scrollback(
+                &term->normal, new_rows, term->conf->scrollback.compress_after);
+        }
+
+        term_reflow_schedule(term);
     }
 
     grid_resize_without_reflow(
@@ -4596,6 +5228,15 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
     term->cols = new_cols;
     term->rows = new_rows;
 
+    /* render_row()'s glyph run buffers, one per render thread */
+    if (new_cols != old_cols) {
+        for (size_t i = 0; i < 1 + term->render.workers.count; i++) {
+            term->render.glyph_bufs[i] = xrealloc(
+                term->render.glyph_bufs[i],
+                new_cols * sizeof(term->render.glyph_bufs[i][0]));
+        }
+    }
+
     sixel_reflow(term);
 
     LOG_DBG("resized: grid: cols=%d, rows=%d "
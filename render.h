@@ -30,11 +30,17 @@ bool render_xcursor_set(
     struct seat *seat, struct terminal *term, enum cursor_shape shape);
 bool render_xcursor_is_valid(const struct seat *seat, const char *cursor);
 
-struct render_worker_context {
-    int my_id;
-    struct terminal *term;
-};
-int render_worker_thread(void *_ctx);
+/* Must be called when the fonts (and thus their glyphs) change */
+void render_reset_glyph_caches(struct terminal *term);
+void render_reset_color_caches(struct terminal *term);
+
+/*
+ * Render worker threads are shared by all terminals. A terminal
+ * acquires the pool, with (at least) 'count' threads, when created,
+ * and releases it when destroyed. Main thread only.
+ */
+bool render_workers_acquire(size_t count);
+void render_workers_release(void);
 
 struct csd_data {
     int x;
@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""
+Generates reproducible VT stimuli files, to be fed to 'foot-bench'.
+
+Each workload stresses a different part of the VT parser and the
+grid. The output only depends on the workload, the grid size, the
+seed and the size, never on the environment the script runs in.
+"""
+
+import argparse
+import base64
+import random
+import sys
+
+
+def ascii_text(out, rng, opts):
+    """Plain, printable ASCII; long and short lines"""
+    alphabet = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,;:-_()[]{}'
+    while out.tell() < opts.size:
+        length = rng.randrange(opts.cols * 2)
+        out.write(''.join(rng.choice(alphabet) for _ in range(length)))
+        out.write('\r\n')
+
+
+def sgr_color(out, rng, opts):
+    """Dense SGR; a new color/attribute for (almost) every word"""
+    words = ['lorem', 'ipsum', 'dolor', 'sit', 'amet', 'foo', 'bar', '{', '}', '=']
+
+    def color(base):
+        kind = rng.randrange(4)
+        if kind == 0:
+            return f'{base + rng.randrange(8)}'
+        elif kind == 1:
+            return f'{base + 60 + rng.randrange(8)}'
+        elif kind == 2:
+            return f'{base + 8};5;{rng.randrange(256)}'
+        else:
+            r, g, b = (rng.randrange(256) for _ in range(3))
+            return f'{base + 8}:2::{r}:{g}:{b}'
+
+    while out.tell() < opts.size:
+        col = 0
+        while col < opts.cols - 8:
+            params = [color(30)]
+            if rng.randrange(3) == 0:
+                params.append(color(40))
+            if rng.randrange(4) == 0:
+                params.append(rng.choice(['1', '2', '3', '4', '4:3', '7', '9']))
+
+            word = rng.choice(words)
+            out.write(f'\033[{";".join(params)}m{word}\033[m ')
+            col += len(word) + 1
+        out.write('\r\n')
+
+
+def cjk(out, rng, opts):
+    """Double-width UTF-8 (CJK ideographs, hiragana, hangul)"""
+    ranges = [(0x4e00, 0x9fff), (0x3041, 0x3096), (0xac00, 0xd7a3)]
+    while out.tell() < opts.size:
+        lo, hi = rng.choice(ranges)
+        length = rng.randrange(opts.cols)
+        out.write(''.join(chr(rng.randint(lo, hi)) for _ in range(length)))
+        out.write('\r\n')
+
+
+def emoji(out, rng, opts):
+    """Emoji, including multi-codepoint grapheme clusters"""
+    clusters = [
+        '😀', '🎉', '🚀', '❤️', '👍🏽',
+        '👨‍👩‍👧‍👦',   # ZWJ sequence
+        '👩🏽‍🔬',      # ZWJ + skin tone modifier
+        '🇸🇪', '🇯🇵',  # Regional indicators
+        '#️⃣',         # Keycap sequence
+        'é',          # Combining acute
+        'a', ' ',
+    ]
+    while out.tell() < opts.size:
+        length = rng.randrange(opts.cols // 2)
+        out.write(''.join(rng.choice(clusters) for _ in range(length)))
+        out.write('\r\n')
+
+
+def scroll_region(out, rng, opts):
+    """Vim-like scroll region churn: status lines, partial scrolling"""
+    lines = opts.rows
+    alphabet = 'abcdefghijklmnopqrstuvwxyz    '
+    while out.tell() < opts.size:
+        top = rng.randrange(1, 4)
+        bottom = lines - rng.randrange(1, 3)
+        out.write(f'\033[{top};{bottom}r')
+
+        for _ in range(rng.randrange(1, 32)):
+            action = rng.randrange(5)
+            if action == 0:
+                # Scroll down, as when moving down in a file
+                out.write(f'\033[{bottom};1H\n')
+            elif action == 1:
+                # Reverse scroll, as when moving up in a file
+                out.write(f'\033[{top};1H\033M')
+            elif action == 2:
+                out.write(f'\033[{rng.randrange(1, lines // 2)}S')
+            elif action == 3:
+                out.write(f'\033[{rng.randrange(1, lines // 2)}T')
+            else:
+                # Insert/delete lines
+                out.write(f'\033[{rng.randrange(top, bottom)};1H')
+                out.write(f'\033[{rng.randrange(1, 4)}{rng.choice("LM")}')
+
+            line = ''.join(rng.choice(alphabet) for _ in range(opts.cols - 1))
+            out.write(f'\033[K{line}')
+
+        # Redraw the status line, outside the scroll region
+        out.write(f'\033[r\033[{lines};1H\033[7m')
+        out.write(f'-- INSERT -- {rng.randrange(100000):>{opts.cols - 14}}')
+        out.write('\033[m')
+
+
+def alt_random(out, rng, opts):
+    """Random cursor positioning and writes on the alt screen"""
+    alphabet = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 öäå'
+    out.write('\033[?1049h')
+    while out.tell() < opts.size:
+        row = rng.randrange(opts.rows)
+        col = rng.randrange(opts.cols)
+        repeat = rng.randrange(opts.cols - col + 1)
+        out.write(f'\033[{row + 1};{col + 1}H')
+        if rng.randrange(2):
+            out.write(f'\033[{30 + rng.randrange(8)};{40 + rng.randrange(8)}m')
+        out.write(rng.choice(alphabet) * repeat)
+        if rng.randrange(2):
+            out.write('\033[m')
+    out.write('\033[m\033[?1049l')
+
+
+def sixel(out, rng, opts):
+    """Sixel images, using both literal and RLE encoded sixels"""
+    sixels = '?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~'
+    width = 8 * opts.cols     # foot-bench hardcodes cell width to 8px
+    height = 15 * opts.rows   # foot-bench hardcodes cell height to 15px
+
+    while out.tell() < opts.size:
+        out.write(f'\033[{rng.randrange(opts.rows // 2) + 1};'
+                  f'{rng.randrange(opts.cols // 2) + 1}H')
+
+        six_width = rng.randrange(1, width // 2)
+        six_height = rng.randrange(1, height // 2)
+
+        out.write(f'\033P;{rng.randrange(2)}q"1;1;{six_width};{six_height}')
+        for idx in range(256):
+            out.write(f'#{idx};2;{rng.randrange(101)};{rng.randrange(101)};{rng.randrange(101)}')
+
+        six_rows = (six_height + 5) // 6
+        for row in range(six_rows):
+            band_count = rng.randrange(1, 8)
+            for band in range(band_count):
+                out.write(f'#{rng.randrange(256)}')
+                if rng.randrange(2):
+                    out.write(''.join(rng.choice(sixels) for _ in range(six_width)))
+                else:
+                    left = six_width
+                    while left > 0:
+                        repeat = rng.randrange(1, left + 1)
+                        out.write(f'!{repeat}{rng.choice(sixels)}')
+                        left -= repeat
+
+                if band + 1 < band_count:
+                    out.write('$')
+                elif row + 1 < six_rows:
+                    out.write('-')
+
+        out.write('\033\\')
+
+
+def osc8(out, rng, opts):
+    """OSC 8 hyperlinks, as emitted by e.g. 'ls --hyperlink'"""
+    names = ['README.md', 'meson.build', 'terminal.c', 'vt.c', 'render.c', 'doc', 'pgo']
+    while out.tell() < opts.size:
+        for _ in range(rng.randrange(1, 8)):
+            name = rng.choice(names)
+            uri = f'file://localhost/home/user/src/{rng.randrange(1000)}/{name}'
+            params = f'id={rng.randrange(100)}' if rng.randrange(2) else ''
+            out.write(f'\033]8;{params};{uri}\033\\{name}\033]8;;\033\\  ')
+        out.write('\r\n')
+
+
+def osc52(out, rng, opts):
+    """Huge OSC 52 (clipboard) payloads"""
+    while out.tell() < opts.size:
+        payload_size = rng.randrange(64 * 1024, 1024 * 1024)
+        payload = bytes(rng.randrange(32, 127) for _ in range(payload_size))
+        out.write(f'\033]52;c;{base64.b64encode(payload).decode("ascii")}')
+        out.write(rng.choice(['\a', '\033\\']))
+
+
+WORKLOADS = {
+    'ascii': ascii_text,
+    'sgr': sgr_color,
+    'cjk': cjk,
+    'emoji': emoji,
+    'scroll-region': scroll_region,
+    'alt-random': alt_random,
+    'sixel': sixel,
+    'osc8': osc8,
+    'osc52': osc52,
+}
+
+
+class ByteCounter:
+    """Wraps a binary stream, tracking the number of UTF-8 bytes written"""
+    def __init__(self, stream):
+        self._stream = stream
+        self._count = 0
+
+    def write(self, s):
+        data = s.encode('utf-8')
+        self._stream.write(data)
+        self._count += len(data)
+
+    def tell(self):
+        return self._count
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('workload', choices=sorted(WORKLOADS.keys()))
+    parser.add_argument('out', type=argparse.FileType(mode='wb'), help='name of output file')
+    parser.add_argument('--rows', type=int, default=67)
+    parser.add_argument('--cols', type=int, default=135)
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--size', type=int, default=4 * 1024**2,
+                        help='approximate size, in bytes, of the generated file')
+
+    opts = parser.parse_args()
+
+    assert opts.rows >= 8, f'{opts.rows}'
+    assert opts.cols >= 32, f'{opts.cols}'
+
+    # Pin seeding method, to make the output stable across versions
+    rng = random.Random()
+    rng.seed(a=opts.seed, version=2)
+
+    out = ByteCounter(opts.out)
+    WORKLOADS[opts.workload](out, rng, opts)
+
+    # Leave the terminal in a sane state
+    out.write('\033[m\033[r')
+    opts.out.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,337 @@
+#!/usr/bin/env python3
+
+"""
+Generates the state transition tables for the VT parser.
+
+The state machine is based on https://vt100.net/emu/dec_ansi_parser,
+with foot's modifications (UTF-8 states, 8-bit C1 controls ignored
+etc). It *must* be kept in sync with the state_*_switch() functions
+in vt.c.
+
+The 256 input bytes are compacted into equivalence classes (bytes
+that behave identically in all states), and each (state, class) pair
+maps to a (compound action, new state) pair. A compound action is the
+sequence of exit, transition and entry actions to run.
+"""
+
+import argparse
+import sys
+
+
+STATES = [
+    'GROUND',
+    'ESCAPE',
+    'ESCAPE_INTERMEDIATE',
+
+    'CSI_ENTRY',
+    'CSI_PARAM',
+    'CSI_INTERMEDIATE',
+    'CSI_IGNORE',
+
+    'OSC_STRING',
+
+    'DCS_ENTRY',
+    'DCS_PARAM',
+    'DCS_INTERMEDIATE',
+    'DCS_IGNORE',
+    'DCS_PASSTHROUGH',
+
+    'SOS_PM_APC_STRING',
+
+    'UTF8_21',
+    'UTF8_31',
+    'UTF8_32',
+    'UTF8_41',
+    'UTF8_42',
+    'UTF8_43',
+]
+
+# Actions, and whether they take the input byte as argument
+ACTIONS = {
+    'ignore': False,
+    'execute': True,
+    'print': True,
+    'clear': False,
+    'collect': True,
+    'esc_dispatch': True,
+    'csi_dispatch': True,
+    'param': True,
+    'param_new': True,
+    'param_new_subparam': True,
+    'osc_start': True,
+    'osc_put': True,
+    'osc_end': True,
+    'hook': True,
+    'put': True,
+    'unhook': True,
+    'utf8_21': True,
+    'utf8_22': True,
+    'utf8_31': True,
+    'utf8_32': True,
+    'utf8_33': True,
+    'utf8_41': True,
+    'utf8_42': True,
+    'utf8_43': True,
+    'utf8_44': True,
+}
+
+C0 = [(0x00, 0x17), 0x19, (0x1c, 0x1f)]
+
+
+def expand(spec):
+    if isinstance(spec, int):
+        return [spec]
+    if isinstance(spec, tuple):
+        return list(range(spec[0], spec[1] + 1))
+    return [b for s in spec for b in expand(s)]
+
+
+class StateMachine:
+    def __init__(self):
+        # table[state][byte] = (actions, new state)
+        self.table = {s: [None] * 256 for s in STATES}
+
+    def on(self, state, spec, actions, new_state=None):
+        for b in expand(spec):
+            assert self.table[state][b] is None, f'{state}: 0x{b:02x} already defined'
+            self.table[state][b] = (tuple(actions), new_state or state)
+
+    def anywhere(self, state):
+        """Fill in the "anywhere" transitions for undefined bytes"""
+        for b in range(256):
+            if self.table[state][b] is not None:
+                continue
+
+            if b in (0x18, 0x1a):
+                self.table[state][b] = (('execute',), 'GROUND')
+            elif b == 0x1b:
+                self.table[state][b] = (('clear',), 'ESCAPE')
+            elif 0x80 <= b <= 0x9f:
+                # 8-bit C1 control characters (not supported)
+                self.table[state][b] = ((), 'GROUND')
+            else:
+                self.table[state][b] = ((), state)
+
+    def default(self, state, actions, new_state=None):
+        for b in range(256):
+            if self.table[state][b] is None:
+                self.table[state][b] = (tuple(actions), new_state or state)
+
+
+def build() -> StateMachine:
+    sm = StateMachine()
+
+    sm.on('GROUND', C0, ['execute'])
+    # modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character
+    sm.on('GROUND', (0x20, 0x7e), ['print'])
+    sm.on('GROUND', (0xc2, 0xdf), ['utf8_21'], 'UTF8_21')
+    sm.on('GROUND', (0xe0, 0xef), ['utf8_31'], 'UTF8_31')
+    sm.on('GROUND', (0xf0, 0xf4), ['utf8_41'], 'UTF8_41')
+    sm.anywhere('GROUND')
+
+    sm.on('ESCAPE', C0, ['execute'])
+    sm.on('ESCAPE', (0x20, 0x2f), ['collect'], 'ESCAPE_INTERMEDIATE')
+    sm.on('ESCAPE', (0x30, 0x4f), ['esc_dispatch'], 'GROUND')
+    sm.on('ESCAPE', 0x50, ['clear'], 'DCS_ENTRY')
+    sm.on('ESCAPE', (0x51, 0x57), ['esc_dispatch'], 'GROUND')
+    sm.on('ESCAPE', 0x58, [], 'SOS_PM_APC_STRING')
+    sm.on('ESCAPE', (0x59, 0x5a), ['esc_dispatch'], 'GROUND')
+    sm.on('ESCAPE', 0x5b, ['clear'], 'CSI_ENTRY')
+    sm.on('ESCAPE', 0x5c, ['esc_dispatch'], 'GROUND')
+    sm.on('ESCAPE', 0x5d, ['osc_start'], 'OSC_STRING')
+    sm.on('ESCAPE', (0x5e, 0x5f), [], 'SOS_PM_APC_STRING')
+    sm.on('ESCAPE', (0x60, 0x7e), ['esc_dispatch'], 'GROUND')
+    sm.on('ESCAPE', 0x7f, ['ignore'])
+    sm.anywhere('ESCAPE')
+
+    sm.on('ESCAPE_INTERMEDIATE', C0, ['execute'])
+    sm.on('ESCAPE_INTERMEDIATE', (0x20, 0x2f), ['collect'])
+    sm.on('ESCAPE_INTERMEDIATE', (0x30, 0x7e), ['esc_dispatch'], 'GROUND')
+    sm.on('ESCAPE_INTERMEDIATE', 0x7f, ['ignore'])
+    sm.anywhere('ESCAPE_INTERMEDIATE')
+
+    sm.on('CSI_ENTRY', C0, ['execute'])
+    sm.on('CSI_ENTRY', (0x20, 0x2f), ['collect'], 'CSI_INTERMEDIATE')
+    sm.on('CSI_ENTRY', (0x30, 0x39), ['param'], 'CSI_PARAM')
+    sm.on('CSI_ENTRY', 0x3a, ['param_new_subparam'], 'CSI_PARAM')
+    sm.on('CSI_ENTRY', 0x3b, ['param_new'], 'CSI_PARAM')
+    sm.on('CSI_ENTRY', (0x3c, 0x3f), ['collect'], 'CSI_PARAM')
+    sm.on('CSI_ENTRY', (0x40, 0x7e), ['csi_dispatch'], 'GROUND')
+    sm.on('CSI_ENTRY', 0x7f, ['ignore'])
+    sm.anywhere('CSI_ENTRY')
+
+    sm.on('CSI_PARAM', C0, ['execute'])
+    sm.on('CSI_PARAM', (0x20, 0x2f), ['collect'], 'CSI_INTERMEDIATE')
+    sm.on('CSI_PARAM', (0x30, 0x39), ['param'])
+    sm.on('CSI_PARAM', 0x3a, ['param_new_subparam'])
+    sm.on('CSI_PARAM', 0x3b, ['param_new'])
+    sm.on('CSI_PARAM', (0x3c, 0x3f), [], 'CSI_IGNORE')
+    sm.on('CSI_PARAM', (0x40, 0x7e), ['csi_dispatch'], 'GROUND')
+    sm.on('CSI_PARAM', 0x7f, ['ignore'])
+    sm.anywhere('CSI_PARAM')
+
+    sm.on('CSI_INTERMEDIATE', C0, ['execute'])
+    sm.on('CSI_INTERMEDIATE', (0x20, 0x2f), ['collect'])
+    sm.on('CSI_INTERMEDIATE', (0x30, 0x3f), [], 'CSI_IGNORE')
+    sm.on('CSI_INTERMEDIATE', (0x40, 0x7e), ['csi_dispatch'], 'GROUND')
+    sm.on('CSI_INTERMEDIATE', 0x7f, ['ignore'])
+    sm.anywhere('CSI_INTERMEDIATE')
+
+    sm.on('CSI_IGNORE', C0, ['execute'])
+    sm.on('CSI_IGNORE', (0x20, 0x3f), ['ignore'])
+    sm.on('CSI_IGNORE', (0x40, 0x7e), [], 'GROUND')
+    sm.on('CSI_IGNORE', 0x7f, ['ignore'])
+    sm.anywhere('CSI_IGNORE')
+
+    # Note: original was 20-7f, but foot uses 20-ff, to include UTF-8
+    sm.on('OSC_STRING', 0x07, ['osc_end'], 'GROUND')
+    sm.on('OSC_STRING', [(0x00, 0x06), (0x08, 0x17), 0x19, (0x1c, 0x1f)], ['ignore'])
+    sm.on('OSC_STRING', [0x18, 0x1a], ['osc_end', 'execute'], 'GROUND')
+    sm.on('OSC_STRING', 0x1b, ['osc_end', 'clear'], 'ESCAPE')
+    sm.default('OSC_STRING', ['osc_put'])
+
+    sm.on('DCS_ENTRY', C0, ['ignore'])
+    sm.on('DCS_ENTRY', (0x20, 0x2f), ['collect'], 'DCS_INTERMEDIATE')
+    sm.on('DCS_ENTRY', (0x30, 0x39), ['param'], 'DCS_PARAM')
+    sm.on('DCS_ENTRY', 0x3a, [], 'DCS_IGNORE')
+    sm.on('DCS_ENTRY', 0x3b, ['param_new'], 'DCS_PARAM')
+    sm.on('DCS_ENTRY', (0x3c, 0x3f), ['collect'], 'DCS_PARAM')
+    sm.on('DCS_ENTRY', (0x40, 0x7e), ['hook'], 'DCS_PASSTHROUGH')
+    sm.on('DCS_ENTRY', 0x7f, ['ignore'])
+    sm.anywhere('DCS_ENTRY')
+
+    sm.on('DCS_PARAM', C0, ['ignore'])
+    sm.on('DCS_PARAM', (0x20, 0x2f), ['collect'], 'DCS_INTERMEDIATE')
+    sm.on('DCS_PARAM', (0x30, 0x39), ['param'])
+    sm.on('DCS_PARAM', 0x3a, [], 'DCS_IGNORE')
+    sm.on('DCS_PARAM', 0x3b, ['param_new'])
+    sm.on('DCS_PARAM', (0x3c, 0x3f), [], 'DCS_IGNORE')
+    sm.on('DCS_PARAM', (0x40, 0x7e), ['hook'], 'DCS_PASSTHROUGH')
+    sm.on('DCS_PARAM', 0x7f, ['ignore'])
+    sm.anywhere('DCS_PARAM')
+
+    sm.on('DCS_INTERMEDIATE', C0, ['ignore'])
+    sm.on('DCS_INTERMEDIATE', (0x20, 0x2f), ['collect'])
+    sm.on('DCS_INTERMEDIATE', (0x30, 0x3f), [], 'DCS_IGNORE')
+    sm.on('DCS_INTERMEDIATE', (0x40, 0x7e), ['hook'], 'DCS_PASSTHROUGH')
+    sm.on('DCS_INTERMEDIATE', 0x7f, ['ignore'])
+    sm.anywhere('DCS_INTERMEDIATE')
+
+    sm.on('DCS_IGNORE', [C0, (0x20, 0x7f)], ['ignore'])
+    sm.anywhere('DCS_IGNORE')
+
+    sm.on('DCS_PASSTHROUGH', [(0x00, 0x17), 0x19, (0x1c, 0x7e)], ['put'])
+    sm.on('DCS_PASSTHROUGH', 0x7f, ['ignore'])
+    sm.on('DCS_PASSTHROUGH', [0x18, 0x1a], ['unhook', 'execute'], 'GROUND')
+    sm.on('DCS_PASSTHROUGH', 0x1b, ['unhook', 'clear'], 'ESCAPE')
+    sm.on('DCS_PASSTHROUGH', (0x80, 0x9f), ['unhook'], 'GROUND')
+    sm.default('DCS_PASSTHROUGH', [])
+
+    sm.on('SOS_PM_APC_STRING', [C0, (0x20, 0x7f)], ['ignore'])
+    sm.anywhere('SOS_PM_APC_STRING')
+
+    # Invalid continuation bytes are consumed, and we return to ground
+    for state, action, new_state in (
+            ('UTF8_21', 'utf8_22', 'GROUND'),
+            ('UTF8_31', 'utf8_32', 'UTF8_32'),
+            ('UTF8_32', 'utf8_33', 'GROUND'),
+            ('UTF8_41', 'utf8_42', 'UTF8_42'),
+            ('UTF8_42', 'utf8_43', 'UTF8_43'),
+            ('UTF8_43', 'utf8_44', 'GROUND')):
+        sm.on(state, (0x80, 0xbf), [action], new_state)
+        sm.default(state, [], 'GROUND')
+
+    for state in STATES:
+        assert all(t is not None for t in sm.table[state]), state
+
+    return sm
+
+
+def action_id(actions) -> str:
+    if not actions:
+        return 'VT_ACTION_NONE'
+    return 'VT_ACTION_' + '_THEN_'.join(a.upper() for a in actions)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('output', type=argparse.FileType('w'))
+    opts = parser.parse_args()
+
+    sm = build()
+
+    # Compact bytes into equivalence classes
+    classes: list[tuple] = []
+    byte_class: list[int] = []
+
+    for b in range(256):
+        column = tuple(sm.table[s][b] for s in STATES)
+        if column not in classes:
+            classes.append(column)
+        byte_class.append(classes.index(column))
+
+    assert len(classes) <= 256
+
+    compound_actions = [()]
+    for column in classes:
+        for actions, _ in column:
+            if actions not in compound_actions:
+                compound_actions.append(actions)
+
+    out = opts.output
+    out.write('/* Generated by generate-vt-tables.py - do not edit */\n')
+    out.write('#pragma once\n')
+    out.write('#include <stdint.h>\n')
+    out.write('\n')
+
+    out.write('enum state {\n')
+    for s in STATES:
+        out.write(f'    STATE_{s},\n')
+    out.write('};\n')
+    out.write(f'#define VT_STATE_COUNT {len(STATES)}\n')
+    out.write(f'#define VT_BYTE_CLASS_COUNT {len(classes)}\n')
+    out.write('\n')
+
+    out.write('enum vt_action {\n')
+    for actions in compound_actions:
+        out.write(f'    {action_id(actions)},\n')
+    out.write('};\n')
+    out.write('\n')
+
+    # X-macro expanding to the code for each compound action. Expects
+    # 'term' and 'data' to be in scope, and action_<name>() functions
+    # to have been defined
+    out.write('#define VT_FOREACH_ACTION(X) \\\n')
+    for actions in compound_actions:
+        calls = ' '.join(
+            f'action_{a}(term{", data" if ACTIONS[a] else ""});'
+            for a in actions)
+        out.write(f'    X({action_id(actions)}, {{ {calls} }}) \\\n')
+    out.write('\n')
+
+    out.write('struct vt_transition {\n')
+    out.write('    uint8_t action;  /* enum vt_action */\n')
+    out.write('    uint8_t state;   /* enum state */\n')
+    out.write('};\n')
+    out.write('\n')
+
+    out.write('static const uint8_t vt_byte_class[256] = {\n')
+    for row in range(0, 256, 16):
+        values = ', '.join(f'{c:2d}' for c in byte_class[row:row + 16])
+        out.write(f'    {values},  /* 0x{row:02x} */\n')
+    out.write('};\n')
+    out.write('\n')
+
+    out.write('static const struct vt_transition '
+              'vt_transitions[VT_STATE_COUNT][VT_BYTE_CLASS_COUNT] = {\n')
+    for i, s in enumerate(STATES):
+        out.write(f'    [STATE_{s}] = {{\n')
+        for c, column in enumerate(classes):
+            actions, new_state = column[i]
+            out.write(f'        [{c}] = {{{action_id(actions)}, STATE_{new_state}}},\n')
+        out.write('    },\n')
+    out.write('};\n')
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -118,6 +118,8 @@ search_cancel_keep_selection(struct terminal *term)
     term->is_searching = false;
     term->render.search_glyph_offset = 0;
 
+    term_compress_scrollback(term);
+
     /* Reset IME state */
     if (term_ime_is_enabled(term)) {
         term_ime_disable(term);
@@ -136,6 +138,9 @@ search_begin(struct terminal *term)
     search_cancel_keep_selection(term);
     selection_cancel(term);
 
+    /* Searching needs the whole scrollback */
+    term_reflow_finish(term);
+
     /* Reset IME state */
     if (term_ime_is_enabled(term)) {
         term_ime_disable(term);
@@ -322,11 +327,22 @@ find_next(struct terminal *term, enum search_direction direction,
     xassert(abs_end.col >= 0);
     xassert(abs_end.col < term->cols);
 
+    /* Empty cells only match a space */
+    const bool skip_empty = term->search.buf[0] != U' ';
+
+    /*
+     * Compressed rows are decoded into these, instead of being
+     * uncompressed; we may be scanning the entire scrollback
+     */
+    struct row *scratch = grid_row_alloc(NULL, grid->num_cols, false);
+    struct row *match_scratch = grid_row_alloc(NULL, grid->num_cols, false);
+    bool found = false;
+
     for (int match_start_row = abs_start.row, match_start_col = abs_start.col;
          ;
          backward ? ROW_DEC(match_start_row) : ROW_INC(match_start_row)) {
 
-        const struct row *row = grid->rows[match_start_row];
+        const struct row *row = grid_row_abs_peek(grid, match_start_row, scratch);
         if (row == NULL) {
             if (match_start_row == abs_end.row)
                 break;
@@ -337,6 +353,27 @@ find_next(struct terminal *term, enum search_direction direction,
              backward ? match_start_col >= 0 : match_start_col < term->cols;
              backward ? match_start_col-- : match_start_col++)
         {
+            if (skip_empty && match_start_col >= row->used) {
+                /* Skip the row's empty tail, but stop at the end point */
+                if (match_start_row == abs_end.row &&
+                    abs_end.col >= row->used &&
+                    (backward
+                     ? abs_end.col <= match_start_col
+                     : abs_end.col >= match_start_col))
+                {
+                    match_start_col = abs_end.col;
+                    break;
+                }
+
+                if (!backward) {
+                    match_start_col = term->cols;
+                    break;
+                }
+
+                match_start_col = row->used;
+                continue;
+            }
+
             if (matches_cell(term, &row->cells[match_start_col], 0) < 0) {
                 if (match_start_row == abs_end.row &&
                     match_start_col == abs_end.col)
@@ -364,7 +401,8 @@ find_next(struct terminal *term, enum search_direction direction,
                     ROW_INC(match_end_row);
                     match_end_col = 0;
 
-                    match_row = grid->rows[match_end_row];
+                    match_row = grid_row_abs_peek(
+                        grid, match_end_row, match_scratch);
                     if (match_row == NULL)
                         break;
                 }
@@ -407,7 +445,8 @@ find_next(struct terminal *term, enum search_direction direction,
                 .end = {match_end_col - 1, match_end_row},
             };
 
-            return true;
+            found = true;
+            goto out;
         }
 
         if (match_start_row == abs_end.row && match_start_col == abs_end.col)
@@ -416,7 +455,59 @@ find_next(struct terminal *term, enum search_direction direction,
         match_start_col = backward ? term->cols - 1 : 0;
     }
 
-    return false;
+out:
+    grid_row_free(scratch);
+    grid_row_free(match_scratch);
+    return found;
+}
+
+/*
+ * Backward search, paging in disk-spilled scrollback when reaching
+ * the oldest row in memory, before wrapping around to the bottom of
+ * the scrollback. Forward searches start at, or below, the view, and
+ * never reach the spilled rows.
+ */
+static bool
+find_prev_and_page_in(struct terminal *term, enum search_direction direction,
+                      struct coord start, struct coord end,
+                      struct range *match)
+{
+    const struct grid *grid = term->grid;
+    xassert(direction != SEARCH_FORWARD);
+
+    struct coord top = {
+        .col = 0,
+        .row = grid_sb_start_ignore_uninitialized(grid, term->rows),
+    };
+
+    if (find_next(term, direction, start, top, match))
+        return true;
+
+    /* Paging in may grow the ring; these are updated if it does */
+    struct coord *const tracking_points[] = {&start, &end, &top};
+
+    while (term_spill_page_in(term, ALEN(tracking_points), tracking_points) > 0) {
+        const struct coord prev_top_row_end = {
+            .col = term->cols - 1,
+            .row = (top.row - 1) & (grid->num_rows - 1),
+        };
+
+        top.row = grid_sb_start_ignore_uninitialized(grid, term->rows);
+
+        if (find_next(term, direction, prev_top_row_end, top, match))
+            return true;
+    }
+
+    /* Wrap around */
+    const struct coord bottom = {
+        .col = term->cols - 1,
+        .row = grid_row_absolute(grid, term->rows - 1),
+    };
+
+    if (start.row == bottom.row && start.col == bottom.col)
+        return false;
+
+    return find_next(term, direction, bottom, end, match);
 }
 
 static void
@@ -513,7 +604,10 @@ search_find_next(struct terminal *term, enum search_direction direction)
     }
 
     struct range match;
-    bool found = find_next(term, direction, start, end, &match);
+    bool found = direction != SEARCH_FORWARD &&
+                 term->spill != NULL && grid == &term->normal
+        ? find_prev_and_page_in(term, direction, start, end, &match)
+        : find_next(term, direction, start, end, &match);
 
     if (found) {
         LOG_DBG("primary match found at %dx%d",
@@ -661,7 +755,7 @@ static bool
 coord_advance_left(const struct terminal *term, struct coord *pos,
                    const struct row **row)
 {
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
     struct coord new_pos = *pos;
 
     if (--new_pos.col < 0) {
@@ -672,7 +766,7 @@ coord_advance_left(const struct terminal *term, struct coord *pos,
             return false;
 
         if (row != NULL)
-            *row = grid->rows[new_pos.row];
+            *row = grid_row_abs(grid, new_pos.row);
     }
 
     *pos = new_pos;
@@ -683,7 +777,7 @@ static bool
 coord_advance_right(const struct terminal *term, struct coord *pos,
                     const struct row **row)
 {
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
     struct coord new_pos = *pos;
 
     if (++new_pos.col >= term->cols) {
@@ -694,7 +788,7 @@ coord_advance_right(const struct terminal *term, struct coord *pos,
             return false;
 
         if (row != NULL)
-            *row = grid->rows[new_pos.row];
+            *row = grid_row_abs(grid, new_pos.row);
     }
 
     *pos = new_pos;
@@ -715,7 +809,7 @@ search_extend_find_char(const struct terminal *term, struct coord *target,
 
     *target = pos;
 
-    const struct row *row = term->grid->rows[pos.row];
+    const struct row *row = grid_row_abs(term->grid, pos.row);
 
     while (true) {
         switch (direction) {
@@ -870,7 +964,7 @@ search_extend_left(struct terminal *term, const struct coord *target)
 
     const struct coord last_coord = selection_get_start(term);
     struct coord pos = *target;
-    const struct row *row = term->grid->rows[pos.row];
+    const struct row *row = grid_row_abs(term->grid, pos.row);
 
     const bool move_cursor = term->search.cursor != 0;
 
@@ -934,7 +1028,7 @@ search_extend_right(struct terminal *term, const struct coord *target)
         return;
 
     struct coord pos = selection_get_end(term);
-    const struct row *row = term->grid->rows[pos.row];
+    const struct row *row = grid_row_abs(term->grid, pos.row);
 
     const bool move_cursor = term->search.cursor == term->search.len;
 
@@ -213,7 +213,7 @@ sixel_erase(struct terminal *term, struct sixel *sixel)
     for (int i = 0; i < sixel->rows; i++) {
         int r = (sixel->pos.row + i) & (term->grid->num_rows - 1);
 
-        struct row *row = term->grid->rows[r];
+        struct row *row = grid_row_abs(term->grid, r);
         if (row == NULL) {
             /* A resize/reflow may cause row to now be unallocated */
             continue;
@@ -1347,7 +1347,7 @@ sixel_unhook(struct terminal *term)
 
         /* Dirty touched cells, and scroll terminal content if necessary */
         for (size_t i = 0; i < image.rows; i++) {
-            struct row *row = term->grid->rows[cur_row + i];
+            struct row *row = grid_row_abs(term->grid, cur_row + i);
             row->dirty = true;
 
             for (int col = image.pos.col;
@@ -2116,6 +2116,71 @@ sixel_put_ar_11(struct terminal *term, uint8_t c)
     count++;
 }
 
+/*
+ * Consumes sixel data until a control character changes the state, or
+ * the span ends. Returns a pointer to the first unconsumed byte.
+ */
+static const uint8_t *
+decsixel_span(struct terminal *term, const uint8_t *p, const uint8_t *end)
+{
+    const bool ar_11 = term->sixel.pan == 1 && term->sixel.pad == 1;
+
+    while (p < end) {
+        const uint8_t c = *p++;
+
+        if (likely(c >= '?' && c <= '~')) {
+            if (likely(ar_11))
+                sixel_add_one_ar_11(term, c - 63);
+            else
+                sixel_add_many_generic(term, c - 63, 1);
+            count++;
+        } else {
+            decsixel_generic(term, c);
+            count++;
+
+            if (term->sixel.state != SIXEL_DECSIXEL)
+                break;
+        }
+    }
+
+    return p;
+}
+
+void
+sixel_put_span(struct terminal *term, const uint8_t *data, size_t len)
+{
+    const uint8_t *p = data;
+    const uint8_t *const end = data + len;
+
+    while (p < end) {
+        switch (term->sixel.state) {
+        case SIXEL_DECSIXEL:
+            p = decsixel_span(term, p, end);
+            break;
+
+        case SIXEL_DECGRA:
+            for (; p < end && term->sixel.state == SIXEL_DECGRA; count++)
+                decgra(term, *p++);
+            break;
+
+        case SIXEL_DECGRI:
+            if (likely(term->sixel.pan == 1 && term->sixel.pad == 1)) {
+                for (; p < end && term->sixel.state == SIXEL_DECGRI; count++)
+                    decgri_ar_11(term, *p++);
+            } else {
+                for (; p < end && term->sixel.state == SIXEL_DECGRI; count++)
+                    decgri_generic(term, *p++);
+            }
+            break;
+
+        case SIXEL_DECGCI:
+            for (; p < end && term->sixel.state == SIXEL_DECGCI; count++)
+                decgci(term, *p++);
+            break;
+        }
+    }
+}
+
 void
 sixel_colors_report_current(struct terminal *term)
 {
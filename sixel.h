@@ -11,6 +11,7 @@ typedef void (*sixel_put)(struct terminal *term, uint8_t c);
 void sixel_fini(struct terminal *term);
 
 sixel_put sixel_init(struct terminal *term, int p1, int p2, int p3);
+void sixel_put_span(struct terminal *term, const uint8_t *data, size_t len);
 void sixel_unhook(struct terminal *term);
 
 void sixel_destroy(struct sixel *sixel);
@@ -0,0 +1,304 @@
+#include "slab.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "slab"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+
+struct chunk;
+
+/*
+ * Each object is prefixed with a pointer to the chunk it belongs
+ * to. Free slots use the object memory to link the free list.
+ */
+struct slot {
+    struct chunk *chunk;
+    alignas(void *) uint8_t obj[];
+};
+
+struct chunk {
+    struct chunk *prev;
+    struct chunk *next;
+
+    size_t live;        /* Number of allocated objects */
+    size_t untouched;   /* Index of first never-allocated slot */
+    struct slot *free;  /* Free list, linked through slot->obj */
+
+    alignas(void *) uint8_t data[];
+};
+
+struct slab {
+    size_t slot_size;
+    size_t per_chunk;
+
+    struct chunk *partial;  /* Chunks with at least one free slot */
+    struct chunk *full;     /* Chunks without free slots */
+    struct chunk *spare;    /* A completely free chunk */
+
+    size_t chunk_count;
+};
+
+static void
+list_remove(struct chunk **list, struct chunk *chunk)
+{
+    if (chunk->prev != NULL)
+        chunk->prev->next = chunk->next;
+    else {
+        xassert(*list == chunk);
+        *list = chunk->next;
+    }
+
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk->prev;
+
+    chunk->prev = chunk->next = NULL;
+}
+
+static void
+list_push(struct chunk **list, struct chunk *chunk)
+{
+    chunk->prev = NULL;
+    chunk->next = *list;
+
+    if (*list != NULL)
+        (*list)->prev = chunk;
+    *list = chunk;
+}
+
+static void
+list_free(struct chunk *list)
+{
+    while (list != NULL) {
+        struct chunk *next = list->next;
+        free(list);
+        list = next;
+    }
+}
+
+struct slab *
+slab_init(size_t obj_size, size_t objs_per_chunk)
+{
+    xassert(objs_per_chunk > 0);
+
+    const size_t align = alignof(void *);
+    size_t slot_size = sizeof(struct slot) + max(obj_size, sizeof(void *));
+    slot_size = (slot_size + align - 1) & ~(align - 1);
+
+    struct slab *slab = xmalloc(sizeof(*slab));
+    *slab = (struct slab){
+        .slot_size = slot_size,
+        .per_chunk = objs_per_chunk,
+    };
+    return slab;
+}
+
+void
+slab_destroy(struct slab *slab)
+{
+    if (slab == NULL)
+        return;
+
+    list_free(slab->partial);
+    list_free(slab->full);
+    free(slab->spare);
+    free(slab);
+}
+
+static struct chunk *
+chunk_new(struct slab *slab)
+{
+    struct chunk *chunk;
+
+    if (slab->spare != NULL) {
+        chunk = slab->spare;
+        slab->spare = NULL;
+    } else {
+        chunk = xmalloc(sizeof(*chunk) + slab->per_chunk * slab->slot_size);
+        slab->chunk_count++;
+    }
+
+    chunk->prev = chunk->next = NULL;
+    chunk->live = 0;
+    chunk->untouched = 0;
+    chunk->free = NULL;
+    return chunk;
+}
+
+void *
+slab_alloc(struct slab *slab)
+{
+    struct chunk *chunk = slab->partial;
+
+    if (unlikely(chunk == NULL)) {
+        chunk = chunk_new(slab);
+        list_push(&slab->partial, chunk);
+    }
+
+    struct slot *slot;
+
+    if (chunk->free != NULL) {
+        slot = chunk->free;
+        memcpy(&chunk->free, slot->obj, sizeof(chunk->free));
+    } else {
+        xassert(chunk->untouched < slab->per_chunk);
+        slot = (struct slot *)&chunk->data[chunk->untouched++ * slab->slot_size];
+        slot->chunk = chunk;
+    }
+
+    if (++chunk->live == slab->per_chunk) {
+        list_remove(&slab->partial, chunk);
+        list_push(&slab->full, chunk);
+    }
+
+    return slot->obj;
+}
+
+void
+slab_free(struct slab *slab, void *obj)
+{
+    if (obj == NULL)
+        return;
+
+    struct slot *slot = (struct slot *)((uint8_t *)obj - offsetof(struct slot, obj));
+    struct chunk *chunk = slot->chunk;
+
+    xassert(chunk->live > 0);
+
+    if (chunk->live == slab->per_chunk) {
+        list_remove(&slab->full, chunk);
+        list_push(&slab->partial, chunk);
+    }
+
+    memcpy(slot->obj, &chunk->free, sizeof(chunk->free));
+    chunk->free = slot;
+
+    if (--chunk->live > 0)
+        return;
+
+    /* Chunk is completely free; keep one around, release the rest */
+    list_remove(&slab->partial, chunk);
+
+    if (slab->spare == NULL)
+        slab->spare = chunk;
+    else {
+        free(chunk);
+        slab->chunk_count--;
+    }
+}
+
+static void
+list_splice(struct chunk **dst, struct chunk *list)
+{
+    while (list != NULL) {
+        struct chunk *next = list->next;
+        list_push(dst, list);
+        list = next;
+    }
+}
+
+void
+slab_merge(struct slab *dst, struct slab *src)
+{
+    xassert(dst->slot_size == src->slot_size);
+    xassert(dst->per_chunk == src->per_chunk);
+
+    list_splice(&dst->partial, src->partial);
+    list_splice(&dst->full, src->full);
+    dst->chunk_count += src->chunk_count;
+
+    if (src->spare != NULL) {
+        if (dst->spare == NULL)
+            dst->spare = src->spare;
+        else {
+            free(src->spare);
+            dst->chunk_count--;
+        }
+    }
+
+    free(src);
+}
+
+size_t
+slab_size(const struct slab *slab)
+{
+    return slab->chunk_count *
+        (sizeof(struct chunk) + slab->per_chunk * slab->slot_size);
+}
+
+UNITTEST
+{
+    struct slab *slab = slab_init(100, 4);
+    void *objs[10];
+
+    for (size_t i = 0; i < ALEN(objs); i++) {
+        objs[i] = slab_alloc(slab);
+        xassert(((uintptr_t)objs[i] & (alignof(void *) - 1)) == 0);
+        memset(objs[i], (int)i, 100);
+    }
+
+    xassert(slab->chunk_count == 3);
+
+    for (size_t i = 0; i < ALEN(objs); i++) {
+        const uint8_t *p = objs[i];
+        for (size_t j = 0; j < 100; j++)
+            xassert(p[j] == i);
+    }
+
+    /* Free the first chunk completely; it becomes the spare */
+    for (size_t i = 0; i < 4; i++)
+        slab_free(slab, objs[i]);
+    xassert(slab->spare != NULL);
+    xassert(slab->chunk_count == 3);
+
+    /* Free the second chunk; it is released */
+    for (size_t i = 4; i < 8; i++)
+        slab_free(slab, objs[i]);
+    xassert(slab->chunk_count == 2);
+
+    /* Freed slots are re-used */
+    slab_free(slab, objs[8]);
+    xassert(slab_alloc(slab) == objs[8]);
+
+    slab_free(slab, objs[8]);
+    slab_free(slab, objs[9]);
+    xassert(slab->partial == NULL);
+    xassert(slab->full == NULL);
+
+    slab_destroy(slab);
+}
+
+UNITTEST
+{
+    struct slab *dst = slab_init(32, 2);
+    struct slab *src = slab_init(32, 2);
+
+    void *a = slab_alloc(dst);
+    void *b = slab_alloc(src);
+    void *c = slab_alloc(src);
+    void *d = slab_alloc(src);
+
+    slab_merge(dst, src);
+    xassert(dst->chunk_count == 3);
+
+    /* Objects allocated from 'src' can be free:d to 'dst' */
+    slab_free(dst, b);
+    slab_free(dst, c);
+    slab_free(dst, d);
+    slab_free(dst, a);
+
+    xassert(dst->partial == NULL);
+    xassert(dst->full == NULL);
+    xassert(dst->spare != NULL);
+    xassert(dst->chunk_count == 1);
+
+    slab_destroy(dst);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Fixed size object allocator. Objects are pointer aligned.
+ *
+ * Objects are carved out of large chunks. Freed objects are put on
+ * their chunk's free list, and re-used by subsequent allocations. A
+ * chunk is released when all its objects have been freed (except for
+ * a single, spare, chunk that is kept around to avoid thrashing).
+ *
+ * Destroying the slab releases all chunks in one go; it is up to the
+ * caller to ensure there are no live objects left.
+ *
+ * Not thread safe.
+ */
+struct slab;
+
+struct slab *slab_init(size_t obj_size, size_t objs_per_chunk);
+void slab_destroy(struct slab *slab);
+
+void *slab_alloc(struct slab *slab);
+void slab_free(struct slab *slab, void *obj);
+
+/*
+ * Moves all chunks (and thus all live objects) from 'src' to 'dst',
+ * and destroys 'src'. Both slabs must have the same object size, and
+ * number of objects per chunk.
+ */
+void slab_merge(struct slab *dst, struct slab *src);
+
+/* Total number of bytes allocated by the slab, including free slots */
+size_t slab_size(const struct slab *slab);
@@ -0,0 +1,394 @@
+#include "spill.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define LOG_MODULE "spill"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+
+struct segment {
+    uint8_t *data;
+    size_t size;
+    size_t used;
+    size_t first;  /* Index of the first blob in this segment */
+};
+
+/* Seconds to wait, after a failed segment creation, before retrying */
+#define SPILL_RETRY_INTERVAL 30
+
+struct spill {
+    char *dir;
+    size_t segment_size;
+    size_t max_size;     /* 0: unlimited */
+    size_t mapped_size;  /* Total size of all segments */
+
+    struct segment *segments;
+    size_t segment_count;
+
+    /* Offset, within its segment, of each blob */
+    uint32_t *offsets;
+    size_t count;
+    size_t size;
+
+    /* Don't retry (and log) a failed segment creation right away */
+    bool failed;
+    struct timespec retry_at;
+};
+
+struct spill *
+spill_init(const char *dir, size_t segment_size, size_t max_size)
+{
+    xassert(segment_size > 0 && segment_size <= UINT32_MAX);
+
+    struct spill *spill = xmalloc(sizeof(*spill));
+    *spill = (struct spill){
+        .dir = xstrdup(dir),
+        .segment_size = segment_size,
+        .max_size = max_size,
+    };
+    return spill;
+}
+
+void
+spill_reset(struct spill *spill)
+{
+    for (size_t i = 0; i < spill->segment_count; i++)
+        munmap(spill->segments[i].data, spill->segments[i].size);
+
+    free(spill->segments);
+    free(spill->offsets);
+
+    spill->segments = NULL;
+    spill->segment_count = 0;
+    spill->mapped_size = 0;
+    spill->offsets = NULL;
+    spill->count = spill->size = 0;
+    spill->failed = false;
+}
+
+void
+spill_truncate(struct spill *spill, size_t count)
+{
+    xassert(count <= spill->count);
+
+    if (count == 0) {
+        spill_reset(spill);
+        return;
+    }
+
+    /* Release the segments holding only discarded blobs */
+    size_t end = spill->count;  /* End of the last remaining segment */
+
+    while (spill->segments[spill->segment_count - 1].first >= count) {
+        struct segment *seg = &spill->segments[--spill->segment_count];
+        end = seg->first;
+
+        munmap(seg->data, seg->size);
+        spill->mapped_size -= seg->size;
+    }
+
+    if (count < end) {
+        struct segment *seg = &spill->segments[spill->segment_count - 1];
+        seg->used = spill->offsets[count];
+    }
+
+    spill->count = count;
+}
+
+/* Releases the oldest segment, and thus the oldest blobs */
+static void
+drop_oldest_segment(struct spill *spill)
+{
+    xassert(spill->segment_count > 0);
+
+    if (spill->segment_count == 1) {
+        spill_reset(spill);
+        return;
+    }
+
+    struct segment *seg = &spill->segments[0];
+    const size_t dropped = spill->segments[1].first;
+
+    LOG_DBG("dropping %zu spilled blobs (%zu bytes)", dropped, seg->size);
+
+    munmap(seg->data, seg->size);
+    spill->mapped_size -= seg->size;
+
+    memmove(&spill->segments[0], &spill->segments[1],
+            (spill->segment_count - 1) * sizeof(spill->segments[0]));
+    spill->segment_count--;
+
+    for (size_t i = 0; i < spill->segment_count; i++)
+        spill->segments[i].first -= dropped;
+
+    memmove(&spill->offsets[0], &spill->offsets[dropped],
+            (spill->count - dropped) * sizeof(spill->offsets[0]));
+    spill->count -= dropped;
+}
+
+void
+spill_destroy(struct spill *spill)
+{
+    if (spill == NULL)
+        return;
+
+    spill_reset(spill);
+    free(spill->dir);
+    free(spill);
+}
+
+static struct segment *
+segment_new(struct spill *spill, size_t min_size)
+{
+    const size_t size = max(spill->segment_size, min_size);
+    xassert(size <= UINT32_MAX);
+
+    char *path = xstrjoin(spill->dir, "/foot-scrollback-XXXXXX");
+    int fd = mkostemp(path, O_CLOEXEC);
+
+    if (fd < 0) {
+        LOG_ERRNO("%s: failed to create scrollback spill file", path);
+        free(path);
+        return NULL;
+    }
+
+    /* We only need the file while it's mapped */
+    unlink(path);
+
+    /*
+     * Allocate the disk space up front; running out of space while
+     * writing to the mapping would result in a SIGBUS
+     */
+    int err = posix_fallocate(fd, 0, size);
+    if (err != 0) {
+        LOG_ERRNO_P(err, "%s: failed to allocate scrollback spill file", path);
+        close(fd);
+        free(path);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        LOG_ERRNO("%s: failed to mmap scrollback spill file", path);
+        free(path);
+        return NULL;
+    }
+
+    LOG_DBG("%s: new segment, %zu bytes", path, size);
+    free(path);
+
+    spill->segments = xrealloc(
+        spill->segments,
+        (spill->segment_count + 1) * sizeof(spill->segments[0]));
+
+    struct segment *seg = &spill->segments[spill->segment_count++];
+    *seg = (struct segment){
+        .data = data,
+        .size = size,
+        .first = spill->count,
+    };
+
+    spill->mapped_size += size;
+    return seg;
+}
+
+static bool
+retry_is_due(const struct spill *spill)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec > spill->retry_at.tv_sec ||
+        (now.tv_sec == spill->retry_at.tv_sec &&
+         now.tv_nsec >= spill->retry_at.tv_nsec);
+}
+
+void *
+spill_append(struct spill *spill, size_t size)
+{
+    struct segment *seg = spill->segment_count > 0
+        ? &spill->segments[spill->segment_count - 1]
+        : NULL;
+
+    if (seg == NULL || seg->size - seg->used < size) {
+        if (spill->failed && !retry_is_due(spill))
+            return NULL;
+
+        /* Make room, by dropping the oldest blobs */
+        const size_t seg_size = max(spill->segment_size, size);
+        while (spill->max_size > 0 && spill->segment_count > 0 &&
+               spill->mapped_size + seg_size > spill->max_size)
+        {
+            drop_oldest_segment(spill);
+        }
+
+        seg = segment_new(spill, size);
+        if (seg == NULL) {
+            if (!spill->failed) {
+                LOG_WARN("scrollback spilling disabled for %ds; "
+                         "scrollback lines are discarded instead",
+                         SPILL_RETRY_INTERVAL);
+            }
+
+            spill->failed = true;
+            clock_gettime(CLOCK_MONOTONIC, &spill->retry_at);
+            spill->retry_at.tv_sec += SPILL_RETRY_INTERVAL;
+            return NULL;
+        }
+
+        if (spill->failed) {
+            LOG_INFO("scrollback spilling re-enabled");
+            spill->failed = false;
+        }
+    }
+
+    if (spill->count >= spill->size) {
+        spill->size = spill->size > 0 ? spill->size * 2 : 1024;
+        spill->offsets = xrealloc(
+            spill->offsets, spill->size * sizeof(spill->offsets[0]));
+    }
+
+    void *ptr = &seg->data[seg->used];
+    spill->offsets[spill->count++] = seg->used;
+    seg->used += size;
+    return ptr;
+}
+
+size_t
+spill_count(const struct spill *spill)
+{
+    return spill->count;
+}
+
+const void *
+spill_get(const struct spill *spill, size_t idx, size_t *size)
+{
+    xassert(idx < spill->count);
+
+    /* Find the last segment starting at, or before, 'idx' */
+    size_t lo = 0;
+    size_t hi = spill->segment_count;
+
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (spill->segments[mid].first <= idx)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const struct segment *seg = &spill->segments[lo];
+    const size_t seg_end = lo + 1 < spill->segment_count
+        ? spill->segments[lo + 1].first
+        : spill->count;
+
+    xassert(idx >= seg->first);
+    xassert(idx < seg_end);
+
+    const size_t start = spill->offsets[idx];
+    const size_t end = idx + 1 < seg_end ? spill->offsets[idx + 1] : seg->used;
+
+    *size = end - start;
+    return &seg->data[start];
+}
+
+UNITTEST
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char *dir = xstrjoin(
+        tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp",
+        "/foot-spill-test-XXXXXX");
+    xassert(mkdtemp(dir) != NULL);
+
+    struct spill *spill = spill_init(dir, 4096, 0);
+
+    /* Fill a couple of segments, with blobs of varying sizes */
+    for (size_t i = 0; i < 1000; i++) {
+        const size_t size = i % 37;
+        uint8_t *blob = spill_append(spill, size);
+        xassert(blob != NULL);
+        memset(blob, (int)i, size);
+    }
+
+    /* Larger than a segment */
+    uint8_t *large = spill_append(spill, 3 * 4096);
+    xassert(large != NULL);
+    memset(large, 0xaa, 3 * 4096);
+
+    xassert(spill_count(spill) == 1001);
+    xassert(spill->segment_count > 2);
+
+    for (size_t i = 0; i < 1000; i++) {
+        size_t size;
+        const uint8_t *blob = spill_get(spill, i, &size);
+        xassert(size == i % 37);
+        for (size_t j = 0; j < size; j++)
+            xassert(blob[j] == (uint8_t)i);
+    }
+
+    size_t size;
+    const uint8_t *blob = spill_get(spill, 1000, &size);
+    xassert(size == 3 * 4096);
+    xassert(blob[0] == 0xaa && blob[size - 1] == 0xaa);
+
+    /* Truncate in the middle of a segment... */
+    spill_truncate(spill, 500);
+    xassert(spill_count(spill) == 500);
+    blob = spill_get(spill, 499, &size);
+    xassert(size == 499 % 37);
+    xassert(size == 0 || blob[size - 1] == (uint8_t)499);
+
+    /* ...and the space after it is re-used */
+    uint8_t *again = spill_append(spill, 5);
+    xassert(again != NULL);
+    memset(again, 0x55, 5);
+    blob = spill_get(spill, 500, &size);
+    xassert(size == 5 && blob == again);
+
+    spill_reset(spill);
+    xassert(spill_count(spill) == 0);
+    xassert(spill_append(spill, 10) != NULL);
+    xassert(spill_count(spill) == 1);
+
+    spill_destroy(spill);
+
+    /* With a size limit, the oldest blobs are dropped */
+    spill = spill_init(dir, 4096, 3 * 4096);
+
+    for (size_t i = 0; i < 4000; i++) {
+        uint8_t *b = spill_append(spill, 16);
+        xassert(b != NULL);
+        memset(b, (int)i, 16);
+    }
+
+    xassert(spill->mapped_size <= 3 * 4096);
+    xassert(spill_count(spill) < 4000);
+    xassert(spill_count(spill) >= 2 * 4096 / 16);
+
+    /* The newest blobs are kept */
+    const size_t count = spill_count(spill);
+    for (size_t i = 0; i < count; i++) {
+        blob = spill_get(spill, i, &size);
+        xassert(size == 16);
+        xassert(blob[0] == (uint8_t)(4000 - count + i));
+    }
+
+    spill_destroy(spill);
+
+    xassert(rmdir(dir) == 0);
+    free(dir);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Append-only, disk backed, store of variable sized blobs (spilled
+ * scrollback rows).
+ *
+ * Blobs are appended to memory mapped segment files, created (and
+ * immediately unlinked) in a user specified directory. A blob is
+ * identified by its index; the oldest blob has index 0.
+ *
+ * Not thread safe.
+ */
+struct spill;
+
+/*
+ * 'dir' is the directory in which segment files are created. Blobs
+ * larger than 'segment_size' get a segment of their own.
+ *
+ * 'max_size' limits the total size of all segments; when reached,
+ * the oldest segment, and thus the oldest blobs, are dropped to make
+ * room for new ones (shifting the remaining blobs' indices). 0 means
+ * no limit.
+ */
+struct spill *spill_init(const char *dir, size_t segment_size, size_t max_size);
+void spill_destroy(struct spill *spill);
+
+/* Throws away all blobs, and releases all segments */
+void spill_reset(struct spill *spill);
+
+/* Throws away the blobs at, and after, index 'count' */
+void spill_truncate(struct spill *spill, size_t count);
+
+/*
+ * Returns a pointer to 'size' bytes of storage, to be written to by
+ * the caller, or NULL if the storage could not be allocated. After a
+ * failure, no new segments are created for SPILL_RETRY_INTERVAL
+ * seconds (see spill.c).
+ */
+void *spill_append(struct spill *spill, size_t size);
+
+size_t spill_count(const struct spill *spill);
+const void *spill_get(const struct spill *spill, size_t idx, size_t *size);
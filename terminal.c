@@ -7,6 +7,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 
 #include <sys/stat.h>
@@ -31,6 +32,7 @@
 #include "grid.h"
 #include "ime.h"
 #include "input.h"
+#include "misc.h"
 #include "notify.h"
 #include "quirks.h"
 #include "reaper.h"
@@ -40,6 +42,7 @@
 #include "sixel.h"
 #include "slave.h"
 #include "spawn.h"
+#include "spill.h"
 #include "url-mode.h"
 #include "util.h"
 #include "vt.h"
@@ -234,6 +237,25 @@ static struct timespec last = {0};
 
 static bool cursor_blink_rearm_timer(struct terminal *term);
 
+#define PTMX_READ_BUF_MIN_SIZE (24 * 1024)
+#define PTMX_READ_BUF_MAX_SIZE (512 * 1024)
+
+/* Parser statistics; only collected in foot-bench builds */
+#if defined(FOOT_BENCH)
+    #define stats_add(term, stat, n) ((term)->stats.stat += (n))
+#else
+    #define stats_add(term, stat, n) ((void)0)
+#endif
+
+static void
+ptmx_read_buf_resize(struct terminal *term, size_t size)
+{
+    /* Contents need not be preserved */
+    free(term->ptmx_read_buf.data);
+    term->ptmx_read_buf.data = xmalloc(size);
+    term->ptmx_read_buf.size = size;
+}
+
 /* Externally visible, but not declared in terminal.h, to enable pgo
  * to call this function directly */
 bool
@@ -266,12 +288,38 @@ fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
         return true;
     }
 
-    uint8_t buf[24 * 1024];
-    const size_t max_iterations = !hup ? 10 : SIZE_MAX;
+    if (unlikely(term->ptmx_read_buf.data == NULL))
+        ptmx_read_buf_resize(term, PTMX_READ_BUF_MIN_SIZE);
+
+    /*
+     * Keep reading until the PTY has been drained, our time budget
+     * has been exhausted, or other FDs are waiting to be
+     * serviced. Note that we always do at least one read.
+     *
+     * On HUP, read everything that is left.
+     */
+    const uint64_t budget_ns = term->conf->tweak.ptmx_read_budget_ns;
+    size_t largest_read = 0;
 
-    for (size_t i = 0; i < max_iterations && pollin; i++) {
-        xassert(pollin);
-        ssize_t count = read(term->ptmx, buf, sizeof(buf));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; pollin; i++) {
+        if (i > 0 && !hup) {
+            if (fdm_pending_events(fdm) > 0)
+                break;
+
+            struct timespec now, elapsed;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timespec_sub(&now, &start, &elapsed);
+
+            if ((uint64_t)elapsed.tv_sec * 1000000000 + elapsed.tv_nsec >= budget_ns)
+                break;
+        }
+
+        uint8_t *const buf = term->ptmx_read_buf.data;
+        const size_t size = term->ptmx_read_buf.size;
+        ssize_t count = read(term->ptmx, buf, size);
 
         if (count < 0) {
             if (errno == EAGAIN || errno == EIO) {
@@ -291,6 +339,22 @@ fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
 
         xassert(term->interactive_resizing.grid == NULL);
         vt_from_slave(term, buf, count);
+
+        largest_read = max(largest_read, (size_t)count);
+
+        if ((size_t)count == size && size < PTMX_READ_BUF_MAX_SIZE) {
+            /* Client is producing data faster than we're consuming it */
+            ptmx_read_buf_resize(term, min(size * 2, PTMX_READ_BUF_MAX_SIZE));
+        }
+    }
+
+    if (largest_read > 0 &&
+        largest_read < term->ptmx_read_buf.size / 4 &&
+        term->ptmx_read_buf.size > PTMX_READ_BUF_MIN_SIZE)
+    {
+        /* Client has calmed down - release some memory */
+        ptmx_read_buf_resize(
+            term, max(term->ptmx_read_buf.size / 2, PTMX_READ_BUF_MIN_SIZE));
     }
 
     if (!term->render.app_sync_updates.enabled) {
@@ -668,47 +732,22 @@ initialize_render_workers(struct terminal *term)
 {
     LOG_INFO("using %hu rendering threads", term->render.workers.count);
 
-    if (sem_init(&term->render.workers.start, 0, 0) < 0 ||
-        sem_init(&term->render.workers.done, 0, 0) < 0)
-    {
-        LOG_ERRNO("failed to instantiate render worker semaphores");
-        return false;
-    }
-
     int err;
     if ((err = mtx_init(&term->render.workers.lock, mtx_plain)) != thrd_success) {
         LOG_ERR("failed to instantiate render worker mutex: %s (%d)",
                 thrd_err_as_string(err), err);
-        goto err_sem_destroy;
+        return false;
     }
 
-    term->render.workers.threads = xcalloc(
-        term->render.workers.count, sizeof(term->render.workers.threads[0]));
-
-    for (size_t i = 0; i < term->render.workers.count; i++) {
-        struct render_worker_context *ctx = xmalloc(sizeof(*ctx));
-        *ctx = (struct render_worker_context) {
-            .term = term,
-            .my_id = 1 + i,
-        };
-
-        int ret = thrd_create(
-            &term->render.workers.threads[i], &render_worker_thread, ctx);
-        if (ret != thrd_success) {
+    if (term->render.workers.count == 0)
+        return true;
 
-            LOG_ERR("failed to create render worker thread: %s (%d)",
-                    thrd_err_as_string(ret), ret);
-            term->render.workers.threads[i] = 0;
-            return false;
-        }
-    }
+    /* The threads themselves are shared with all other terminals */
+    if (!render_workers_acquire(term->render.workers.count))
+        return false;
 
+    term->render.workers.acquired = true;
     return true;
-
-err_sem_destroy:
-    sem_destroy(&term->render.workers.start);
-    sem_destroy(&term->render.workers.done);
-    return false;
 }
 
 static void
@@ -785,6 +824,8 @@ term_set_fonts(struct terminal *term, struct fcft_font *fonts[static 4],
     free_custom_glyphs(
         &term->custom_glyphs.legacy, GLYPH_LEGACY_COUNT);
 
+    render_reset_glyph_caches(term);
+
     const struct config *conf = term->conf;
 
     const struct fcft_glyph *M = fcft_rasterize_char_utf32(
@@ -1101,6 +1142,30 @@ static void fdm_client_terminated(
 
 static const int PTY_OPEN_FLAGS = O_RDWR | O_NOCTTY;
 
+static struct spill *
+scrollback_spill_init(const struct config *conf)
+{
+    if (!conf->scrollback.spill.enabled)
+        return NULL;
+
+    /*
+     * Not $XDG_RUNTIME_DIR; it is usually a (size limited) tmpfs,
+     * i.e. RAM, which defeats the purpose of spilling
+     */
+    const char *dir = conf->scrollback.spill.directory;
+    if (dir == NULL || dir[0] == '\0')
+        dir = getenv("XDG_CACHE_HOME");
+    if (dir == NULL || dir[0] == '\0')
+        dir = "/var/tmp";
+
+    const size_t max_size = (size_t)conf->scrollback.spill.limit * 1024 * 1024;
+    const size_t segment_size = max_size > 0
+        ? min(max_size, 16 * 1024 * 1024)
+        : 16 * 1024 * 1024;
+
+    return spill_init(dir, segment_size, max_size);
+}
+
 struct terminal *
 term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
           struct wayland *wayl, const char *foot_exe, const char *cwd,
@@ -1262,8 +1327,13 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         },
         .normal = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
         .alt = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
+        .spill = scrollback_spill_init(conf),
+        .reflow = {
+            .timer_fd = -1,
+        },
         .grid = &term->normal,
         .composed = NULL,
+        .hyperlinks = hyperlinks_init(),
         .alt_scrolling = conf->mouse.alternate_scroll_mode,
         .meta = {
             .esc_prefix = true,
@@ -1295,6 +1365,15 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
                 .count = conf->render_worker_count,
                 .queue = tll_init(),
             },
+            .glyph_caches = xcalloc(
+                1 + conf->render_worker_count,
+                sizeof(term->render.glyph_caches[0])),
+            .color_caches = xcalloc(
+                1 + conf->render_worker_count,
+                sizeof(term->render.color_caches[0])),
+            .glyph_bufs = xcalloc(
+                1 + conf->render_worker_count,
+                sizeof(term->render.glyph_bufs[0])),
         },
         .delayed_render_timer = {
             .is_armed = false,
@@ -1624,6 +1703,7 @@ term_shutdown(struct terminal *term)
     xassert(term->cursor_blink.fd < 0);
 
     fdm_del(term->fdm, term->selection.auto_scroll.fd);
+    fdm_del(term->fdm, term->reflow.timer_fd);
     fdm_del(term->fdm, term->render.app_sync_updates.timer_fd);
     fdm_del(term->fdm, term->render.app_id.timer_fd);
     fdm_del(term->fdm, term->render.title.timer_fd);
@@ -1675,6 +1755,7 @@ term_shutdown(struct terminal *term)
     }
 
     term->selection.auto_scroll.fd = -1;
+    term->reflow.timer_fd = -1;
     term->render.app_sync_updates.timer_fd = -1;
     term->render.app_id.timer_fd = -1;
     term->render.title.timer_fd = -1;
@@ -1729,6 +1810,7 @@ term_destroy(struct terminal *term)
     del_utmp_record(term->conf, term->reaper, term->ptmx);
 
     fdm_del(term->fdm, term->selection.auto_scroll.fd);
+    fdm_del(term->fdm, term->reflow.timer_fd);
     fdm_del(term->fdm, term->render.app_sync_updates.timer_fd);
     fdm_del(term->fdm, term->render.app_id.timer_fd);
     fdm_del(term->fdm, term->render.title.timer_fd);
@@ -1746,31 +1828,20 @@ term_destroy(struct terminal *term)
         term->window = NULL;
     }
 
-    mtx_lock(&term->render.workers.lock);
-    xassert(tll_length(term->render.workers.queue) == 0);
-
-    /* Count livinig threads - we may get here when only some of the
-     * threads have been successfully started */
-    size_t worker_count = 0;
-    if (term->render.workers.threads != NULL) {
-        for (size_t i = 0; i < term->render.workers.count; i++, worker_count++) {
-            if (term->render.workers.threads[i] == 0)
-                break;
-        }
-
-        for (size_t i = 0; i < worker_count; i++) {
-            sem_post(&term->render.workers.start);
-            tll_push_back(term->render.workers.queue, -2);
-        }
-    }
-    mtx_unlock(&term->render.workers.lock);
-
     key_binding_unref(term->wl->key_binding_manager, term->conf);
 
     urls_reset(term);
 
+    if (term->sgr_cache.hits + term->sgr_cache.misses > 0) {
+        LOG_DBG("SGR cache: %"PRIu64" hits, %"PRIu64" misses (%.1f%% hit rate)",
+                term->sgr_cache.hits, term->sgr_cache.misses,
+                100. * term->sgr_cache.hits /
+                (term->sgr_cache.hits + term->sgr_cache.misses));
+    }
+
     free(term->vt.osc.data);
-    free(term->vt.osc8.uri);
+    hyperlink_unref(term->vt.osc8.link);
+    free(term->ptmx_read_buf.data);
 
     composed_free(term->composed);
 
@@ -1794,16 +1865,18 @@ term_destroy(struct terminal *term)
     free(term->search.buf);
     free(term->search.last.buf);
 
-    if (term->render.workers.threads != NULL) {
-        for (size_t i = 0; i < term->render.workers.count; i++) {
-            if (term->render.workers.threads[i] != 0)
-                thrd_join(term->render.workers.threads[i], NULL);
-        }
+    if (term->render.workers.acquired)
+        render_workers_release();
+    render_reset_glyph_caches(term);
+    free(term->render.glyph_caches);
+    render_reset_color_caches(term);
+    free(term->render.color_caches);
+    if (term->render.glyph_bufs != NULL) {
+        for (size_t i = 0; i < 1 + term->render.workers.count; i++)
+            free(term->render.glyph_bufs[i]);
+        free(term->render.glyph_bufs);
     }
-    free(term->render.workers.threads);
     mtx_destroy(&term->render.workers.lock);
-    sem_destroy(&term->render.workers.start);
-    sem_destroy(&term->render.workers.done);
     xassert(tll_length(term->render.workers.queue) == 0);
     tll_free(term->render.workers.queue);
 
@@ -1843,8 +1916,10 @@ term_destroy(struct terminal *term)
 
     grid_free(&term->normal);
     grid_free(&term->alt);
+    spill_destroy(term->spill);
     grid_free(term->interactive_resizing.grid);
     free(term->interactive_resizing.grid);
+    hyperlinks_destroy(term->hyperlinks);
 
     free(term->foot_exe);
     free(term->cwd);
@@ -1965,6 +2040,9 @@ erase_cell_range(struct terminal *term, struct row *row, int start, int end)
     } else
         memset(&row->cells[start], 0, (end - start + 1) * sizeof(row->cells[0]));
 
+    if (end + 1 >= row->used)
+        row->used = min(row->used, start);
+
     if (unlikely(row->extra != NULL)) {
         grid_row_uri_range_erase(row, start, end);
         grid_row_underline_range_erase(row, start, end);
@@ -2018,7 +2096,7 @@ term_reset(struct terminal *term, bool hard)
     term->scroll_region.start = 0;
     term->scroll_region.end = term->rows;
 
-    free(term->vt.osc8.uri);
+    hyperlink_unref(term->vt.osc8.link);
     free(term->vt.osc.data);
 
     term->vt = (struct vt){
@@ -2076,6 +2154,7 @@ term_reset(struct terminal *term, bool hard)
     term->colors.use_custom_selection = term->conf->colors.use_custom.selection;
     memcpy(term->colors.table, term->conf->colors.table,
            sizeof(term->colors.table));
+    term_colors_changed(term);
     free(term->color_stack.stack);
     term->color_stack.stack = NULL;
     term->color_stack.size = 0;
@@ -2106,6 +2185,7 @@ term_reset(struct terminal *term, bool hard)
         grid_row_free(term->normal.rows[i]);
         term->normal.rows[i] = NULL;
     }
+    grid_reflow_discard(&term->normal);
     for (size_t i = term->rows; i < term->alt.num_rows; i++) {
         grid_row_free(term->alt.rows[i]);
         term->alt.rows[i] = NULL;
@@ -2416,10 +2496,18 @@ term_damage_margins(struct terminal *term)
     term->render.margins = true;
 }
 
+void
+term_colors_changed(struct terminal *term)
+{
+    /* Invalidates the renderer's resolved colors */
+    term->render.color_generation++;
+}
+
 void
 term_damage_color(struct terminal *term, enum color_source src, int idx)
 {
     xassert(src == COLOR_DEFAULT || src == COLOR_BASE256);
+    term_colors_changed(term);
 
     for (int r = 0; r < term->rows; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
@@ -2639,6 +2727,10 @@ term_erase_scrollback(struct terminal *term)
             break;
     }
 
+    if (term->spill != NULL && term->grid == &term->normal)
+        spill_reset(term->spill);
+
+    grid_reflow_discard(term->grid);
     term->grid->view = term->grid->offset;
 
 #if defined(_DEBUG)
@@ -2940,6 +3032,215 @@ selection_on_bottom_region(const struct terminal *term,
         selection_on_rows(term, region.end, term->rows - 1);
 }
 
+/* Number of (old) rows reflowed by each idle slice */
+#define REFLOW_SLICE_ROWS 1024
+
+static bool
+fdm_reflow_timer(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+
+    uint64_t expiration_count;
+    ssize_t ret = read(
+        term->reflow.timer_fd, &expiration_count, sizeof(expiration_count));
+
+    if (ret < 0) {
+        if (errno == EAGAIN)
+            return true;
+
+        LOG_ERRNO("failed to read scrollback reflow timer");
+        return false;
+    }
+
+    term_reflow_step(term);
+
+    /*
+     * The reflowed rows are prepended to the scrollback; the view's
+     * rows are unchanged, but the scrollback position indicator
+     * isn't. It's only shown when the view has been scrolled
+     */
+    if (term->grid->view != term->grid->offset)
+        render_refresh(term);
+
+    return true;
+}
+
+static void
+reflow_timer_stop(struct terminal *term)
+{
+    fdm_del(term->fdm, term->reflow.timer_fd);
+    term->reflow.timer_fd = -1;
+}
+
+void
+term_reflow_schedule(struct terminal *term)
+{
+    if (!grid_reflow_is_pending(&term->normal))
+        return;
+
+    if (term->reflow.timer_fd < 0) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (fd < 0) {
+            LOG_ERRNO("failed to create scrollback reflow timer");
+            goto err;
+        }
+
+        if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_reflow_timer, term)) {
+            close(fd);
+            goto err;
+        }
+
+        term->reflow.timer_fd = fd;
+    }
+
+    /* One slice every millisecond, starting right away */
+    const struct itimerspec timer = {
+        .it_value = {.tv_nsec = 1},
+        .it_interval = {.tv_nsec = 1000000},
+    };
+
+    if (timerfd_settime(term->reflow.timer_fd, 0, &timer, NULL) < 0) {
+        LOG_ERRNO("failed to arm scrollback reflow timer");
+        goto err;
+    }
+
+    return;
+
+err:
+    term_reflow_finish(term);
+}
+
+bool
+term_reflow_step(struct terminal *term)
+{
+    const bool compress = term->conf->scrollback.compress_after > 0;
+    if (grid_reflow_step(&term->normal, REFLOW_SLICE_ROWS, compress))
+        return true;
+
+    reflow_timer_stop(term);
+    return false;
+}
+
+void
+term_reflow_finish(struct terminal *term)
+{
+    const bool compress = term->conf->scrollback.compress_after > 0;
+    while (grid_reflow_step(&term->normal, INT_MAX, compress))
+        ;
+    reflow_timer_stop(term);
+}
+
+/* Number of spilled rows paged in at a time */
+#define SPILL_PAGE_IN_ROWS 1024
+
+int
+term_spill_page_in(struct terminal *term, size_t tracking_points_count,
+                   struct coord *const tracking_points[])
+{
+    if (term->spill == NULL || spill_count(term->spill) == 0)
+        return 0;
+    if (term->grid != &term->normal)
+        return 0;
+
+    /* These hold absolute row numbers we don't track */
+    if (term->interactive_resizing.grid != NULL || urls_mode_is_active(term))
+        return 0;
+
+    /* Not-yet-reflowed rows are newer than the spilled ones */
+    if (grid_reflow_is_pending(&term->normal))
+        term_reflow_finish(term);
+
+    struct grid *grid = &term->normal;
+
+    /*
+     * Paging in may double the ring, up to twice the size needed by
+     * the configured scrollback, unless that would exceed the
+     * memory budget
+     */
+    const size_t max_bytes =
+        (size_t)term->conf->scrollback.memory_limit * 1024 * 1024;
+    const int max_ring_rows =
+        max_bytes > 0 && grid_memory_usage(grid) * 2 > max_bytes
+            ? grid->num_rows
+            : 2 * grid_max_rows(term->rows, term->render.scrollback_lines);
+
+    struct coord original_view = {.row = term->search.original_view};
+    struct coord *const own_tracking_points[] = {
+        &term->selection.coords.start,
+        &term->selection.coords.end,
+        &term->selection.pivot.start,
+        &term->selection.pivot.end,
+        &term->search.match,
+        &original_view,
+    };
+
+    const size_t count = ALEN(own_tracking_points) + tracking_points_count;
+    struct coord **all_tracking_points = xmalloc(
+        count * sizeof(all_tracking_points[0]));
+
+    memcpy(all_tracking_points, own_tracking_points,
+           sizeof(own_tracking_points));
+    for (size_t i = 0; i < tracking_points_count; i++)
+        all_tracking_points[ALEN(own_tracking_points) + i] = tracking_points[i];
+
+    const int paged_in = grid_spill_page_in(
+        grid, term->rows, term->spill, term->hyperlinks,
+        SPILL_PAGE_IN_ROWS, max_ring_rows,
+        term->conf->scrollback.compress_after > 0,
+        count, all_tracking_points);
+
+    free(all_tracking_points);
+    term->search.original_view = original_view.row;
+
+    if (paged_in > 0) {
+        LOG_DBG("paged in %d spilled rows (%zu left)",
+                paged_in, spill_count(term->spill));
+        term_damage_view(term);
+        render_refresh(term);
+    }
+
+    return paged_in;
+}
+
+/*
+ * Writes the scrollback lines about to be recycled by a scroll of
+ * 'rows' lines to disk. Spilled lines are free:d, and re-allocated
+ * when scrolled in again.
+ */
+static void
+spill_scrollback(struct terminal *term, int rows)
+{
+    struct grid *grid = term->grid;
+
+    /* With a tiny scrollback, the scroll may wrap around into the
+     * screen. Those rows aren't scrollback, and are never spilled */
+    const int count = min(rows, grid->num_rows - term->rows);
+
+    for (int r = 0; r < count; r++) {
+        const int abs_row = grid_row_absolute(grid, term->rows + r);
+        struct row *row = grid->rows[abs_row];
+
+        if (row == NULL)
+            continue;
+
+        /* The ring is full; there's no room for not-yet-reflowed
+         * (older) rows, and they must not be spilled after this one */
+        grid_reflow_discard(grid);
+
+        if (!grid_row_spill(term->spill, row, grid->num_cols))
+            return;
+
+        if (term->render.last_cursor.row == row)
+            term->render.last_cursor.row = NULL;
+
+        grid_row_free(row);
+        grid->rows[abs_row] = NULL;
+    }
+}
+
 void
 term_scroll_partial(struct terminal *term, struct scroll_region region, int rows)
 {
@@ -2949,6 +3250,18 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
     /* Verify scroll amount has been clamped */
     xassert(rows <= region.end - region.start);
 
+    stats_add(term, lines_scrolled, rows);
+
+    /* Grow the scrollback, instead of recycling its oldest lines */
+    if (term->grid == &term->normal) {
+        grid_grow_for_scroll(
+            term->grid, term->rows, rows, term->render.scrollback_lines,
+            (size_t)term->conf->scrollback.memory_limit * 1024 * 1024);
+    }
+
+    if (unlikely(term->spill != NULL) && term->grid == &term->normal)
+        spill_scrollback(term, rows);
+
     /* Cancel selections that cannot be scrolled */
     if (unlikely(term->selection.coords.end.row >= 0)) {
         /*
@@ -2999,6 +3312,51 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
         erase_line(term, row);
     }
 
+    /* Compress the scrollback lines that were pushed past the
+     * compression distance */
+    const int compress_after = term->conf->scrollback.compress_after;
+    if (unlikely(compress_after > 0) && term->grid == &term->normal) {
+        struct grid *grid = term->grid;
+        const int max_depth = grid->num_rows - term->rows;
+
+        /*
+         * Rows in the view are left alone (like
+         * grid_compress_scrollback() does); they would be
+         * uncompressed again by the next frame. The view's top row
+         * is 'view_depth' rows above the screen's top row
+         */
+        const int view_depth = (grid->offset - grid->view) & (grid->num_rows - 1);
+        int skipped_depth = 0;
+
+        for (int r = compress_after + 1;
+             r <= min(compress_after + rows, max_depth);
+             r++)
+        {
+            struct row *row = grid->rows[grid_row_absolute(grid, -r)];
+            if (row == NULL)
+                continue;
+
+            if (r <= view_depth && r > view_depth - term->rows) {
+                skipped_depth = r;
+                continue;
+            }
+
+            grid_row_compress(row, grid->num_cols);
+
+            if (term->render.last_cursor.row == row)
+                term->render.last_cursor.row = NULL;
+        }
+
+        /* Rows uncompressed by e.g. a selection moved up with the rest */
+        if (grid->compress_watermark > compress_after) {
+            grid->compress_watermark = min(
+                grid->compress_watermark + rows, max_depth);
+        }
+
+        /* The skipped rows aren't compressed */
+        grid->compress_watermark = max(grid->compress_watermark, skipped_depth);
+    }
+
     term->grid->cur_row = grid_row(term->grid, term->grid->cursor.point.row);
 
 #if defined(_DEBUG)
@@ -3007,6 +3365,27 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
 #endif
 }
 
+/*
+ * (Re-)compresses scrollback rows that have been uncompressed by
+ * e.g. search, selection or scrollback viewing.
+ */
+void
+term_compress_scrollback(struct terminal *term)
+{
+    const int compress_after = term->conf->scrollback.compress_after;
+    if (compress_after == 0)
+        return;
+
+    grid_compress_scrollback(&term->normal, term->rows, compress_after);
+
+    /* Cursor is never in the scrollback, but be safe */
+    if (term->render.last_cursor.row != NULL &&
+        term->render.last_cursor.row->cells == NULL)
+    {
+        term->render.last_cursor.row = NULL;
+    }
+}
+
 void
 term_scroll(struct terminal *term, int rows)
 {
@@ -3023,6 +3402,8 @@ term_scroll_reverse_partial(struct terminal *term,
     /* Verify scroll amount has been clamped */
     xassert(rows <= region.end - region.start);
 
+    stats_add(term, lines_scrolled, rows);
+
     /* Cancel selections that cannot be scrolled */
     if (unlikely(term->selection.coords.end.row >= 0)) {
         /*
@@ -3717,6 +4098,9 @@ print_insert(struct terminal *term, int width)
         &row->cells[term->grid->cursor.point.col],
         move_count * sizeof(struct cell));
 
+    if (row->used > term->grid->cursor.point.col)
+        row->used = min(row->used + width, term->cols);
+
     /* Mark moved cells as dirty */
     for (size_t i = term->grid->cursor.point.col + width; i < term->cols; i++)
         row->cells[i].attrs.clean = 0;
@@ -3731,6 +4115,7 @@ print_spacer(struct terminal *term, int col, int remaining)
 
     cell->wc = CELL_SPACER + remaining;
     cell->attrs = term->vt.attrs;
+    grid_row_mark_used(row, col + 1);
 }
 
 /*
@@ -3764,8 +4149,8 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
         cell->attrs = attrs;
 
         /* TODO: why do we print the URI here, and then erase it below? */
-        if (unlikely(use_sgr_attrs && term->vt.osc8.uri != NULL)) {
-            grid_row_uri_range_put(row, c, term->vt.osc8.uri, term->vt.osc8.id);
+        if (unlikely(use_sgr_attrs && term->vt.osc8.link != NULL)) {
+            grid_row_uri_range_put(row, c, term->vt.osc8.link);
 
             switch (term->conf->url.osc8_underline) {
             case OSC8_UNDERLINE_ALWAYS:
@@ -3785,8 +4170,11 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
         }
     }
 
+    if (data != 0)
+        grid_row_mark_used(row, c + count);
+
     if (unlikely(row->extra != NULL)) {
-        if (likely(term->vt.osc8.uri != NULL))
+        if (likely(term->vt.osc8.link != NULL))
             grid_row_uri_range_erase(row, c, c + count - 1);
 
         if (likely(term->vt.underline.style <= UNDERLINE_SINGLE &&
@@ -3850,10 +4238,11 @@ term_print(struct terminal *term, char32_t wc, int width)
     struct cell *cell = &row->cells[col];
     cell->wc = term->vt.last_printed = wc;
     cell->attrs = term->vt.attrs;
+    grid_row_mark_used(row, min(col + width, term->cols));
+    stats_add(term, cells_written, width);
 
-    if (term->vt.osc8.uri != NULL) {
-        grid_row_uri_range_put(
-            row, col, term->vt.osc8.uri, term->vt.osc8.id);
+    if (term->vt.osc8.link != NULL) {
+        grid_row_uri_range_put(row, col, term->vt.osc8.link);
 
         switch (term->conf->url.osc8_underline) {
         case OSC8_UNDERLINE_ALWAYS:
@@ -3891,6 +4280,152 @@ term_print(struct terminal *term, char32_t wc, int width)
     grid->cursor.point.col = col;
 }
 
+/*
+ * Updates the row's URI and underline ranges for a run of cells
+ * printed with the current SGR attributes.
+ */
+static inline void
+print_run_update_ranges(struct terminal *term, struct row *row,
+                        int start, int end)
+{
+    if (unlikely(term->vt.osc8.link != NULL)) {
+        grid_row_uri_range_put_span(row, start, end, term->vt.osc8.link);
+    } else if (unlikely(row->extra != NULL))
+        grid_row_uri_range_erase(row, start, end);
+
+    if (unlikely(term->vt.underline.style > UNDERLINE_SINGLE ||
+                 term->vt.underline.color_src != COLOR_DEFAULT))
+    {
+        grid_row_underline_range_put_span(
+            row, start, end, term->vt.underline);
+    } else if (unlikely(row->extra != NULL))
+        grid_row_underline_range_erase(row, start, end);
+}
+
+static void
+print_run(struct terminal *term, const char32_t *wcs, size_t count, int width)
+{
+    xassert(width > 0);
+
+    struct grid *grid = term->grid;
+
+    if (unlikely(term->charsets.set[term->charsets.selected] == CHARSET_GRAPHIC)) {
+        /* Characters may need to be translated; do it the slow way */
+        for (size_t i = 0; i < count; i++)
+            term_print(term, wcs[i], width);
+        return;
+    }
+
+    struct attributes attrs = term->vt.attrs;
+    if (term->vt.osc8.link != NULL &&
+        term->conf->url.osc8_underline == OSC8_UNDERLINE_ALWAYS)
+    {
+        attrs.url = true;
+    }
+
+    while (count > 0) {
+        print_linewrap(term);
+
+        if (unlikely(grid->cursor.lcf)) {
+            /*
+             * Auto-wrap disabled, and we're at the right margin. Each
+             * character overwrites the last cell, meaning only the
+             * last one is going to be visible.
+             */
+            xassert(!term->auto_margin);
+            term_print(term, wcs[count - 1], width);
+            return;
+        }
+
+        int col = grid->cursor.point.col;
+        const size_t fits = (term->cols - col) / width;
+
+        if (unlikely(fits == 0)) {
+            /* Multi-column character that doesn't fit on the current
+             * line. Let term_print() deal with padding and wrapping */
+            term_print(term, *wcs, width);
+            wcs++;
+            count--;
+            continue;
+        }
+
+        const size_t n = min(count, fits);
+        const int cell_count = n * width;
+
+        print_insert(term, cell_count);
+        sixel_overwrite_at_cursor(term, cell_count);
+
+        /* *Must* get current row *after* linewrap+insert */
+        struct row *row = grid->cur_row;
+        row->dirty = true;
+        row->linebreak = true;
+
+        struct cell *cell = &row->cells[col];
+
+        if (likely(width == 1)) {
+            for (size_t i = 0; i < n; i++) {
+                cell[i].wc = wcs[i];
+                cell[i].attrs = attrs;
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                cell->wc = wcs[i];
+                cell->attrs = attrs;
+                cell++;
+
+                for (int j = 1; j < width; j++, cell++) {
+                    cell->wc = CELL_SPACER + width - j;
+                    cell->attrs = term->vt.attrs;
+                }
+            }
+        }
+
+        grid_row_mark_used(row, col + cell_count);
+        term->vt.last_printed = wcs[n - 1];
+        stats_add(term, cells_written, cell_count);
+        print_run_update_ranges(term, row, col, col + cell_count - 1);
+
+        /* Advance cursor */
+        col += cell_count;
+        if (unlikely(col >= term->cols)) {
+            xassert(col == term->cols);
+            grid->cursor.lcf = true;
+            col--;
+        } else
+            xassert(!grid->cursor.lcf);
+
+        grid->cursor.point.col = col;
+
+        wcs += n;
+        count -= n;
+    }
+}
+
+/*
+ * Prints a run of single-column characters, using the current SGR
+ * attributes. Equivalent to calling term_print(term, wc, 1) for each
+ * character, but cells are written row segment by row segment, and
+ * URI/underline ranges are updated once per segment, instead of once
+ * per cell.
+ */
+void
+term_print_run(struct terminal *term, const char32_t *wcs, size_t count)
+{
+    print_run(term, wcs, count, 1);
+}
+
+/*
+ * Like term_print_run(), but for characters that are all 'width'
+ * columns wide (typically CJK). The caller is responsible for
+ * resolving the width (i.e. c32width()).
+ */
+void
+term_print_run_wide(struct terminal *term, const char32_t *wcs, size_t count,
+                    int width)
+{
+    print_run(term, wcs, count, width);
+}
+
 static void
 ascii_printer_generic(struct terminal *term, char32_t wc)
 {
@@ -3919,6 +4454,8 @@ ascii_printer_fast(struct terminal *term, char32_t wc)
     struct cell *cell = &row->cells[col];
     cell->wc = term->vt.last_printed = wc;
     cell->attrs = term->vt.attrs;
+    grid_row_mark_used(row, col + 1);
+    stats_add(term, cells_written, 1);
 
     /* Advance cursor */
     if (unlikely(++col >= term->cols)) {
@@ -3936,6 +4473,106 @@ ascii_printer_fast(struct terminal *term, char32_t wc)
     }
 }
 
+static void
+ascii_printer_fast_run(struct terminal *term, const uint8_t *data, size_t len)
+{
+    struct grid *grid = term->grid;
+
+    xassert(term->charsets.set[term->charsets.selected] == CHARSET_ASCII);
+    xassert(!term->insert_mode);
+    xassert(tll_length(grid->sixel_images) == 0);
+
+    const struct attributes attrs = term->vt.attrs;
+
+    while (len > 0) {
+        print_linewrap(term);
+
+        if (unlikely(grid->cursor.lcf)) {
+            /*
+             * Auto-wrap disabled, and we're at the right margin. Each
+             * character overwrites the last cell, meaning only the
+             * last one is going to be visible.
+             */
+            xassert(!term->auto_margin);
+            data += len - 1;
+            len = 1;
+        }
+
+        /* *Must* get current cell *after* linewrap */
+        int col = grid->cursor.point.col;
+        const int start = col;
+        const size_t count = min(len, (size_t)(term->cols - col));
+
+        struct row *row = grid->cur_row;
+        row->dirty = true;
+        row->linebreak = true;
+
+        struct cell *cell = &row->cells[col];
+        for (size_t i = 0; i < count; i++, cell++) {
+            cell->wc = data[i];
+            cell->attrs = attrs;
+        }
+
+        grid_row_mark_used(row, col + count);
+        term->vt.last_printed = data[count - 1];
+        stats_add(term, cells_written, count);
+
+        /* Advance cursor */
+        col += count;
+        if (unlikely(col >= term->cols)) {
+            xassert(col == term->cols);
+            grid->cursor.lcf = true;
+            col--;
+        } else
+            xassert(!grid->cursor.lcf);
+
+        grid->cursor.point.col = col;
+
+        print_run_update_ranges(term, row, start, start + count - 1);
+
+        data += count;
+        len -= count;
+    }
+}
+
+/*
+ * Prints a run of printable ASCII characters (0x20-0x7e). Equivalent
+ * to calling term->ascii_printer() once for each character, but
+ * cheaper, since cells are written row segment by row segment.
+ */
+void
+term_print_ascii(struct terminal *term, const uint8_t *data, size_t len)
+{
+    if (likely(term->ascii_printer == &ascii_printer_fast)) {
+        ascii_printer_fast_run(term, data, len);
+        return;
+    }
+
+    if (term->ascii_printer == &ascii_printer_generic) {
+        /* E.g. OSC-8 URI, or styled underline active */
+        char32_t wcs[256];
+
+        while (len > 0) {
+            const size_t count = min(len, ALEN(wcs));
+            for (size_t i = 0; i < count; i++)
+                wcs[i] = data[i];
+
+            term_print_run(term, wcs, count);
+            data += count;
+            len -= count;
+        }
+        return;
+    }
+
+    /*
+     * Note: the printer may change while printing (e.g. a single
+     * shift only applies to the first character), so we must
+     * re-load it for each character.
+     */
+    for (size_t i = 0; i < len; i++)
+        term->ascii_printer(term, data[i]);
+}
+
 static void
 ascii_printer_single_shift(struct terminal *term, char32_t wc)
 {
@@ -4002,25 +4639,37 @@ term_surface_kind(const struct terminal *term, const struct wl_surface *surface)
 }
 
 static bool
-rows_to_text(const struct terminal *term, int start, int end,
-             int col_start, int col_end, char **text, size_t *len)
+rows_extract(const struct terminal *term, int start, int end,
+             int col_start, int col_end, struct extraction_context *ctx)
 {
-    struct extraction_context *ctx = extract_begin(SELECTION_NONE, true);
-    if (ctx == NULL)
-        return false;
-
     const int grid_rows = term->grid->num_rows;
     int r = start;
 
-    while (true) {
-        const struct row *row = term->grid->rows[r];
+    /*
+     * Compressed rows are decoded into these, instead of being
+     * uncompressed. The extraction context references the previous
+     * row; alternate between the two
+     */
+    struct row *scratch[2] = {
+        grid_row_alloc(NULL, term->grid->num_cols, false),
+        grid_row_alloc(NULL, term->grid->num_cols, false),
+    };
+    bool ok = true;
+
+    for (size_t i = 0; ok; i++) {
+        const struct row *row = grid_row_abs_peek(
+            term->grid, r, scratch[i % ALEN(scratch)]);
         xassert(row != NULL);
 
         const int c_end = r == end ? col_end : term->cols;
+        const int c_used = max(col_start, min(row->used, c_end));
 
-        for (int c = col_start; c < c_end; c++) {
-            if (!extract_one(term, row, &row->cells[c], c, ctx))
-                goto out;
+        for (int c = col_start; ok && c < c_used; c++)
+            ok = extract_one(term, row, &row->cells[c], c, ctx);
+
+        if (ok) {
+            ok = extract_empty(term, row, &row->cells[c_used], c_used,
+                               c_end - c_used, ctx);
         }
 
         if (r == end)
@@ -4032,7 +4681,20 @@ rows_to_text(const struct terminal *term, int start, int end,
         col_start = 0;
     }
 
-out:
+    grid_row_free(scratch[0]);
+    grid_row_free(scratch[1]);
+    return ok;
+}
+
+static bool
+rows_to_text(const struct terminal *term, int start, int end,
+             int col_start, int col_end, char **text, size_t *len)
+{
+    struct extraction_context *ctx = extract_begin(SELECTION_NONE, true);
+    if (ctx == NULL)
+        return false;
+
+    rows_extract(term, start, end, col_start, col_end, ctx);
     return extract_finish(ctx, text, len);
 }
 
@@ -4061,7 +4723,43 @@ term_scrollback_to_text(const struct terminal *term, char **text, size_t *len)
             end += term->grid->num_rows;
     }
 
-    return rows_to_text(term, start, end, 0, term->cols, text, len);
+    if (term->spill == NULL || term->grid != &term->normal)
+        return rows_to_text(term, start, end, 0, term->cols, text, len);
+
+    struct extraction_context *ctx = extract_begin(SELECTION_NONE, true);
+    if (ctx == NULL)
+        return false;
+
+    /*
+     * Spilled rows first, oldest first. The extraction context
+     * references the previous row; keep it alive until the next row
+     * has been extracted (and the last one until we're done)
+     */
+    struct row *prev = NULL;
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < spill_count(term->spill); i++) {
+        int cols;
+        struct row *row = grid_row_unspill(
+            term->spill, i, term->hyperlinks, &cols);
+
+        const int used = min(row->used, cols);
+
+        for (int c = 0; ok && c < used; c++)
+            ok = extract_one(term, row, &row->cells[c], c, ctx);
+
+        if (ok)
+            ok = extract_empty(term, row, &row->cells[used], used, cols - used, ctx);
+
+        grid_row_free(prev);
+        prev = row;
+    }
+
+    if (ok)
+        rows_extract(term, start, end, 0, term->cols, ctx);
+
+    grid_row_free(prev);
+    return extract_finish(ctx, text, len);
 }
 
 bool
@@ -4080,13 +4778,13 @@ term_command_output_to_text(const struct terminal *term, char **text, size_t *le
     int start_col = -1;
     int end_col = -1;
 
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
     const int sb_end = grid_row_absolute(grid, term->rows - 1);
     const int sb_start = (sb_end + 1) & (grid->num_rows - 1);
     int r = sb_end;
 
     while (start_row < 0) {
-        const struct row *row = grid->rows[r];
+        const struct row *row = grid_row_abs(grid, r);
         if (row == NULL)
             break;
 
@@ -4136,7 +4834,7 @@ term_command_output_to_text(const struct terminal *term, char **text, size_t *le
     }
 
     int next_to_last_row = (end_row - 1 + grid->num_rows) & (grid->num_rows - 1);
-    const struct row *row = grid->rows[next_to_last_row];
+    const struct row *row = grid_row_abs(grid, next_to_last_row);
 
     /* Add newline if last row has a hard linebreak */
     if (row->linebreak) {
@@ -4244,10 +4942,9 @@ void
 term_osc8_open(struct terminal *term, uint64_t id, const char *uri)
 {
     term_osc8_close(term);
-    xassert(term->vt.osc8.uri == NULL);
+    xassert(term->vt.osc8.link == NULL);
 
-    term->vt.osc8.id = id;
-    term->vt.osc8.uri = xstrdup(uri);
+    term->vt.osc8.link = hyperlink_get(term->hyperlinks, id, uri);
 
     term->bits_affecting_ascii_printer.osc8 = true;
     term_update_ascii_printer(term);
@@ -4256,9 +4953,8 @@ term_osc8_open(struct terminal *term, uint64_t id, const char *uri)
 void
 term_osc8_close(struct terminal *term)
 {
-    free(term->vt.osc8.uri);
-    term->vt.osc8.uri = NULL;
-    term->vt.osc8.id = 0;
+    hyperlink_unref(term->vt.osc8.link);
+    term->vt.osc8.link = NULL;
     term->bits_affecting_ascii_printer.osc8 = false;
     term_update_ascii_printer(term);
 }
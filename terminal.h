@@ -5,7 +5,6 @@
 #include <stddef.h>
 
 #include <threads.h>
-#include <semaphore.h>
 
 #if defined(FOOT_GRAPHEME_CLUSTERING)
  #include <utf8proc.h>
@@ -18,6 +17,7 @@
 #include "config.h"
 #include "debug.h"
 #include "fdm.h"
+#include "hyperlink.h"
 #include "key-binding.h"
 #include "macros.h"
 #include "notify.h"
@@ -101,8 +101,7 @@ struct damage {
 };
 
 struct uri_range_data {
-    uint64_t id;
-    char *uri;
+    struct hyperlink *link;  /* Counted reference */
 };
 
 enum underline_style {
@@ -131,8 +130,8 @@ struct row_range {
 
     union {
         /* This is just an expanded union row_range_data, but
-         * anonymous, so that we don't have to write range->u.uri.id,
-         * but can instead do range->uri.id */
+         * anonymous, so that we don't have to write range->u.uri.link,
+         * but can instead do range->uri.link */
         union {
             struct uri_range_data uri;
             struct underline_range_data underline;
@@ -154,13 +153,25 @@ struct row_data {
     struct row_ranges underline_ranges;
 };
 
+struct row_compressed;
+struct grid_slab;
+struct grid_reflow;
+struct spill;
+struct color_cache;
+
 struct row {
-    struct cell *cells;
+    struct cell *cells;  /* NULL when the row has been compressed */
     struct row_data *extra;
+    struct row_compressed *compressed;
+    struct grid_slab *slab;  /* Allocator, NULL if malloc:ed */
 
     bool dirty;
     bool linebreak;
 
+    /* Cells at, and after, this column are empty (wc == 0). This is
+     * an upper bound; the cells before it may be empty too */
+    int used;
+
     struct {
         bool prompt_marker;
         int cmd_start;  /* Column, -1 if unset */
@@ -246,6 +257,18 @@ struct grid {
     struct row **rows;
     struct row *cur_row;
 
+    /* Row allocator; NULL means rows are allocated with malloc() */
+    struct grid_slab *slab;
+
+    /* Scrollback not yet reflowed, NULL if none */
+    struct grid_reflow *reflow;
+
+    /*
+     * Scrollback rows more than this many rows above the screen's top
+     * row are all compressed (when compression is enabled)
+     */
+    int compress_watermark;
+
     tll(struct damage) scroll_damage;
     tll(struct sixel) sixel_images;
 
@@ -280,6 +303,10 @@ struct vt {
         struct vt_param *cur;
         struct vt_param v[16];
         struct vt_param dummy;
+
+        /* Raw parameter bytes, used as SGR cache key */
+        uint8_t raw[32];
+        uint8_t raw_len;  /* > sizeof(raw) if truncated */
     } params;
 
     uint32_t private; /* LSB=priv0, MSB=priv3 */
@@ -296,8 +323,7 @@ struct vt {
 
     /* Start coordinate for current OSC-8 URI */
     struct {
-        uint64_t id;
-        char *uri;
+        struct hyperlink *link;
     } osc8;
 
     struct underline_range_data underline;
@@ -308,9 +334,39 @@ struct vt {
         size_t idx;
         void (*put_handler)(struct terminal *term, uint8_t c);
         void (*unhook_handler)(struct terminal *term);
+
+        /* Optional; if NULL, put_handler is called for each byte */
+        void (*put_span_handler)(
+            struct terminal *term, const uint8_t *data, size_t len);
     } dcs;
 };
 
+/*
+ * Maps the raw parameter bytes of an SGR sequence, together with the
+ * attributes in effect *before* it, to the attributes in effect
+ * *after* it.
+ */
+struct sgr_cache_entry {
+    uint8_t len;  /* 0 - unused entry */
+    uint8_t raw[sizeof(((struct vt *)0)->params.raw)];
+
+    struct attributes attrs_in;
+    struct underline_range_data underline_in;
+    bool underline_style_in:1;  /* bits_affecting_ascii_printer */
+    bool underline_color_in:1;  /* bits_affecting_ascii_printer */
+
+    struct attributes attrs_out;
+    struct underline_range_data underline_out;
+    bool underline_style_out:1;
+    bool underline_color_out:1;
+};
+
+struct sgr_cache {
+    struct sgr_cache_entry entries[64];
+    uint64_t hits;
+    uint64_t misses;
+};
+
 enum cursor_origin { ORIGIN_ABSOLUTE, ORIGIN_RELATIVE };
 enum cursor_keys { CURSOR_KEYS_DONTCARE, CURSOR_KEYS_NORMAL, CURSOR_KEYS_APPLICATION };
 enum keypad_keys { KEYPAD_DONTCARE, KEYPAD_NUMERICAL, KEYPAD_APPLICATION };
@@ -429,9 +485,24 @@ struct terminal {
     int ptmx;
 
     struct vt vt;
+    struct sgr_cache sgr_cache;
+
+    /*
+     * Parser statistics, reported by foot-bench. Only updated when
+     * terminal.c is built with FOOT_BENCH (i.e. for foot-bench)
+     */
+    struct {
+        uint64_t cells_written;
+        uint64_t lines_scrolled;
+    } stats;
     struct grid *grid;
     struct grid normal;
     struct grid alt;
+    struct spill *spill;  /* Disk-spilled scrollback, NULL if disabled */
+
+    struct {
+        int timer_fd;     /* Reflows the scrollback deferred by a resize */
+    } reflow;
 
     int cols;   /* number of columns */
     int rows;   /* number of rows */
@@ -460,6 +531,7 @@ struct terminal {
 
     size_t composed_count;
     struct composed *composed;
+    struct hyperlinks *hyperlinks;  /* Interned OSC-8 URIs */
 
     /* Temporary: for FDM */
     struct {
@@ -504,6 +576,13 @@ struct terminal {
     ptmx_buffer_list_t ptmx_buffers;
     ptmx_buffer_list_t ptmx_paste_buffers;
 
+    /* Buffer used when reading from the PTY; grows (and shrinks) with
+     * the amount of data the client writes */
+    struct {
+        uint8_t *data;
+        size_t size;
+    } ptmx_read_buf;
+
     struct {
         bool esc_prefix;
         bool eight_bit;
@@ -682,17 +761,23 @@ struct terminal {
             int timer_fd;
         } app_sync_updates;
 
-        /* Render threads + synchronization primitives */
+        /* Render worker (pool) state; see render_workers_acquire() */
         struct {
             uint16_t count;
-            sem_t start;
-            sem_t done;
+            bool acquired;
             mtx_t lock;
             tll(int) queue;
-            thrd_t *threads;
             struct buffer *buf;
         } workers;
 
+        /* One per render thread; index 0 is the main thread */
+        pixman_glyph_cache_t **glyph_caches;
+        struct color_cache **color_caches;
+        pixman_glyph_t **glyph_bufs;  /* term->cols glyphs each */
+
+        /* Bumped whenever term->colors changes; see term_colors_changed() */
+        uint64_t color_generation;
+
         /* Last rendered cursor position */
         struct {
             struct row *row;
@@ -858,6 +943,7 @@ void term_damage_view(struct terminal *term);
 void term_damage_cursor(struct terminal *term);
 void term_damage_margins(struct terminal *term);
 void term_damage_color(struct terminal *term, enum color_source src, int idx);
+void term_colors_changed(struct terminal *term);
 
 void term_reset_view(struct terminal *term);
 
@@ -871,6 +957,26 @@ void term_erase(
     int end_row, int end_col);
 void term_erase_scrollback(struct terminal *term);
 
+/*
+ * Reflow of the scrollback rows deferred by a resize (see
+ * grid_resize_and_reflow()). term_reflow_schedule() reflows them in
+ * the background, term_reflow_step() reflows the next slice, and
+ * term_reflow_finish() reflows everything right away.
+ */
+void term_reflow_schedule(struct terminal *term);
+bool term_reflow_step(struct terminal *term);
+void term_reflow_finish(struct terminal *term);
+
+/*
+ * Moves the newest disk-spilled scrollback rows back into the
+ * scrollback, in front of its oldest row (see grid_spill_page_in()).
+ * The selection, the search match, and the given tracking points
+ * (absolute coordinates) are updated if the ring is grown. Returns
+ * the number of rows paged in.
+ */
+int term_spill_page_in(struct terminal *term, size_t tracking_points_count,
+                       struct coord *const tracking_points[]);
+
 int term_row_rel_to_abs(const struct terminal *term, int row);
 void term_cursor_home(struct terminal *term);
 void term_cursor_to(struct terminal *term, int row, int col);
@@ -882,10 +988,15 @@ void term_cursor_down(struct terminal *term, int count);
 void term_cursor_blink_update(struct terminal *term);
 
 void term_print(struct terminal *term, char32_t wc, int width);
+void term_print_ascii(struct terminal *term, const uint8_t *data, size_t len);
+void term_print_run(struct terminal *term, const char32_t *wcs, size_t count);
+void term_print_run_wide(
+    struct terminal *term, const char32_t *wcs, size_t count, int width);
 void term_fill(struct terminal *term, int row, int col, uint8_t c, size_t count,
                bool use_sgr_attrs);
 
 void term_scroll(struct terminal *term, int rows);
+void term_compress_scrollback(struct terminal *term);
 void term_scroll_reverse(struct terminal *term, int rows);
 
 void term_scroll_partial(
@@ -600,6 +600,50 @@ test_section_scrollback(void)
                 &conf.scrollback.lines);
     test_float(&ctx, parse_section_scrollback, "multiplier", &conf.scrollback.multiplier);
 
+    /* Like test_uint32(), but large values are clamped */
+    ctx.key = "compress-after";
+    {
+        static const struct {
+            const char *option_string;
+            uint32_t value;
+            bool invalid;
+        } input[] = {
+            {"0", 0}, {"65536", 65536}, {"2147483647", INT32_MAX},
+            {"2147483648", INT32_MAX}, {"4294967295", INT32_MAX},
+            {"4294967296", 0, true}, {"abc", 0, true},
+        };
+
+        for (size_t i = 0; i < ALEN(input); i++) {
+            ctx.value = input[i].option_string;
+
+            if (input[i].invalid) {
+                if (parse_section_scrollback(&ctx)) {
+                    BUG("[%s].%s=%s: did not fail to parse as expected",
+                        ctx.section, ctx.key, ctx.value);
+                }
+            } else {
+                if (!parse_section_scrollback(&ctx)) {
+                    BUG("[%s].%s=%s: failed to parse",
+                        ctx.section, ctx.key, ctx.value);
+                }
+                if (conf.scrollback.compress_after != input[i].value) {
+                    BUG("[%s].%s=%s: set value (%u) not the expected one (%u)",
+                        ctx.section, ctx.key, ctx.value,
+                        conf.scrollback.compress_after, input[i].value);
+                }
+            }
+        }
+    }
+
+    test_uint32(&ctx, &parse_section_scrollback, "memory-limit",
+                &conf.scrollback.memory_limit);
+    test_boolean(&ctx, &parse_section_scrollback, "spill",
+                 &conf.scrollback.spill.enabled);
+    test_string(&ctx, &parse_section_scrollback, "spill-directory",
+                &conf.scrollback.spill.directory);
+    test_uint32(&ctx, &parse_section_scrollback, "spill-limit",
+                &conf.scrollback.spill.limit);
+
     test_enum(
         &ctx, &parse_section_scrollback, "indicator-position",
         3,
@@ -1361,13 +1405,37 @@ test_section_tweak(void)
                 &conf.tweak.box_drawing_base_thickness);
     test_boolean(&ctx, &parse_section_tweak, "box-drawing-solid-shades",
         &conf.tweak.box_drawing_solid_shades);
+    test_boolean(&ctx, &parse_section_tweak, "parallel-reflow",
+                 &conf.tweak.parallel_reflow);
 
-#if 0  /* Must be less than 16ms */
+#if 0  /* Must not exceed 16666666ns */
     test_uint32(&ctx, &parse_section_tweak, "delayed-render-lower",
                 &conf.tweak.delayed_render_lower_ns);
     test_uint32(&ctx, &parse_section_tweak, "delayed-render-upper",
                 &conf.tweak.delayed_render_upper_ns);
+    test_uint32(&ctx, &parse_section_tweak, "ptmx-read-budget",
+                &conf.tweak.ptmx_read_budget_ns);
 #endif
+    {
+        /* Limited to one frame (60Hz), as documented */
+        static const char *const keys[] = {
+            "delayed-render-lower", "delayed-render-upper", "ptmx-read-budget",
+        };
+
+        for (size_t i = 0; i < ALEN(keys); i++) {
+            ctx.key = keys[i];
+
+            ctx.value = "16666666";
+            if (!parse_section_tweak(&ctx))
+                BUG("[%s].%s=%s: failed to parse", ctx.section, ctx.key, ctx.value);
+
+            ctx.value = "16666667";
+            if (parse_section_tweak(&ctx)) {
+                BUG("[%s].%s=%s: did not fail to parse as expected",
+                    ctx.section, ctx.key, ctx.value);
+            }
+        }
+    }
     test_boolean(&ctx, &parse_section_tweak, "damage-whole-window",
                  &conf.tweak.damage_whole_window);
 
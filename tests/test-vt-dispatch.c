@@ -0,0 +1,231 @@
+/*
+ * Verifies that the generated VT transition tables (table_dispatch())
+ * are equivalent to the hand written per-state switch functions
+ * (switch_dispatch()), for every state, and every input byte.
+ *
+ * With --benchmark, instead measures the throughput of the two
+ * dispatchers, on the given stimuli files (e.g. the PGO stimuli).
+ * Actions are no-ops; this measures the dispatch itself, and every
+ * byte goes through the dispatcher (vt_from_slave()'s fast paths are
+ * not used).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vt-tables.h"
+
+#define ALEN(v) (sizeof(v) / sizeof((v)[0]))
+
+/* The only part of the terminal the dispatchers use */
+struct terminal {
+    struct {
+        enum state state;
+    } vt;
+};
+
+/* Actions executed for the current input byte, e.g. "clear;collect(3f);" */
+static char trace[256];
+static size_t trace_len;
+static bool tracing = true;
+static volatile uint64_t checksum;  /* Keeps the no-op actions alive */
+
+static void
+record(const char *action, int data)
+{
+    if (!tracing) {
+        checksum += (uintptr_t)action ^ (unsigned)data;
+        return;
+    }
+
+    trace_len += data >= 0
+        ? snprintf(&trace[trace_len], sizeof(trace) - trace_len,
+                   "%s(%02x);", action, data)
+        : snprintf(&trace[trace_len], sizeof(trace) - trace_len,
+                   "%s;", action);
+
+    if (trace_len >= sizeof(trace)) {
+        fprintf(stderr, "action trace overflow\n");
+        abort();
+    }
+}
+
+#define ACTION(name)                                                    \
+    static void                                                         \
+    action_##name(struct terminal *term, uint8_t data)                  \
+    {                                                                   \
+        record(#name, data);                                            \
+    }
+
+#define ACTION_NO_DATA(name)                                            \
+    static void                                                         \
+    action_##name(struct terminal *term)                                \
+    {                                                                   \
+        record(#name, -1);                                              \
+    }
+
+ACTION_NO_DATA(ignore)
+ACTION_NO_DATA(clear)
+ACTION(execute)
+ACTION(print)
+ACTION(collect)
+ACTION(esc_dispatch)
+ACTION(csi_dispatch)
+ACTION(param)
+ACTION(param_new)
+ACTION(param_new_subparam)
+ACTION(osc_start)
+ACTION(osc_put)
+ACTION(osc_end)
+ACTION(hook)
+ACTION(put)
+ACTION(unhook)
+ACTION(utf8_21)
+ACTION(utf8_22)
+ACTION(utf8_31)
+ACTION(utf8_32)
+ACTION(utf8_33)
+ACTION(utf8_41)
+ACTION(utf8_42)
+ACTION(utf8_43)
+ACTION(utf8_44)
+
+#define VT_DISPATCH_SWITCH
+#define VT_DISPATCH_TABLE
+#include "../vt-dispatch.h"
+
+static int
+verify(void)
+{
+    int failures = 0;
+
+    for (int state = 0; state < VT_STATE_COUNT; state++) {
+        for (int byte = 0; byte < 256; byte++) {
+            struct terminal term = {.vt = {.state = state}};
+
+            trace_len = 0;
+            trace[0] = '\0';
+            const enum state switch_state = switch_dispatch(&term, state, byte);
+
+            char switch_trace[sizeof(trace)];
+            memcpy(switch_trace, trace, sizeof(trace));
+
+            term.vt.state = state;
+            trace_len = 0;
+            trace[0] = '\0';
+            const enum state table_state = table_dispatch(&term, state, byte);
+
+            if (switch_state != table_state || strcmp(switch_trace, trace) != 0) {
+                fprintf(stderr,
+                        "state=%d, byte=0x%02x: "
+                        "switch: \"%s\" -> %d, table: \"%s\" -> %d\n",
+                        state, byte,
+                        switch_trace, switch_state, trace, table_state);
+                failures++;
+            }
+        }
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d (state, byte) pairs differ; "
+                "re-generate the tables, or fix the switch functions\n",
+                failures);
+    }
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Throughput, in MB/s, of a single pass over 'data' */
+static double
+run(enum state (*dispatch)(struct terminal *, enum state, uint8_t),
+    const uint8_t *data, size_t len)
+{
+    struct terminal term = {.vt = {.state = STATE_GROUND}};
+
+    const double start = now();
+    for (size_t i = 0; i < len; i++)
+        term.vt.state = dispatch(&term, term.vt.state, data[i]);
+    const double elapsed = now() - start;
+
+    return (double)len / elapsed / (1024. * 1024.);
+}
+
+static enum state
+switch_dispatch_noinline(struct terminal *term, enum state state, uint8_t data)
+{
+    return switch_dispatch(term, state, data);
+}
+
+static enum state
+table_dispatch_noinline(struct terminal *term, enum state state, uint8_t data)
+{
+    return table_dispatch(term, state, data);
+}
+
+static int
+benchmark(int argc, const char *const *argv)
+{
+    const int iterations = 15;
+    tracing = false;
+
+    for (int i = 0; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        fseek(f, 0, SEEK_END);
+        const long len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        uint8_t *data = malloc(len > 0 ? len : 1);
+        if (data == NULL || fread(data, 1, len, f) != (size_t)len) {
+            fprintf(stderr, "%s: failed to read\n", argv[i]);
+            fclose(f);
+            free(data);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+
+        /* Best of N; alternate between the two to even out noise */
+        double mb_switch = 0.;
+        double mb_table = 0.;
+
+        for (int j = 0; j < iterations; j++) {
+            const double s = run(&switch_dispatch_noinline, data, len);
+            const double t = run(&table_dispatch_noinline, data, len);
+
+            mb_switch = s > mb_switch ? s : mb_switch;
+            mb_table = t > mb_table ? t : mb_table;
+        }
+
+        printf("%s: %ld bytes: switch: %.1f MB/s, table: %.1f MB/s (%+.1f%%)\n",
+               argv[i], len, mb_switch, mb_table,
+               (mb_table - mb_switch) / mb_switch * 100.);
+        free(data);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int
+main(int argc, const char *const *argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+        return benchmark(argc - 2, &argv[2]);
+
+    return verify();
+}
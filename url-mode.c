@@ -290,7 +290,14 @@ auto_detected(const struct terminal *term, enum url_action action,
     for (int r = 0; r < term->rows; r++) {
         const struct row *row = grid_row_in_view(term->grid, r);
 
-        for (int c = 0; c < term->cols; c++) {
+        /*
+         * Two empty cells are enough to terminate a URL (the first
+         * one), and to break up the protocol match (the second one);
+         * the rest of the row's empty tail can be skipped
+         */
+        const int cols = min(row->used + 2, term->cols);
+
+        for (int c = 0; c < cols; c++) {
             const struct cell *cell = &row->cells[c];
 
             if (cell->wc >= CELL_SPACER)
@@ -523,8 +530,8 @@ osc8_uris(const struct terminal *term, enum url_action action, url_list_t *urls)
            tll_push_back(
                *urls,
                ((struct url){
-                   .id = range->uri.id,
-                   .url = xstrdup(range->uri.uri),
+                   .id = range->uri.link->id,
+                   .url = xstrdup(range->uri.link->uri),
                    .range = {
                        .start = start,
                        .end = end,
@@ -745,7 +752,7 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
     size_t r = start->row & (grid->num_rows - 1);
     size_t c = start->col;
 
-    struct row *row = grid->rows[r];
+    struct row *row = grid_row_abs(grid, r);
     row->dirty = true;
 
     while (true) {
@@ -760,7 +767,7 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
             r = (r + 1) & (grid->num_rows - 1);
             c = 0;
 
-            row = grid->rows[r];
+            row = grid_row_abs(grid, r);
             if (row == NULL) {
                 /* Un-allocated scrollback. This most likely means a
                  * runaway OSC-8 URL. */
@@ -0,0 +1,428 @@
+#pragma once
+
+/*
+ * The VT parser's two dispatchers:
+ *
+ *  - switch_dispatch(): hand written; one switch function per state
+ *  - table_dispatch(): uses the transition tables generated by
+ *    scripts/generate-vt-tables.py
+ *
+ * Define VT_DISPATCH_SWITCH and/or VT_DISPATCH_TABLE to select which
+ * one(s) to compile. The includer must provide the action_*()
+ * functions, and 'struct terminal' (only term->vt.state is used).
+ *
+ * Included by vt.c, and by tests/test-vt-dispatch.c, which verifies
+ * that the two dispatchers are equivalent.
+ */
+
+#include <stdint.h>
+
+#include "macros.h"
+#include "vt-tables.h"
+
+#if defined(VT_DISPATCH_SWITCH)
+IGNORE_WARNING("-Wpedantic")
+
+static enum state
+anywhere(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x18:                                           action_execute(term, data);                                       return STATE_GROUND;
+    case 0x1a:                                           action_execute(term, data);                                       return STATE_GROUND;
+    case 0x1b:                                                                            action_clear(term);              return STATE_ESCAPE;
+
+    /* 8-bit C1 control characters (not supported) */
+    case 0x80 ... 0x9f:                                                                                                    return STATE_GROUND;
+    }
+
+    return term->vt.state;
+}
+
+static enum state
+state_ground_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_GROUND;
+
+    /* modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character */
+    case 0x20 ... 0x7e:                                  action_print(term, data);                                         return STATE_GROUND;
+
+    case 0xc2 ... 0xdf:                                  action_utf8_21(term, data);                                       return STATE_UTF8_21;
+    case 0xe0 ... 0xef:                                  action_utf8_31(term, data);                                       return STATE_UTF8_31;
+    case 0xf0 ... 0xf4:                                  action_utf8_41(term, data);                                       return STATE_UTF8_41;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_escape_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
+    case 0x30 ... 0x4f:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x50:                                                                            action_clear(term);              return STATE_DCS_ENTRY;
+    case 0x51 ... 0x57:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x58:                                                                                                             return STATE_SOS_PM_APC_STRING;
+    case 0x59:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x5a:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x5b:                                                                            action_clear(term);              return STATE_CSI_ENTRY;
+    case 0x5c:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x5d:                                                                            action_osc_start(term, data);    return STATE_OSC_STRING;
+    case 0x5e ... 0x5f:                                                                                                    return STATE_SOS_PM_APC_STRING;
+    case 0x60 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_escape_intermediate_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
+    case 0x30 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE_INTERMEDIATE;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_csi_entry_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_ENTRY;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
+    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
+    case 0x3a:                                           action_param_new_subparam(term, data);                            return STATE_CSI_PARAM;
+    case 0x3b:                                           action_param_new(term, data);                                     return STATE_CSI_PARAM;
+
+    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_CSI_PARAM;
+    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_ENTRY;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_csi_param_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_PARAM;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
+
+    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
+    case 0x3a:                                           action_param_new_subparam(term, data);                            return STATE_CSI_PARAM;
+    case 0x3b:                                           action_param_new(term, data);                                     return STATE_CSI_PARAM;
+
+    case 0x3c ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
+    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_PARAM;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_csi_intermediate_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_INTERMEDIATE;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
+    case 0x30 ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
+    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_INTERMEDIATE;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_csi_ignore_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_IGNORE;
+
+    case 0x20 ... 0x3f:                                  action_ignore(term);                                              return STATE_CSI_IGNORE;
+    case 0x40 ... 0x7e:                                                                                                    return STATE_GROUND;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_IGNORE;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_osc_string_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+
+    /* Note: original was 20-7f, but I changed to 20-ff to include utf-8. Don't forget to add EXECUTE to 8-bit C1 if we implement that. */
+    default:                                             action_osc_put(term, data);                                       return STATE_OSC_STRING;
+
+    case 0x07:          action_osc_end(term, data);                                                                        return STATE_GROUND;
+
+    case 0x00 ... 0x06:
+    case 0x08 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_OSC_STRING;
+
+
+    case 0x18:
+    case 0x1a:          action_osc_end(term, data);      action_execute(term, data);                                       return STATE_GROUND;
+
+    case 0x1b:          action_osc_end(term, data);      action_clear(term);                                               return STATE_ESCAPE;
+    }
+}
+
+static enum state
+state_dcs_entry_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_ENTRY;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
+    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
+    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
+    case 0x3b:                                           action_param_new(term, data);                                     return STATE_DCS_PARAM;
+    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_DCS_PARAM;
+    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_ENTRY;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_dcs_param_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_PARAM;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
+    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
+    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
+    case 0x3b:                                           action_param_new(term, data);                                     return STATE_DCS_PARAM;
+    case 0x3c ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
+    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PARAM;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_dcs_intermediate_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
+
+    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
+    case 0x30 ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
+    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
+    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_dcs_ignore_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x1f:
+    case 0x20 ... 0x7f:                                  action_ignore(term);                                              return STATE_DCS_IGNORE;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_dcs_passthrough_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x7e:                                  action_put(term, data);                                           return STATE_DCS_PASSTHROUGH;
+
+    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PASSTHROUGH;
+
+    /* Anywhere */
+    case 0x18:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
+    case 0x1a:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
+    case 0x1b:          action_unhook(term, data);                                        action_clear(term);              return STATE_ESCAPE;
+
+    /* 8-bit C1 control characters (not supported) */
+    case 0x80 ... 0x9f: action_unhook(term, data);                                                                         return STATE_GROUND;
+
+    default:                                                                                                               return STATE_DCS_PASSTHROUGH;
+    }
+}
+
+static enum state
+state_sos_pm_apc_string_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x00 ... 0x17:
+    case 0x19:
+    case 0x1c ... 0x7f:                                  action_ignore(term);                                              return STATE_SOS_PM_APC_STRING;
+    }
+
+    return anywhere(term, data);
+}
+
+static enum state
+state_utf8_21_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x80 ... 0xbf:                                  action_utf8_22(term, data);                                       return STATE_GROUND;
+    default:                                                                                                               return STATE_GROUND;
+    }
+}
+
+static enum state
+state_utf8_31_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x80 ... 0xbf:                                  action_utf8_32(term, data);                                       return STATE_UTF8_32;
+    default:                                                                                                               return STATE_GROUND;
+    }
+}
+
+static enum state
+state_utf8_32_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x80 ... 0xbf:                                  action_utf8_33(term, data);                                       return STATE_GROUND;
+    default:                                                                                                               return STATE_GROUND;
+    }
+}
+
+static enum state
+state_utf8_41_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x80 ... 0xbf:                                  action_utf8_42(term, data);                                       return STATE_UTF8_42;
+    default:                                                                                                               return STATE_GROUND;
+    }
+}
+
+static enum state
+state_utf8_42_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x80 ... 0xbf:                                  action_utf8_43(term, data);                                       return STATE_UTF8_43;
+    default:                                                                                                               return STATE_GROUND;
+    }
+}
+
+static enum state
+state_utf8_43_switch(struct terminal *term, uint8_t data)
+{
+    switch (data) {
+        /*              exit                             current                          enter                            new state */
+    case 0x80 ... 0xbf:                                  action_utf8_44(term, data);                                       return STATE_GROUND;
+    default:                                                                                                               return STATE_GROUND;
+    }
+}
+
+static inline enum state
+switch_dispatch(struct terminal *term, enum state current_state, uint8_t data)
+{
+    switch (current_state) {
+    case STATE_GROUND:              return state_ground_switch(term, data);
+    case STATE_ESCAPE:              return state_escape_switch(term, data);
+    case STATE_ESCAPE_INTERMEDIATE: return state_escape_intermediate_switch(term, data);
+    case STATE_CSI_ENTRY:           return state_csi_entry_switch(term, data);
+    case STATE_CSI_PARAM:           return state_csi_param_switch(term, data);
+    case STATE_CSI_INTERMEDIATE:    return state_csi_intermediate_switch(term, data);
+    case STATE_CSI_IGNORE:          return state_csi_ignore_switch(term, data);
+    case STATE_OSC_STRING:          return state_osc_string_switch(term, data);
+    case STATE_DCS_ENTRY:           return state_dcs_entry_switch(term, data);
+    case STATE_DCS_PARAM:           return state_dcs_param_switch(term, data);
+    case STATE_DCS_INTERMEDIATE:    return state_dcs_intermediate_switch(term, data);
+    case STATE_DCS_IGNORE:          return state_dcs_ignore_switch(term, data);
+    case STATE_DCS_PASSTHROUGH:     return state_dcs_passthrough_switch(term, data);
+    case STATE_SOS_PM_APC_STRING:   return state_sos_pm_apc_string_switch(term, data);
+
+    case STATE_UTF8_21:             return state_utf8_21_switch(term, data);
+    case STATE_UTF8_31:             return state_utf8_31_switch(term, data);
+    case STATE_UTF8_32:             return state_utf8_32_switch(term, data);
+    case STATE_UTF8_41:             return state_utf8_41_switch(term, data);
+    case STATE_UTF8_42:             return state_utf8_42_switch(term, data);
+    case STATE_UTF8_43:             return state_utf8_43_switch(term, data);
+    }
+
+    return current_state;
+}
+
+UNIGNORE_WARNINGS
+#endif
+
+#if defined(VT_DISPATCH_TABLE)
+static inline enum state
+table_dispatch(struct terminal *term, enum state current_state, uint8_t data)
+{
+    const struct vt_transition *t =
+        &vt_transitions[current_state][vt_byte_class[data]];
+
+    switch ((enum vt_action)t->action) {
+#define ACTION_CASE(id, code) case id: code break;
+    VT_FOREACH_ACTION(ACTION_CASE)
+#undef ACTION_CASE
+    }
+
+    return t->state;
+}
+#endif
@@ -8,6 +8,10 @@
  #include <utf8proc.h>
 #endif
 
+#if defined(__AVX2__) || defined(__SSE2__)
+ #include <immintrin.h>
+#endif
+
 #define LOG_MODULE "vt"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
@@ -17,42 +21,24 @@
 #include "dcs.h"
 #include "debug.h"
 #include "emoji-variation-sequences.h"
+#include "grid.h"
 #include "osc.h"
 #include "sixel.h"
 #include "util.h"
+#include "vt-tables.h"
 #include "xmalloc.h"
 
 #define UNHANDLED() LOG_DBG("unhandled: %s", esc_as_string(term, final))
 
-/* https://vt100.net/emu/dec_ansi_parser */
-
-enum state {
-    STATE_GROUND,
-    STATE_ESCAPE,
-    STATE_ESCAPE_INTERMEDIATE,
-
-    STATE_CSI_ENTRY,
-    STATE_CSI_PARAM,
-    STATE_CSI_INTERMEDIATE,
-    STATE_CSI_IGNORE,
-
-    STATE_OSC_STRING,
-
-    STATE_DCS_ENTRY,
-    STATE_DCS_PARAM,
-    STATE_DCS_INTERMEDIATE,
-    STATE_DCS_IGNORE,
-    STATE_DCS_PASSTHROUGH,
-
-    STATE_SOS_PM_APC_STRING,
-
-    STATE_UTF8_21,
-    STATE_UTF8_31,
-    STATE_UTF8_32,
-    STATE_UTF8_41,
-    STATE_UTF8_42,
-    STATE_UTF8_43,
-};
+/*
+ * https://vt100.net/emu/dec_ansi_parser
+ *
+ * The states (enum state), and the transition tables used by the
+ * table driven dispatcher, are generated by
+ * scripts/generate-vt-tables.py. The generated tables must be kept in
+ * sync with the state_*_switch() functions in vt-dispatch.h;
+ * tests/test-vt-dispatch.c verifies they are.
+ */
 
 #if defined(_DEBUG) && defined(LOG_ENABLE_DBG) && LOG_ENABLE_DBG && 0
 static const char *const state_names[] = {
@@ -113,6 +99,7 @@ static void
 action_clear(struct terminal *term)
 {
     term->vt.params.idx = 0;
+    term->vt.params.raw_len = 0;
     term->vt.private = 0;
 }
 
@@ -214,6 +201,8 @@ action_execute(struct terminal *term, uint8_t c)
                 cell->wc = U' ';
                 cell->attrs.clean = 0;
             }
+
+            grid_row_mark_used(row, new_col);
         }
 
         /* According to the specification, HT _should_ cancel LCF. But
@@ -298,6 +287,158 @@ action_print(struct terminal *term, uint8_t c)
     term->ascii_printer(term, c);
 }
 
+static void
+action_print_ascii(struct terminal *term, const uint8_t *data, size_t len)
+{
+    term_reset_grapheme_state(term);
+    term_print_ascii(term, data, len);
+}
+
+/*
+ * Returns the number of leading bytes in 'data' that are printable
+ * ASCII (0x20-0x7e). I.e. the number of bytes that can be handed to
+ * the ASCII printer without going through the state machine.
+ */
+static size_t
+printable_ascii_run(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+
+    /*
+     * Note: the compares below are *signed*. Bytes >= 0x80 are thus
+     * negative, and fail the "greater than 0x1f" test, just like the
+     * C0 control characters do.
+     */
+
+#if defined(__AVX2__)
+    const __m256i lo32 = _mm256_set1_epi8(0x1f);
+    const __m256i hi32 = _mm256_set1_epi8(0x7f);
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&data[i]);
+        const __m256i ok = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, lo32), _mm256_cmpgt_epi8(hi32, v));
+
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(ok);
+        if (mask != 0xffffffff)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i lo16 = _mm_set1_epi8(0x1f);
+    const __m128i hi16 = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&data[i]);
+        const __m128i ok = _mm_and_si128(
+            _mm_cmpgt_epi8(v, lo16), _mm_cmplt_epi8(v, hi16));
+
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(ok);
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (data[i] < 0x20 || data[i] > 0x7e)
+            break;
+    }
+
+    return i;
+}
+
+UNITTEST
+{
+    static const uint8_t terminators[] = {
+        0x00, 0x1b, 0x1f, 0x7f, 0x80, 0xc3, 0xff};
+    uint8_t buf[100];
+
+    for (size_t len = 0; len <= sizeof(buf); len++) {
+        /* Both ends of the printable range */
+        memset(buf, ' ', sizeof(buf));
+        xassert(printable_ascii_run(buf, len) == len);
+        memset(buf, '~', sizeof(buf));
+        xassert(printable_ascii_run(buf, len) == len);
+
+        /* Insert a non-printable at every possible position */
+        for (size_t t = 0; t < sizeof(terminators); t++) {
+            for (size_t pos = 0; pos < len; pos++) {
+                memset(buf, 'a', sizeof(buf));
+                buf[pos] = terminators[t];
+                xassert(printable_ascii_run(buf, len) == pos);
+            }
+        }
+    }
+}
+
+/*
+ * Returns the number of leading bytes in 'data' that are *not* C0
+ * control characters (0x00-0x1f). In the OSC string state, these are
+ * all appended to the OSC buffer, while the string terminators (BEL,
+ * ESC, CAN and SUB) are all C0 control characters.
+ */
+static size_t
+osc_string_run(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i c0_mask32 = _mm256_set1_epi8((char)0xe0);
+    const __m256i zero32 = _mm256_setzero_si256();
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&data[i]);
+        const __m256i c0 = _mm256_cmpeq_epi8(
+            _mm256_and_si256(v, c0_mask32), zero32);
+
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(c0);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i c0_mask16 = _mm_set1_epi8((char)0xe0);
+    const __m128i zero16 = _mm_setzero_si128();
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&data[i]);
+        const __m128i c0 = _mm_cmpeq_epi8(_mm_and_si128(v, c0_mask16), zero16);
+
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(c0);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (data[i] < 0x20)
+            break;
+    }
+
+    return i;
+}
+
+UNITTEST
+{
+    uint8_t buf[100];
+
+    for (size_t len = 0; len < sizeof(buf); len++) {
+        memset(buf, 0xa5, sizeof(buf));
+        xassert(osc_string_run(buf, len) == len);
+
+        for (size_t pos = 0; pos < len; pos++) {
+            memset(buf, 0x20, sizeof(buf));
+            buf[pos] = pos % 2 ? '\a' : '\x1b';
+            xassert(osc_string_run(buf, len) == pos);
+
+            buf[pos] = 0xff;
+            xassert(osc_string_run(buf, len) == len);
+        }
+    }
+}
+
 static void
 action_param_lazy_init(struct terminal *term)
 {
@@ -312,11 +453,25 @@ action_param_lazy_init(struct terminal *term)
     }
 }
 
+static inline void
+action_param_raw(struct terminal *term, uint8_t c)
+{
+    /* Record the raw parameter bytes; used as key in the SGR cache */
+    uint8_t len = term->vt.params.raw_len;
+
+    if (likely(len < sizeof(term->vt.params.raw)))
+        term->vt.params.raw[len] = c;
+
+    if (likely(len <= sizeof(term->vt.params.raw)))
+        term->vt.params.raw_len = len + 1;
+}
+
 static void
 action_param_new(struct terminal *term, uint8_t c)
 {
     xassert(c == ';');
     action_param_lazy_init(term);
+    action_param_raw(term, c);
 
     const size_t max_params
         = sizeof(term->vt.params.v) / sizeof(term->vt.params.v[0]);
@@ -347,6 +502,7 @@ action_param_new_subparam(struct terminal *term, uint8_t c)
 {
     xassert(c == ':');
     action_param_lazy_init(term);
+    action_param_raw(term, c);
 
     const size_t max_sub_params
         = sizeof(term->vt.params.v[0].sub.value) / sizeof(term->vt.params.v[0].sub.value[0]);
@@ -376,6 +532,7 @@ static void
 action_param(struct terminal *term, uint8_t c)
 {
     action_param_lazy_init(term);
+    action_param_raw(term, c);
     xassert(term->vt.params.cur != NULL);
 
     struct vt_param *param = term->vt.params.cur;
@@ -629,6 +786,16 @@ action_osc_put(struct terminal *term, uint8_t c)
     term->vt.osc.data[term->vt.osc.idx++] = c;
 }
 
+/* Appends an entire span of OSC string bytes */
+static void
+action_osc_put_span(struct terminal *term, const uint8_t *data, size_t len)
+{
+    if (!osc_ensure_size(term, term->vt.osc.idx + len))
+        return;
+    memcpy(&term->vt.osc.data[term->vt.osc.idx], data, len);
+    term->vt.osc.idx += len;
+}
+
 static void
 action_hook(struct terminal *term, uint8_t c)
 {
@@ -647,6 +814,12 @@ action_put(struct terminal *term, uint8_t c)
     dcs_put(term, c);
 }
 
+static void
+action_put_span(struct terminal *term, const uint8_t *data, size_t len)
+{
+    dcs_put_span(term, data, len);
+}
+
 static inline uint32_t
 chain_key(uint32_t old_key, uint32_t new_wc)
 {
@@ -1040,363 +1213,236 @@ action_utf8_44(struct terminal *term, uint8_t c)
     action_utf8_print(term, term->vt.utf8);
 }
 
-IGNORE_WARNING("-Wpedantic")
-
-static enum state
-anywhere(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x18:                                           action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1a:                                           action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1b:                                                                            action_clear(term);              return STATE_ESCAPE;
-
-    /* 8-bit C1 control characters (not supported) */
-    case 0x80 ... 0x9f:                                                                                                    return STATE_GROUND;
-    }
-
-    return term->vt.state;
-}
-
-static enum state
-state_ground_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_GROUND;
-
-    /* modified from 0x20..0x7f to 0x20..0x7e, since 0x7f is DEL, which is a zero-width character */
-    case 0x20 ... 0x7e:                                  action_print(term, data);                                         return STATE_GROUND;
-
-    case 0xc2 ... 0xdf:                                  action_utf8_21(term, data);                                       return STATE_UTF8_21;
-    case 0xe0 ... 0xef:                                  action_utf8_31(term, data);                                       return STATE_UTF8_31;
-    case 0xf0 ... 0xf4:                                  action_utf8_41(term, data);                                       return STATE_UTF8_41;
-    }
-
-    return anywhere(term, data);
-}
-
-static enum state
-state_escape_switch(struct terminal *term, uint8_t data)
+/*
+ * Decodes as many complete, and valid, multi-byte UTF-8 sequences as
+ * possible from 'data', and stores them in 'out'.
+ *
+ * Decoding stops at the first byte that isn't the start of such a
+ * sequence: ASCII, stray continuation bytes, surrogates, out-of-range
+ * code points, and sequences that are truncated (i.e. continue in the
+ * next read). Those are left to the state machine, which also
+ * takes care of sequences split across read boundaries.
+ *
+ * Returns the number of bytes consumed. The number of decoded code
+ * points is returned in 'count'.
+ */
+static size_t
+utf8_decode_block(const uint8_t *data, size_t len,
+                  char32_t *out, size_t out_size, size_t *count)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-    case 0x30 ... 0x4f:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x50:                                                                            action_clear(term);              return STATE_DCS_ENTRY;
-    case 0x51 ... 0x57:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x58:                                                                                                             return STATE_SOS_PM_APC_STRING;
-    case 0x59:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5a:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5b:                                                                            action_clear(term);              return STATE_CSI_ENTRY;
-    case 0x5c:                                           action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x5d:                                                                            action_osc_start(term, data);    return STATE_OSC_STRING;
-    case 0x5e ... 0x5f:                                                                                                    return STATE_SOS_PM_APC_STRING;
-    case 0x60 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE;
-    }
-
-    return anywhere(term, data);
-}
+    size_t i = 0;
+    size_t n = 0;
 
-static enum state
-state_escape_intermediate_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_ESCAPE_INTERMEDIATE;
-    case 0x30 ... 0x7e:                                  action_esc_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_ESCAPE_INTERMEDIATE;
-    }
+    while (n < out_size && i < len) {
+        const uint8_t *s = &data[i];
+        const size_t left = len - i;
 
-    return anywhere(term, data);
-}
+        if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+            if (left < 2 || (s[1] & 0xc0) != 0x80)
+                break;
 
-static enum state
-state_csi_entry_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_ENTRY;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-    case 0x3a:                                           action_param_new_subparam(term, data);                            return STATE_CSI_PARAM;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_CSI_PARAM;
-
-    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_CSI_PARAM;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_ENTRY;
-    }
+            out[n++] = (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+            i += 2;
+        }
 
-    return anywhere(term, data);
-}
+        else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+            if (left < 3 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80)
+                break;
 
-static enum state
-state_csi_param_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_PARAM;
+            const char32_t wc =
+                (s[0] & 0x0f) << 12 | (s[1] & 0x3f) << 6 | (s[2] & 0x3f);
 
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
+            if (unlikely(wc >= 0xd800 && wc <= 0xdfff))
+                break;
 
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_CSI_PARAM;
-    case 0x3a:                                           action_param_new_subparam(term, data);                            return STATE_CSI_PARAM;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_CSI_PARAM;
+            out[n++] = wc;
+            i += 3;
+        }
 
-    case 0x3c ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_PARAM;
-    }
+        else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+            if (left < 4 ||
+                (s[1] & 0xc0) != 0x80 ||
+                (s[2] & 0xc0) != 0x80 ||
+                (s[3] & 0xc0) != 0x80)
+            {
+                break;
+            }
 
-    return anywhere(term, data);
-}
+            const char32_t wc =
+                (s[0] & 0x07) << 18 | (s[1] & 0x3f) << 12 |
+                (s[2] & 0x3f) << 6 | (s[3] & 0x3f);
 
-static enum state
-state_csi_intermediate_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_CSI_INTERMEDIATE;
-    case 0x30 ... 0x3f:                                                                                                    return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                  action_csi_dispatch(term, data);                                  return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_INTERMEDIATE;
-    }
+            if (unlikely(wc > 0x10ffff))
+                break;
 
-    return anywhere(term, data);
-}
+            out[n++] = wc;
+            i += 4;
+        }
 
-static enum state
-state_csi_ignore_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_execute(term, data);                                       return STATE_CSI_IGNORE;
-
-    case 0x20 ... 0x3f:                                  action_ignore(term);                                              return STATE_CSI_IGNORE;
-    case 0x40 ... 0x7e:                                                                                                    return STATE_GROUND;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_CSI_IGNORE;
+        else
+            break;
     }
 
-    return anywhere(term, data);
+    *count = n;
+    return i;
 }
 
-static enum state
-state_osc_string_switch(struct terminal *term, uint8_t data)
+UNITTEST
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-
-    /* Note: original was 20-7f, but I changed to 20-ff to include utf-8. Don't forget to add EXECUTE to 8-bit C1 if we implement that. */
-    default:                                             action_osc_put(term, data);                                       return STATE_OSC_STRING;
-
-    case 0x07:          action_osc_end(term, data);                                                                        return STATE_GROUND;
-
-    case 0x00 ... 0x06:
-    case 0x08 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_OSC_STRING;
-
-
-    case 0x18:
-    case 0x1a:          action_osc_end(term, data);      action_execute(term, data);                                       return STATE_GROUND;
-
-    case 0x1b:          action_osc_end(term, data);      action_clear(term);                                               return STATE_ESCAPE;
-    }
+    char32_t out[8];
+    size_t count;
+
+    /* 2, 3 and 4-byte sequences, terminated by ASCII */
+    const uint8_t mixed[] = "\xc3\xa5\xe4\xb8\xad\xf0\x9f\x98\x80" "a";
+    xassert(utf8_decode_block(mixed, sizeof(mixed) - 1, out, ALEN(out), &count) == 9);
+    xassert(count == 3);
+    xassert(out[0] == U'å');
+    xassert(out[1] == 0x4e2d);
+    xassert(out[2] == 0x1f600);
+
+    /* Truncated sequence is left for the state machine */
+    xassert(utf8_decode_block(mixed, 8, out, ALEN(out), &count) == 5);
+    xassert(count == 2);
+
+    /* Surrogate */
+    const uint8_t surrogate[] = "\xed\xa0\x80";
+    xassert(utf8_decode_block(surrogate, 3, out, ALEN(out), &count) == 0);
+    xassert(count == 0);
+
+    /* Out of range */
+    const uint8_t out_of_range[] = "\xf4\x90\x80\x80";
+    xassert(utf8_decode_block(out_of_range, 4, out, ALEN(out), &count) == 0);
+
+    /* Output buffer full */
+    xassert(utf8_decode_block(mixed, 9, out, 1, &count) == 2);
+    xassert(count == 1);
 }
 
-static enum state
-state_dcs_entry_switch(struct terminal *term, uint8_t data)
+/* Last code point of the most recently printed cell */
+static char32_t
+last_printed_code_point(const struct terminal *term)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_ENTRY;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_DCS_PARAM;
-    case 0x3c ... 0x3f:                                  action_collect(term, data);                                       return STATE_DCS_PARAM;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_ENTRY;
-    }
+    char32_t wc = term->vt.last_printed;
 
-    return anywhere(term, data);
-}
+    if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI) {
+        const struct composed *composed =
+            composed_lookup(term->composed, wc - CELL_COMB_CHARS_LO);
 
-static enum state
-state_dcs_param_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_PARAM;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x39:                                  action_param(term, data);                                         return STATE_DCS_PARAM;
-    case 0x3a:                                                                                                             return STATE_DCS_IGNORE;
-    case 0x3b:                                           action_param_new(term, data);                                     return STATE_DCS_PARAM;
-    case 0x3c ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PARAM;
+        if (composed != NULL)
+            wc = composed->chars[composed->count - 1];
     }
 
-    return anywhere(term, data);
+    return wc;
 }
 
-static enum state
-state_dcs_intermediate_switch(struct terminal *term, uint8_t data)
+/*
+ * Prints a block of decoded code points. This is equivalent to
+ * calling action_utf8_print() for each code point, but code points
+ * that are guaranteed to start a new cell (i.e. that don't combine
+ * with, or cluster with, the previous one) are batched into
+ * term_print_run() calls.
+ */
+static void
+action_utf8_print_decoded(struct terminal *term, const char32_t *wcs,
+                          size_t count)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:                                  action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
-
-    case 0x20 ... 0x2f:                                  action_collect(term, data);                                       return STATE_DCS_INTERMEDIATE;
-    case 0x30 ... 0x3f:                                                                                                    return STATE_DCS_IGNORE;
-    case 0x40 ... 0x7e:                                                                   action_hook(term, data);         return STATE_DCS_PASSTHROUGH;
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_INTERMEDIATE;
-    }
-
-    return anywhere(term, data);
-}
+    const bool grapheme_clustering = term->grapheme_shaping;
 
-static enum state
-state_dcs_ignore_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x1f:
-    case 0x20 ... 0x7f:                                  action_ignore(term);                                              return STATE_DCS_IGNORE;
-    }
+#if !defined(FOOT_GRAPHEME_CLUSTERING)
+    xassert(!grapheme_clustering);
+#endif
 
-    return anywhere(term, data);
-}
+    size_t run_start = 0;
+    size_t run_len = 0;
+    int run_width = 0;
+    char32_t UNUSED prev = 0;
 
-static enum state
-state_dcs_passthrough_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x7e:                                  action_put(term, data);                                           return STATE_DCS_PASSTHROUGH;
+    for (size_t i = 0; i < count; i++) {
+        const char32_t wc = wcs[i];
+        const int width = c32width(wc);
 
-    case 0x7f:                                           action_ignore(term);                                              return STATE_DCS_PASSTHROUGH;
+        /*
+         * The first code point always takes the slow path, since we
+         * don't know what it may combine with. Single-column
+         * terminals are excluded since the cursor may be at column
+         * 0 after a print.
+         */
+        bool batch = i > 0 && width > 0 && term->cols > 1;
 
-    /* Anywhere */
-    case 0x18:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1a:          action_unhook(term, data);       action_execute(term, data);                                       return STATE_GROUND;
-    case 0x1b:          action_unhook(term, data);                                        action_clear(term);              return STATE_ESCAPE;
+#if defined(FOOT_GRAPHEME_CLUSTERING)
+        if (batch && grapheme_clustering) {
+            const utf8proc_int32_t saved_state = term->vt.grapheme_state;
 
-    /* 8-bit C1 control characters (not supported) */
-    case 0x80 ... 0x9f: action_unhook(term, data);                                                                         return STATE_GROUND;
+            if (utf8proc_grapheme_break_stateful(
+                    prev, wc, &term->vt.grapheme_state))
+            {
+                term_reset_grapheme_state(term);
+            } else {
+                /* Part of the current cluster; restore state, and let
+                 * action_utf8_print() deal with it */
+                term->vt.grapheme_state = saved_state;
+                batch = false;
+            }
+        } else
+#endif
+        if (batch)
+            term_reset_grapheme_state(term);
 
-    default:                                                                                                               return STATE_DCS_PASSTHROUGH;
-    }
-}
+        if (batch && run_len > 0 && width != run_width) {
+            term_print_run_wide(term, &wcs[run_start], run_len, run_width);
+            run_len = 0;
+        }
 
-static enum state
-state_sos_pm_apc_string_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x00 ... 0x17:
-    case 0x19:
-    case 0x1c ... 0x7f:                                  action_ignore(term);                                              return STATE_SOS_PM_APC_STRING;
-    }
+        if (batch) {
+            if (run_len == 0) {
+                run_start = i;
+                run_width = width;
+            }
 
-    return anywhere(term, data);
-}
+            run_len++;
+            prev = wc;
+            continue;
+        }
 
-static enum state
-state_utf8_21_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_22(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+        if (run_len > 0) {
+            term_print_run_wide(term, &wcs[run_start], run_len, run_width);
+            run_len = 0;
+        }
 
-static enum state
-state_utf8_31_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_32(term, data);                                       return STATE_UTF8_32;
-    default:                                                                                                               return STATE_GROUND;
+        action_utf8_print(term, wc);
+        prev = last_printed_code_point(term);
     }
-}
 
-static enum state
-state_utf8_32_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_33(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
-    }
+    if (run_len > 0)
+        term_print_run_wide(term, &wcs[run_start], run_len, run_width);
 }
 
-static enum state
-state_utf8_41_switch(struct terminal *term, uint8_t data)
+/*
+ * Decodes, and prints, a block of multi-byte UTF-8 sequences. Returns
+ * the number of bytes consumed. See utf8_decode_block().
+ */
+static size_t
+action_utf8_print_block(struct terminal *term, const uint8_t *data, size_t len)
 {
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_42(term, data);                                       return STATE_UTF8_42;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+    char32_t wcs[512];
+    size_t total = 0;
+    size_t count;
 
-static enum state
-state_utf8_42_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_43(term, data);                                       return STATE_UTF8_43;
-    default:                                                                                                               return STATE_GROUND;
-    }
-}
+    do {
+        total += utf8_decode_block(
+            &data[total], len - total, wcs, ALEN(wcs), &count);
+        action_utf8_print_decoded(term, wcs, count);
+    } while (count == ALEN(wcs));
 
-static enum state
-state_utf8_43_switch(struct terminal *term, uint8_t data)
-{
-    switch (data) {
-        /*              exit                             current                          enter                            new state */
-    case 0x80 ... 0xbf:                                  action_utf8_44(term, data);                                       return STATE_GROUND;
-    default:                                                                                                               return STATE_GROUND;
-    }
+    return total;
 }
 
-UNIGNORE_WARNINGS
+#if defined(FOOT_VT_TABLE_DISPATCH) && FOOT_VT_TABLE_DISPATCH
+#define VT_DISPATCH_TABLE
+#else
+#define VT_DISPATCH_SWITCH
+#endif
+#include "vt-dispatch.h"
 
 void
 vt_from_slave(struct terminal *term, const uint8_t *data, size_t len)
@@ -1404,31 +1450,65 @@ vt_from_slave(struct terminal *term, const uint8_t *data, size_t len)
     enum state current_state = term->vt.state;
 
     const uint8_t *p = data;
-    for (size_t i = 0; i < len; i++, p++) {
-        switch (current_state) {
-        case STATE_GROUND:              current_state = state_ground_switch(term, *p); break;
-        case STATE_ESCAPE:              current_state = state_escape_switch(term, *p); break;
-        case STATE_ESCAPE_INTERMEDIATE: current_state = state_escape_intermediate_switch(term, *p); break;
-        case STATE_CSI_ENTRY:           current_state = state_csi_entry_switch(term, *p); break;
-        case STATE_CSI_PARAM:           current_state = state_csi_param_switch(term, *p); break;
-        case STATE_CSI_INTERMEDIATE:    current_state = state_csi_intermediate_switch(term, *p); break;
-        case STATE_CSI_IGNORE:          current_state = state_csi_ignore_switch(term, *p); break;
-        case STATE_OSC_STRING:          current_state = state_osc_string_switch(term, *p); break;
-        case STATE_DCS_ENTRY:           current_state = state_dcs_entry_switch(term, *p); break;
-        case STATE_DCS_PARAM:           current_state = state_dcs_param_switch(term, *p); break;
-        case STATE_DCS_INTERMEDIATE:    current_state = state_dcs_intermediate_switch(term, *p); break;
-        case STATE_DCS_IGNORE:          current_state = state_dcs_ignore_switch(term, *p); break;
-        case STATE_DCS_PASSTHROUGH:     current_state = state_dcs_passthrough_switch(term, *p); break;
-        case STATE_SOS_PM_APC_STRING:   current_state = state_sos_pm_apc_string_switch(term, *p); break;
-
-        case STATE_UTF8_21:             current_state = state_utf8_21_switch(term, *p); break;
-        case STATE_UTF8_31:             current_state = state_utf8_31_switch(term, *p); break;
-        case STATE_UTF8_32:             current_state = state_utf8_32_switch(term, *p); break;
-        case STATE_UTF8_41:             current_state = state_utf8_41_switch(term, *p); break;
-        case STATE_UTF8_42:             current_state = state_utf8_42_switch(term, *p); break;
-        case STATE_UTF8_43:             current_state = state_utf8_43_switch(term, *p); break;
+    const uint8_t *const end = data + len;
+
+    while (p < end) {
+        if (current_state == STATE_GROUND && *p >= 0x20 && *p <= 0x7e) {
+            /*
+             * Fast path: plain text. Print the entire run of
+             * printable ASCII in one go, bypassing the per-byte state
+             * machine dispatch.
+             */
+            const size_t count = printable_ascii_run(p, end - p);
+            action_print_ascii(term, p, count);
+            p += count;
+            continue;
         }
 
+        if (current_state == STATE_GROUND && *p >= 0xc2 && *p <= 0xf4) {
+            /*
+             * Fast path: decode, and print, complete UTF-8
+             * sequences without going through the UTF-8 states. If
+             * nothing could be decoded (invalid, or truncated
+             * sequence), fall through to the state machine.
+             */
+            const size_t count = action_utf8_print_block(term, p, end - p);
+            if (count > 0) {
+                p += count;
+                continue;
+            }
+        }
+
+        if (current_state == STATE_OSC_STRING && *p >= 0x20) {
+            /*
+             * Fast path: OSC string payload. Append everything up
+             * to the next C0 control character (which includes all
+             * terminators) in one go.
+             */
+            const size_t count = osc_string_run(p, end - p);
+            action_osc_put_span(term, p, count);
+            p += count;
+            continue;
+        }
+
+        if (current_state == STATE_DCS_PASSTHROUGH && *p >= 0x20 && *p <= 0x7e) {
+            /*
+             * Fast path: DCS payload. Printable ASCII is always
+             * passed through, as-is, to the DCS handler.
+             */
+            const size_t count = printable_ascii_run(p, end - p);
+            action_put_span(term, p, count);
+            p += count;
+            continue;
+        }
+
+#if defined(FOOT_VT_TABLE_DISPATCH) && FOOT_VT_TABLE_DISPATCH
+        current_state = table_dispatch(term, current_state, *p);
+#else
+        current_state = switch_dispatch(term, current_state, *p);
+#endif
+
         term->vt.state = current_state;
+        p++;
     }
 }